@@ -1,6 +1,7 @@
 #include "cairo_plot.h"
 #include <FL/names.h> //for fl_eventnames
 #include <cmath>
+#include "raw_log_reader.h"
 
 cairo_plot::cairo_plot (int x, int y, int w, int h, const char *l)
   : cairo_box (x, y, w, h, l),
@@ -233,36 +234,25 @@ void cairo_plot::cairo_draw()
 
 void cairo_plot::load_csv (const char *fn, double FS)
 {
-  double value;
-  int cnt = 0;
-  ifstream in (fn);
-  if (in.is_open())
+  try
     {
+      raw_log_reader in (fn);
+      vector<double> values;
+      in.read (0, in.size (), values);
+
       clear ();
-      while (! in.fail ())
-        {
-          in >> value;
-          //cout << value << endl;;
-          add_point (cnt/FS, value);
-          cnt++;
-        }
+      xdata.reserve (values.size ());
+      ydata.reserve (values.size ());
+      for (unsigned int cnt = 0; cnt < values.size (); ++cnt)
+        add_point (cnt/FS, values[cnt]);
 
       update_limits ();
       redraw ();
-
-      //cout << "fail =" << in.fail() << endl;
-      //cout << "bad =" << in.bad() << endl;
-      //cout << "eof =" << in.eof() << endl;
-
-      if (in.fail () && ! in.eof ())
-        cerr << "Couldn't read double in line " << cnt << endl;
-      //cout << "read " << cnt << " values..." << endl;
-
-      in.close();
     }
-  else
-    cerr << "Unable to open file '" << fn << "'" << endl;
-
+  catch (exception& e)
+    {
+      cerr << e.what () << endl;
+    }
 }
 
 int cairo_plot::handle (int event)
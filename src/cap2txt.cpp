@@ -0,0 +1,58 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+cap2txt: print a liballuris USB capture (see liballuris_set_capture_file) as text
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fstream>
+#include "usb_capture_replay.h"
+
+/*
+  Usage: cap2txt CAPTURE_FN [TXT_FN]
+  writes to stdout if TXT_FN is omitted
+*/
+int main (int argc, char **argv)
+{
+  if (argc < 2 || argc > 3)
+    {
+      cerr << "Usage: cap2txt CAPTURE_FN [TXT_FN]" << endl;
+      return -1;
+    }
+
+  try
+    {
+      if (argc == 3)
+        {
+          ofstream out (argv[2]);
+          if (! out)
+            throw runtime_error (string ("Can't create ") + argv[2]);
+          usb_capture_to_text (argv[1], out);
+        }
+      else
+        usb_capture_to_text (argv[1], cout);
+    }
+  catch (exception& e)
+    {
+      cerr << "cap2txt: " << e.what () << endl;
+      return -1;
+    }
+  return 0;
+}
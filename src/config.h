@@ -1,2 +1,5 @@
 //#define ISO6789_1
 #define ISO6789
+
+// sampling rate of the TTT in LIBALLURIS_MODE_PEAK in samples per second
+#define TTT_SPS 900
@@ -56,7 +56,8 @@ CREATE TABLE torque_tester (id INTEGER PRIMARY KEY,
                           calibration_number TEXT,
                           max_torque REAL,
                           resolution REAL,
-                          uncertainty_of_measurement REAL);
+                          uncertainty_of_measurement REAL,
+                          digits INTEGER);
 
 ---------------------------------------------------------------------------
 
@@ -70,6 +71,8 @@ CREATE TABLE measurement (id INTEGER PRIMARY KEY,
                           raw_data_filename TEXT,
                           temperature REAL,   -- [°C]
                           humidity REAL,     -- [%rH]
+                          state TEXT,        -- running, aborted, finished (NULL: saved at the end)
+                          repeat_on_timing_violation INTEGER, -- to regenerate the steps on resume
                           FOREIGN KEY(test_person_id) REFERENCES test_person(id),
                           FOREIGN KEY(test_object_id) REFERENCES test_object(id),
                           FOREIGN KEY(torque_tester_id) REFERENCES torque_tester(id)
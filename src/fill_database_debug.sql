@@ -56,8 +56,9 @@ INSERT INTO torque_tester (serial_number,
                          calibration_number,
                          max_torque,
                          resolution,
-                         uncertainty_of_measurement)
-       VALUES ("L.23451", "Alluris GmbH & Co. KG", "TTT-300C1", "2017-01", "2000-05-03", "calnumber fillme", 10, 0.01, 0.005);
+                         uncertainty_of_measurement,
+                         digits)
+       VALUES ("L.23451", "Alluris GmbH & Co. KG", "TTT-300C1", "2017-01", "2000-05-03", "calnumber fillme", 10, 0.01, 0.005, 2);
 
 INSERT INTO measurement (norm,
                          test_person_id,
@@ -0,0 +1,114 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class fixed_ring: ring buffer with fixed capacity
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FIXED_RING_H
+#define FIXED_RING_H
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/*
+ * The storage is allocated once with allocate (), outside of the sample path.
+ * Not thread safe, see spsc_ring for the acquisition path.
+ */
+template <typename T> class fixed_ring
+{
+private:
+  vector<T> buf;
+  size_t first;   // position of the oldest element
+  size_t len;
+
+public:
+  fixed_ring ()
+    : first (0), len (0)
+  {}
+
+  void allocate (size_t capacity)
+  {
+    buf.resize (capacity);
+    first = 0;
+    len = 0;
+  }
+
+  size_t capacity () const
+  {
+    return buf.size ();
+  }
+
+  size_t size () const
+  {
+    return len;
+  }
+
+  bool empty () const
+  {
+    return len == 0;
+  }
+
+  bool full () const
+  {
+    return len == buf.size ();
+  }
+
+  void clear ()
+  {
+    first = 0;
+    len = 0;
+  }
+
+  // k = 0 is the oldest element
+  T& operator[] (size_t k)
+  {
+    return buf[(first + k) % buf.size ()];
+  }
+
+  T& front ()
+  {
+    return buf[first];
+  }
+
+  T& back ()
+  {
+    return (*this)[len - 1];
+  }
+
+  // the oldest element is overwritten if the ring is full
+  void push_back (const T &v)
+  {
+    if (full ())
+      pop_front ();
+    buf[(first + len) % buf.size ()] = v;
+    len++;
+  }
+
+  void pop_front ()
+  {
+    first = (first + 1) % buf.size ();
+    len--;
+  }
+};
+
+#endif
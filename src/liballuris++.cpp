@@ -44,10 +44,19 @@ string liballuris::err_msg (int err)
   return ret;
 }
 
+bool liballuris::is_disconnect_error (int err)
+{
+  // IO and PIPE are also reported by a device which is still present
+  return    err == LIBUSB_ERROR_NO_DEVICE
+            || err == LIBUSB_ERROR_NOT_FOUND;
+}
+
 #define ERR_PREFIX(e) liballuris_error_name (e) << " in " << __FILE__ << ":" << __LINE__ << "(" << __FUNCTION__ << "):"
-#define RUNTIME_ERROR(e, msg) if(e) { std::ostringstream tmp_err; tmp_err << ERR_PREFIX(e) << msg << "\n\n" << err_msg(e); throw runtime_error (tmp_err.str ());}
+#define RUNTIME_ERROR(e, msg) if(e) { std::ostringstream tmp_err; tmp_err << ERR_PREFIX(e) << msg << "\n\n" << err_msg(e); throw liballuris_exception (e, tmp_err.str ());}
 
 liballuris::liballuris ()
+  : usb_h (0), stream (0), hotplug_handle (0), hotplug_registered (false),
+    digits_cache (-1)
 {
   cout << "liballuris c'tor" << endl;
 
@@ -57,11 +66,13 @@ liballuris::liballuris ()
   r = liballuris_open_device (usb_ctx, NULL, &usb_h);
   RUNTIME_ERROR(r, "c'tor  liballuris_open_device");
 
-  r = libusb_claim_interface (usb_h, 0);
+  r = claim_interface ();
   RUNTIME_ERROR(r, "c'tor libusb_claim_interface");
 }
 
 liballuris::liballuris (string serial)
+  : usb_h (0), stream (0), hotplug_handle (0), hotplug_registered (false),
+    digits_cache (-1)
 {
   cout << "liballuris c'tor with serial = " << serial << endl;
 
@@ -71,17 +82,113 @@ liballuris::liballuris (string serial)
   r = liballuris_open_device (usb_ctx, serial.c_str(), &usb_h);
   RUNTIME_ERROR(r,"c'tor open_device. Couldn't connect to FMI-S/B device with given serial.");
 
-  r = libusb_claim_interface (usb_h, 0);
+  r = claim_interface ();
+  RUNTIME_ERROR(r,"c'tor libusb_claim_interface");
+}
+
+liballuris::liballuris (libusb_context* ctx, string serial)
+  : usb_ctx (ctx), usb_h (0), stream (0), hotplug_handle (0), hotplug_registered (false),
+    digits_cache (-1)
+{
+  cout << "liballuris c'tor with shared context, serial = " << serial << endl;
+
+  int r = liballuris_open_device (usb_ctx, serial.empty ()? NULL : serial.c_str(), &usb_h);
+  RUNTIME_ERROR(r,"c'tor open_device. Couldn't connect to FMI-S/B device with given serial.");
+
+  r = claim_interface ();
   RUNTIME_ERROR(r,"c'tor libusb_claim_interface");
 }
 
 liballuris::~liballuris ()
 {
   cout << "liballuris d'tor" << endl;
-  liballuris_clear_RX (usb_h, 500);
-  liballuris_clear_RX (usb_h, 500);
-  libusb_release_interface (usb_h, 0);
-  libusb_close (usb_h);
+  deregister_hotplug ();
+  if (stream)
+    liballuris_stop_streaming (stream);
+  if (usb_h)
+    liballuris_drain_RX (usb_h, LIBALLURIS_DRAIN_IDLE_TIMEOUT, 1000);
+  close_device ();
+}
+
+// virtual devices (see liballuris_add_virtual_device) aren't libusb handles
+int liballuris::claim_interface ()
+{
+  if (liballuris_is_virtual_device (usb_h))
+    return LIBUSB_SUCCESS;
+  return libusb_claim_interface (usb_h, 0);
+}
+
+void liballuris::close_device ()
+{
+  if (usb_h)
+    {
+      liballuris_reset_metrics (usb_h);
+      if (! liballuris_is_virtual_device (usb_h))
+        {
+          libusb_release_interface (usb_h, 0);
+          libusb_close (usb_h);
+        }
+      usb_h = 0;
+    }
+}
+
+void liballuris::reopen (string serial)
+{
+  cout << "liballuris::reopen serial = " << serial << endl;
+
+  // the old device is gone, errors while stopping are expected
+  if (stream)
+    {
+      liballuris_stop_streaming (stream);
+      stream = 0;
+    }
+  close_device ();
+  digits_cache = -1;
+  firmware_cache.clear ();
+
+  int r = liballuris_open_device (usb_ctx, serial.c_str(), &usb_h);
+  if (r)
+    usb_h = 0;
+  RUNTIME_ERROR(r,"reopen open_device");
+
+  r = claim_interface ();
+  if (r)
+    {
+      libusb_close (usb_h);
+      usb_h = 0;
+    }
+  RUNTIME_ERROR(r,"reopen libusb_claim_interface");
+}
+
+bool liballuris::register_hotplug (libusb_hotplug_callback_fn cb, void *user_data)
+{
+  if (   hotplug_registered || ! libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG)
+      || liballuris_is_virtual_device (usb_h))
+    return hotplug_registered;
+
+  int r = libusb_hotplug_register_callback (usb_ctx,
+          LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+          LIBUSB_HOTPLUG_NO_FLAGS, 0x04d8, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+          cb, user_data, &hotplug_handle);
+  hotplug_registered = (r == LIBUSB_SUCCESS);
+  if (! hotplug_registered)
+    cerr << "liballuris::register_hotplug failed: " << liballuris_error_name (r) << endl;
+  return hotplug_registered;
+}
+
+void liballuris::deregister_hotplug ()
+{
+  if (hotplug_registered)
+    libusb_hotplug_deregister_callback (usb_ctx, hotplug_handle);
+  hotplug_registered = false;
+}
+
+void liballuris::handle_events (int timeout)
+{
+  struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+  int r = libusb_handle_events_timeout_completed (usb_ctx, &tv, NULL);
+  if (r != LIBUSB_ERROR_INTERRUPTED)
+    RUNTIME_ERROR(r,"handle_events");
 }
 
 void liballuris::set_debug_level (int l)
@@ -184,10 +291,14 @@ double liballuris::get_uncertainty ()
 
 int liballuris::get_digits ()
 {
-  int digits;
-  int r = liballuris_get_digits (usb_h, &digits);
-  RUNTIME_ERROR(r,"");
-  return digits;
+  if (digits_cache < 0)
+    {
+      int r = liballuris_get_digits (usb_h, &digits_cache);
+      if (r)
+        digits_cache = -1;
+      RUNTIME_ERROR(r,"");
+    }
+  return digits_cache;
 }
 
 int liballuris::get_resolution ()
@@ -227,6 +338,60 @@ vector<int> liballuris::poll_measurement_no_wait ()
   return samples;
 }
 
+void liballuris::start_streaming (int packet_length, liballuris_stream_sink sink, void *user_data)
+{
+  if (stream)
+    throw runtime_error ("liballuris::start_streaming: stream already started");
+
+  int r = liballuris_start_streaming (usb_ctx, usb_h, packet_length, sink, user_data, &stream);
+  RUNTIME_ERROR(r,"start_streaming");
+}
+
+void liballuris::handle_stream_events (int timeout)
+{
+  if (stream)
+    {
+      int r = liballuris_handle_stream_events (stream, timeout);
+      RUNTIME_ERROR(r,"handle_stream_events");
+    }
+}
+
+void liballuris::check_stream ()
+{
+  if (stream)
+    {
+      int r = liballuris_stream_error (stream);
+      RUNTIME_ERROR(r,"check_stream");
+    }
+}
+
+void liballuris::stop_streaming ()
+{
+  if (stream)
+    {
+      int r = liballuris_stop_streaming (stream);
+      stream = 0;
+      RUNTIME_ERROR(r,"stop_streaming");
+    }
+}
+
+liballuris_metrics liballuris::get_metrics ()
+{
+  liballuris_metrics m;
+  liballuris_get_metrics (usb_h, &m);
+  return m;
+}
+
+void liballuris::print_metrics (FILE *sink)
+{
+  liballuris_print_metrics (sink, usb_h);
+}
+
+void liballuris::set_expected_sample_rate (double sps)
+{
+  liballuris_set_expected_sample_rate (usb_h, sps);
+}
+
 void liballuris::tare ()
 {
   int r = liballuris_tare (usb_h);
@@ -282,6 +447,7 @@ void liballuris::set_mode (enum liballuris_measurement_mode mode)
 void liballuris::set_unit (enum liballuris_unit unit)
 {
   int r = liballuris_set_unit (usb_h, unit);
+  digits_cache = -1;
   RUNTIME_ERROR(r,"");
 }
 
@@ -290,6 +456,11 @@ void liballuris::clear_RX (int timeout)
   liballuris_clear_RX (usb_h, timeout);
 }
 
+int liballuris::drain_RX (int idle_timeout, int max_time)
+{
+  return liballuris_drain_RX (usb_h, idle_timeout, max_time);
+}
+
 void liballuris::set_peak_level (double level)
 {
   int tmp = round (level * 100);
@@ -333,21 +504,80 @@ void liballuris::set_memory_mode (liballuris_memory_mode mode)
 
 vector<int> liballuris::read_memory ()
 {
-  vector<int> ret;
   int num = 0;
   int r = liballuris_get_mem_count (usb_h, &num);
   RUNTIME_ERROR(r,"liballuris::read_memory get_mem_count");
 
-  for (int k=0; k < num; ++k)
+  vector<int> ret (num);
+  if (num > 0)
     {
-      int value = 0;
-      r = liballuris_read_memory (usb_h, k, &value);
+      r = liballuris_read_memory_block (usb_h, 0, num, &ret[0], 0, 0);
       RUNTIME_ERROR(r,"liballuris::read_memory");
-      ret.push_back (value);
     }
   return ret;
 }
 
+vector<memory_record> liballuris::read_memory_records (int words_per_record, liballuris_progress_cb progress, void *user_data)
+{
+  if (words_per_record < 1 || words_per_record > 2)
+    throw runtime_error ("liballuris::read_memory_records: words_per_record has to be 1 or 2");
+
+  int num = 0;
+  int r = liballuris_get_mem_count (usb_h, &num);
+  RUNTIME_ERROR(r,"liballuris::read_memory_records get_mem_count");
+
+  vector<int> words (num);
+  if (num > 0)
+    {
+      r = liballuris_read_memory_block (usb_h, 0, num, &words[0], progress, user_data);
+      RUNTIME_ERROR(r,"liballuris::read_memory_records");
+    }
+
+  vector<memory_record> ret;
+  for (int k=0; k < num; k += words_per_record)
+    {
+      memory_record m;
+      m.adr = k;
+      m.value = words[k];
+      m.aux = (words_per_record == 2 && k + 1 < num)? words[k + 1] : 0;
+      ret.push_back (m);
+    }
+  return ret;
+}
+
+memory_statistics liballuris::get_memory_statistics ()
+{
+  memory_statistics ret;
+
+  // the reply has no count, an empty memory is reported as all 0.
+  // get_digits and get_firmware only cost a round trip on the first call
+  // after the device was opened
+  int stats[6];
+  int r = liballuris_get_mem_statistics (usb_h, stats, 6);
+  RUNTIME_ERROR(r,"get_memory_statistics");
+  ret.empty = true;
+  for (int k = 0; k < 6; ++k)
+    if (stats[k])
+      ret.empty = false;
+
+  int digits = get_digits ();
+  double scale = pow (10, -digits);
+  ret.max_plus  = stats[0] * scale;
+  ret.min_plus  = stats[1] * scale;
+  ret.max_minus = stats[2] * scale;
+  ret.min_minus = stats[3] * scale;
+  ret.mean      = stats[4] * scale;
+
+  // firmware < V5.04.007 uses fixed 3 digits for the variance
+  int major = 0, minor = 0, build = 0;
+  sscanf (get_firmware ().c_str (), "V%d.%d.%d", &major, &minor, &build);
+  if (major * 1000000 + minor * 1000 + build < 5004007)
+    ret.variance = stats[5] * 1e-3;
+  else
+    ret.variance = stats[5] * scale;
+  return ret;
+}
+
 void liballuris::clear_memory ()
 {
   int r = liballuris_delete_memory (usb_h);
@@ -398,10 +628,14 @@ string liballuris::get_variant ()
 
 string liballuris::get_firmware ()
 {
-  char tmp_buf[SERIAL_LEN];
-  int r = liballuris_get_firmware (usb_h, 0, tmp_buf, SERIAL_LEN);
-  RUNTIME_ERROR(r,"get_firmware");
-  return tmp_buf;
+  if (firmware_cache.empty ())
+    {
+      char tmp_buf[SERIAL_LEN];
+      int r = liballuris_get_firmware (usb_h, 0, tmp_buf, SERIAL_LEN);
+      RUNTIME_ERROR(r,"get_firmware");
+      firmware_cache = tmp_buf;
+    }
+  return firmware_cache;
 }
 
 liballuris_state liballuris::read_state ()
@@ -40,19 +40,86 @@ If not, see <http://www.gnu.org/licenses/>.
 
 using namespace std;
 
+//! runtime_error thrown by class liballuris, code is the liballuris_error or libusb_error
+class liballuris_exception: public runtime_error
+{
+public:
+  int code;
+  liballuris_exception (int c, const string &msg)
+    : runtime_error (msg), code (c)
+  {}
+};
+
+//! one record of the device memory
+struct memory_record
+{
+  int adr;    //!< address of the first word
+  int value;  //!< raw value, multiply with 10^-digits (see get_digits)
+  int aux;    //!< second word of two-word records (LIBALLURIS_MEM_MODE_QUICK_CHECK), 0 otherwise
+};
+
+//! statistics of the device memory computed by the device, see liballuris_get_mem_statistics
+struct memory_statistics
+{
+  bool empty;         //!< nothing stored, the device reports all statistics as 0
+  double max_plus;
+  double min_plus;
+  double max_minus;
+  double min_minus;
+  double mean;
+  double variance;
+
+  double std_dev () const
+  {
+    return sqrt (variance);
+  }
+};
+
 class liballuris
 {
 private:
   libusb_context* usb_ctx;
   libusb_device_handle* usb_h;
+  liballuris_stream* stream;
+  libusb_hotplug_callback_handle hotplug_handle;
+  bool hotplug_registered;
+
+  // digits and firmware don't change while the device is open (digits may change with set_unit),
+  // -1 and "" are unknown
+  int digits_cache;
+  string firmware_cache;
+
+  int claim_interface ();
+  void close_device ();
 
 public:
   string err_msg (int err);
+  //! the device was unplugged (NO_DEVICE, NOT_FOUND), other errors are thrown by the callers
+  static bool is_disconnect_error (int err);
 
   liballuris ();
   explicit liballuris (string serial);
+  // use a libusb context which is shared with other devices, serial may be empty for the first device
+  liballuris (libusb_context* ctx, string serial);
   ~liballuris ();
 
+  // close the (unplugged) device and open the device with serial on the same context
+  void reopen (string serial);
+  bool is_virtual_device ()
+  {
+    return liballuris_is_virtual_device (usb_h);
+  }
+  libusb_device* get_device ()
+  {
+    return (usb_h && ! liballuris_is_virtual_device (usb_h)) ? libusb_get_device (usb_h) : 0;
+  }
+
+  // call cb if Alluris devices are attached or detached, the callback is called
+  // from event handling (see handle_events). Returns false if hotplug isn't supported (Windows)
+  bool register_hotplug (libusb_hotplug_callback_fn cb, void *user_data);
+  void deregister_hotplug ();
+  void handle_events (int timeout);
+
   void set_debug_level (int l);
 
   string get_serial_number ();
@@ -68,6 +135,28 @@ public:
   void set_cyclic_measurement (bool enable, int packet_length);
 
   vector<int> poll_measurement_no_wait ();
+
+  // asynchronous streaming, see liballuris_start_streaming
+  void start_streaming (int packet_length, liballuris_stream_sink sink, void *user_data);
+  void handle_stream_events (int timeout);
+  // throws if the stream was terminated, for streams where another thread handles the events
+  void check_stream ();
+  void stop_streaming ();
+  // error of the stream, 0 if ok. Doesn't throw
+  int stream_error ()
+  {
+    return stream ? liballuris_stream_error (stream) : 0;
+  }
+  bool is_streaming ()
+  {
+    return stream != 0;
+  }
+
+  // USB transport metrics, see liballuris_get_metrics
+  liballuris_metrics get_metrics ();
+  void print_metrics (FILE *sink);
+  void set_expected_sample_rate (double sps);
+
   void tare ();
 
   void start_measurement ();
@@ -81,6 +170,8 @@ public:
   void set_mode (enum liballuris_measurement_mode mode);
   void set_unit (enum liballuris_unit unit);
   void clear_RX (int timeout);
+  // read until no packet arrives within idle_timeout, at most max_time ms
+  int drain_RX (int idle_timeout, int max_time);
 
   void set_peak_level (double level);
   double get_peak_level ();
@@ -90,7 +181,12 @@ public:
 
   void set_memory_mode (liballuris_memory_mode mode);
   vector<int> read_memory ();
+  // read all stored words and group them into records of words_per_record words
+  // progress (optional) is called after every word, see liballuris_progress_cb
+  vector<memory_record> read_memory_records (int words_per_record = 1, liballuris_progress_cb progress = 0, void *user_data = 0);
   void clear_memory ();
+  // scaled with get_digits, one round trip if digits and firmware are cached
+  memory_statistics get_memory_statistics ();
 
   void set_data_ratio (int decimate);
   int get_pos_peak ();
@@ -26,6 +26,9 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "liballuris.h"
+#include <math.h>
+#include <pthread.h>
+#include <errno.h>
 
 int liballuris_debug_level;
 
@@ -157,6 +160,492 @@ static void print_buffer (unsigned char* buf, int len)
   fprintf (stderr, "\n");
 }
 
+/****************************************************************************************/
+// USB transport metrics per device handle
+
+//! Internal registry entry for \ref liballuris_get_metrics
+struct liballuris_metrics_entry
+{
+  libusb_device_handle* dev_handle;
+  struct liballuris_metrics m;
+  struct timeval last_packet;           //!< arrival of the last streaming packet
+  char stream_restart;                  //!< don't measure the interval to the next packet
+  unsigned long timed_samples;          //!< samples of packets with measured interval
+};
+
+static struct liballuris_metrics_entry metrics_registry[MAX_NUM_DEVICES];
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double timeval_diff (struct timeval *t1, struct timeval *t2)
+{
+  return (t2->tv_sec - t1->tv_sec) + (t2->tv_usec - t1->tv_usec)/1.0e6;
+}
+
+//! Internal: find or create the registry entry of dev_handle. Call with metrics_mutex locked.
+static struct liballuris_metrics_entry* liballuris_metrics_entry (libusb_device_handle* dev_handle)
+{
+  int k;
+  struct liballuris_metrics_entry* unused = NULL;
+  for (k=0; k < MAX_NUM_DEVICES; ++k)
+    {
+      if (metrics_registry[k].dev_handle == dev_handle)
+        return &metrics_registry[k];
+      if (! unused && ! metrics_registry[k].dev_handle)
+        unused = &metrics_registry[k];
+    }
+
+  // registry full: no metrics for this handle
+  if (unused)
+    {
+      memset (unused, 0, sizeof (*unused));
+      unused->dev_handle = dev_handle;
+    }
+  return unused;
+}
+
+//! Internal: histogram bin for a latency in microseconds
+static int liballuris_latency_bin (unsigned long us)
+{
+  int bin = 0;
+  while (us >= 2 && bin < LIBALLURIS_METRICS_HIST_BINS - 1)
+    {
+      us >>= 1;
+      bin++;
+    }
+  return bin;
+}
+
+//! Internal: record a send or receive latency of funcname
+static void liballuris_record_latency (libusb_device_handle* dev_handle, const char* funcname, char recv, char new_call, struct timeval *t1, struct timeval *t2)
+{
+  double diff = timeval_diff (t1, t2);
+  unsigned long us = (diff > 0)? (unsigned long) (diff * 1e6) : 0;
+
+  pthread_mutex_lock (&metrics_mutex);
+  struct liballuris_metrics_entry* e = liballuris_metrics_entry (dev_handle);
+  if (e)
+    {
+      // funcname is always __FUNCTION__, compare pointers first
+      struct liballuris_cmd_metrics* c = NULL;
+      int k;
+      for (k=0; k < e->m.num_cmds && ! c; ++k)
+        if (e->m.cmd[k].name == funcname || ! strcmp (e->m.cmd[k].name, funcname))
+          c = &e->m.cmd[k];
+
+      if (! c && e->m.num_cmds < LIBALLURIS_METRICS_MAX_CMDS)
+        {
+          c = &e->m.cmd[e->m.num_cmds++];
+          c->name = funcname;
+        }
+
+      if (c)
+        {
+          if (new_call)
+            c->count++;
+          if (recv)
+            {
+              c->recv_hist[liballuris_latency_bin (us)]++;
+              if (us > c->recv_max_us)
+                c->recv_max_us = us;
+            }
+          else
+            {
+              c->send_hist[liballuris_latency_bin (us)]++;
+              if (us > c->send_max_us)
+                c->send_max_us = us;
+            }
+        }
+    }
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+//! Internal counters of struct liballuris_metrics
+enum liballuris_metrics_counter
+{
+  METRICS_SAMPLES_IGNORED,
+  METRICS_OVERFLOW,
+  METRICS_TIMEOUT,
+  METRICS_ERROR,
+  METRICS_STREAM_IGNORED
+};
+
+//! Internal: increment a counter of dev_handle
+static void liballuris_count (libusb_device_handle* dev_handle, enum liballuris_metrics_counter c)
+{
+  pthread_mutex_lock (&metrics_mutex);
+  struct liballuris_metrics_entry* e = liballuris_metrics_entry (dev_handle);
+  if (e)
+    switch (c)
+      {
+      case METRICS_SAMPLES_IGNORED:
+        e->m.samples_ignored++;
+        break;
+      case METRICS_OVERFLOW:
+        e->m.overflows++;
+        break;
+      case METRICS_TIMEOUT:
+        e->m.timeouts++;
+        break;
+      case METRICS_ERROR:
+        e->m.errors++;
+        break;
+      case METRICS_STREAM_IGNORED:
+        e->m.stream_ignored++;
+        break;
+      }
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+//! Internal: a (libusb) error code occurred in a transfer of dev_handle
+static void liballuris_count_error (libusb_device_handle* dev_handle, int r)
+{
+  if (r == LIBUSB_ERROR_OVERFLOW)
+    liballuris_count (dev_handle, METRICS_OVERFLOW);
+  else if (r == LIBUSB_ERROR_TIMEOUT)
+    liballuris_count (dev_handle, METRICS_TIMEOUT);
+  else
+    liballuris_count (dev_handle, METRICS_ERROR);
+}
+
+//! Internal: a streaming packet with num_samples arrived
+static void liballuris_record_stream_packet (libusb_device_handle* dev_handle, size_t num_samples)
+{
+  struct timeval now;
+  gettimeofday (&now, NULL);
+
+  pthread_mutex_lock (&metrics_mutex);
+  struct liballuris_metrics_entry* e = liballuris_metrics_entry (dev_handle);
+  if (e)
+    {
+      struct liballuris_metrics *m = &e->m;
+      if (m->stream_packets > 0 && ! e->stream_restart)
+        {
+          double dt = timeval_diff (&e->last_packet, &now);
+          m->stream_seconds += dt;
+
+          double expected = m->stream_mean_interval;
+          if (m->stream_expected_sps > 0)
+            expected = num_samples / m->stream_expected_sps;
+
+          if (expected > 0 && dt > 1.5 * expected)
+            m->stream_gaps++;
+
+          if (m->stream_mean_interval > 0)
+            m->stream_mean_interval = 0.99 * m->stream_mean_interval + 0.01 * dt;
+          else
+            m->stream_mean_interval = dt;
+
+          // the samples of a packet were taken in the interval before its arrival
+          e->timed_samples += num_samples;
+          if (m->stream_expected_sps > 0)
+            m->stream_dropped_est = lround (m->stream_seconds * m->stream_expected_sps) - (long) e->timed_samples;
+        }
+      e->stream_restart = 0;
+      m->stream_packets++;
+      m->stream_samples += num_samples;
+      e->last_packet = now;
+    }
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+//! Internal: streaming (re)starts, the pause isn't a gap
+static void liballuris_record_stream_start (libusb_device_handle* dev_handle)
+{
+  pthread_mutex_lock (&metrics_mutex);
+  struct liballuris_metrics_entry* e = liballuris_metrics_entry (dev_handle);
+  if (e)
+    e->stream_restart = 1;
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+/*
+ * Capture of all USB frames for offline analysis and replay (see usb_capture_replay.h),
+ * the file format is described in liballuris.h
+ */
+static FILE* capture_fp = NULL;
+static struct timeval capture_t0;
+static libusb_device_handle* capture_devices[MAX_NUM_DEVICES];
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t capture_env_once = PTHREAD_ONCE_INIT;
+
+//! Internal: write v as little endian with n bytes
+static void liballuris_put_le (unsigned char* p, unsigned long long v, int n)
+{
+  int k;
+  for (k=0; k<n; ++k)
+    p[k] = (v >> (8 * k)) & 0xFF;
+}
+
+//! Internal: close the capture, call with capture_mutex locked
+static void liballuris_close_capture (void)
+{
+  if (capture_fp)
+    fclose (capture_fp);
+  capture_fp = NULL;
+}
+
+//! Internal: open a capture, call with capture_mutex locked
+static int liballuris_open_capture (const char* fn)
+{
+  liballuris_close_capture ();
+  if (! fn || ! *fn)
+    return LIBALLURIS_SUCCESS;
+
+  capture_fp = fopen (fn, "wb");
+  if (! capture_fp)
+    {
+      fprintf (stderr, "Error: Couldn't create capture file '%s': %s\n", fn, strerror (errno));
+      return LIBUSB_ERROR_IO;
+    }
+
+  gettimeofday (&capture_t0, NULL);
+  memset (capture_devices, 0, sizeof (capture_devices));
+
+  unsigned char h[16];
+  memcpy (h, LIBALLURIS_CAPTURE_MAGIC, 8);
+  liballuris_put_le (h + 8, capture_t0.tv_sec * 1000000ULL + capture_t0.tv_usec, 8);
+  fwrite (h, 1, sizeof (h), capture_fp);
+  fflush (capture_fp);
+  return LIBALLURIS_SUCCESS;
+}
+
+static void liballuris_close_capture_at_exit (void)
+{
+  pthread_mutex_lock (&capture_mutex);
+  liballuris_close_capture ();
+  pthread_mutex_unlock (&capture_mutex);
+}
+
+//! Internal: start a capture if $LIBALLURIS_CAPTURE is set
+static void liballuris_capture_from_env (void)
+{
+  const char* env = getenv ("LIBALLURIS_CAPTURE");
+  if (env && *env)
+    {
+      pthread_mutex_lock (&capture_mutex);
+      if (! capture_fp && liballuris_open_capture (env) == LIBALLURIS_SUCCESS)
+        atexit (liballuris_close_capture_at_exit);
+      pthread_mutex_unlock (&capture_mutex);
+    }
+}
+
+/*!
+ * \brief Capture all USB frames to a file
+ *
+ * Every command, reply and streaming packet of all devices is appended to fn
+ * with direction, timestamp, command id and payload (format see liballuris.h).
+ * Without calling this function the capture is started on first use
+ * if the environment variable LIBALLURIS_CAPTURE contains a filename.
+ * \param[in] fn filename, an existing file is overwritten. NULL or "" stops the capture.
+ * \return 0 if successful else LIBUSB_ERROR_IO
+ */
+int liballuris_set_capture_file (const char* fn)
+{
+  // don't let a later first transfer overwrite this setting
+  pthread_once (&capture_env_once, liballuris_capture_from_env);
+
+  pthread_mutex_lock (&capture_mutex);
+  int r = liballuris_open_capture (fn);
+  pthread_mutex_unlock (&capture_mutex);
+  return r;
+}
+
+//! Internal: append a record to the capture file
+static void liballuris_capture (libusb_device_handle* dev_handle, enum liballuris_capture_direction dir,
+                                const unsigned char* data, int len, int result, unsigned int timeout)
+{
+  pthread_once (&capture_env_once, liballuris_capture_from_env);
+
+  pthread_mutex_lock (&capture_mutex);
+  if (capture_fp)
+    {
+      struct timeval now;
+      gettimeofday (&now, NULL);
+      long long us = (now.tv_sec - capture_t0.tv_sec) * 1000000LL + (now.tv_usec - capture_t0.tv_usec);
+
+      int dev = 0;
+      if (dev_handle)
+        {
+          while (dev < MAX_NUM_DEVICES - 1 && capture_devices[dev] && capture_devices[dev] != dev_handle)
+            dev++;
+          capture_devices[dev] = dev_handle;
+        }
+
+      if (len < 0 || ! data)
+        len = 0;
+
+      unsigned char r[LIBALLURIS_CAPTURE_RECORD_SIZE];
+      liballuris_put_le (r, (us > 0)? us : 0, 8);
+      r[8] = dir;
+      r[9] = dev;
+      r[10] = (len > 0)? data[0] : 0;
+      r[11] = (signed char) result;
+      liballuris_put_le (r + 12, (timeout > 0xFFFF)? 0xFFFF : timeout, 2);
+      liballuris_put_le (r + 14, len, 2);
+      fwrite (r, 1, sizeof (r), capture_fp);
+      if (len > 0)
+        fwrite (data, 1, len, capture_fp);
+
+      // commands are rare, keep the file usable if the program dies
+      if (dir == LIBALLURIS_CAPTURE_OUT || dir == LIBALLURIS_CAPTURE_HOST)
+        fflush (capture_fp);
+    }
+  pthread_mutex_unlock (&capture_mutex);
+}
+
+/*!
+ * \brief Append an input of the application to the capture
+ *
+ * Inputs which influence the commands sent to the device but aren't transferred
+ * over USB (for example a confirmation by the user) are needed to replay a capture.
+ * The record is ignored if no capture is running.
+ * \param[in] data payload, defined by the application
+ * \param[in] len length of data
+ */
+void liballuris_capture_host_event (const unsigned char* data, int len)
+{
+  liballuris_capture (NULL, LIBALLURIS_CAPTURE_HOST, data, len, 0, 0);
+}
+
+/*
+ * Virtual devices replace the USB transfers of a device handle by a function,
+ * for example an emulated TTT for tests without hardware (see ttt_emulator.h).
+ * The handle is the address of the registry entry, it's never passed to libusb.
+ */
+struct liballuris_virtual_device
+{
+  char serial_number[30];
+  liballuris_virtual_transfer transfer;   //!< NULL = entry unused
+  void* user_data;
+};
+
+static struct liballuris_virtual_device virtual_devices[LIBALLURIS_MAX_VIRTUAL_DEVICES];
+static pthread_mutex_t virtual_devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! Internal: registry entry of a virtual device or NULL for an USB device
+static struct liballuris_virtual_device* liballuris_virtual_device (libusb_device_handle* h)
+{
+  struct liballuris_virtual_device *v = (struct liballuris_virtual_device *) h;
+  if (v >= virtual_devices && v < virtual_devices + LIBALLURIS_MAX_VIRTUAL_DEVICES && v->transfer)
+    return v;
+  return NULL;
+}
+
+/*!
+ * \brief Register a virtual device
+ *
+ * The returned handle can be used with all liballuris functions like a handle from libusb_open.
+ * \ref liballuris_open_device returns it if the serial number matches (or no serial number is given),
+ * so code which opens the "first" device uses the virtual device without changes.
+ * The handle mustn't be passed to libusb functions, check with \ref liballuris_is_virtual_device.
+ *
+ * \param[in] serial_number as returned by \ref liballuris_get_serial_number, for example "P.25412"
+ * \param[in] transfer replaces libusb_interrupt_transfer
+ * \param[in] user_data passed to transfer
+ * \param[out] h handle of the virtual device
+ * \return 0 if successful, LIBUSB_ERROR_NO_MEM if LIBALLURIS_MAX_VIRTUAL_DEVICES are already registered
+ */
+int liballuris_add_virtual_device (const char* serial_number, liballuris_virtual_transfer transfer, void* user_data, libusb_device_handle** h)
+{
+  int ret = LIBUSB_ERROR_NO_MEM;
+  pthread_mutex_lock (&virtual_devices_mutex);
+  int k;
+  for (k=0; k < LIBALLURIS_MAX_VIRTUAL_DEVICES; ++k)
+    if (! virtual_devices[k].transfer)
+      {
+        snprintf (virtual_devices[k].serial_number, sizeof (virtual_devices[k].serial_number), "%s", serial_number);
+        virtual_devices[k].user_data = user_data;
+        virtual_devices[k].transfer = transfer;
+        *h = (libusb_device_handle *) &virtual_devices[k];
+        ret = LIBUSB_SUCCESS;
+        break;
+      }
+  pthread_mutex_unlock (&virtual_devices_mutex);
+  return ret;
+}
+
+//! Unregister a virtual device, the handle mustn't be used afterwards
+void liballuris_remove_virtual_device (libusb_device_handle* h)
+{
+  pthread_mutex_lock (&virtual_devices_mutex);
+  struct liballuris_virtual_device *v = liballuris_virtual_device (h);
+  if (v)
+    v->transfer = NULL;
+  pthread_mutex_unlock (&virtual_devices_mutex);
+  liballuris_reset_metrics (h);
+}
+
+//! Returns 1 if h was returned by \ref liballuris_add_virtual_device, else 0
+int liballuris_is_virtual_device (libusb_device_handle* h)
+{
+  return liballuris_virtual_device (h) != NULL;
+}
+
+//! Internal: libusb_interrupt_transfer or the transfer function of a virtual device
+static int liballuris_transfer (libusb_device_handle* dev_handle, unsigned char endpoint,
+                                unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  int r;
+  struct liballuris_virtual_device *v = liballuris_virtual_device (dev_handle);
+  if (v)
+    r = v->transfer (v->user_data, endpoint, data, length, transferred, timeout);
+  else
+    r = libusb_interrupt_transfer (dev_handle, endpoint, data, length, transferred, timeout);
+
+  if (endpoint & LIBUSB_ENDPOINT_IN)
+    liballuris_capture (dev_handle, LIBALLURIS_CAPTURE_IN, data, (r == LIBUSB_SUCCESS)? *transferred : 0, r, timeout);
+  else
+    liballuris_capture (dev_handle, LIBALLURIS_CAPTURE_OUT, data, length, r, timeout);
+  return r;
+}
+
+/****************************************************************************************/
+// commands while streaming
+
+//! Internal: streams which are started, the replies to commands arrive within them
+static struct liballuris_stream* active_streams[MAX_NUM_DEVICES];
+static libusb_device_handle* active_stream_devices[MAX_NUM_DEVICES];
+static pthread_mutex_t active_streams_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! Internal: register (stream != NULL) or unregister the active stream of dev_handle
+static void liballuris_set_active_stream (libusb_device_handle* dev_handle, struct liballuris_stream* stream)
+{
+  pthread_mutex_lock (&active_streams_mutex);
+  int k;
+  for (k=0; k < MAX_NUM_DEVICES; ++k)
+    if (active_stream_devices[k] == dev_handle)
+      {
+        active_stream_devices[k] = NULL;
+        active_streams[k] = NULL;
+      }
+  if (stream)
+    for (k=0; k < MAX_NUM_DEVICES; ++k)
+      if (! active_stream_devices[k])
+        {
+          active_stream_devices[k] = dev_handle;
+          active_streams[k] = stream;
+          break;
+        }
+  pthread_mutex_unlock (&active_streams_mutex);
+}
+
+//! Internal: active stream of dev_handle or NULL
+static struct liballuris_stream* liballuris_active_stream (libusb_device_handle* dev_handle)
+{
+  struct liballuris_stream* ret = NULL;
+  pthread_mutex_lock (&active_streams_mutex);
+  int k;
+  for (k=0; k < MAX_NUM_DEVICES; ++k)
+    if (active_stream_devices[k] == dev_handle)
+      ret = active_streams[k];
+  pthread_mutex_unlock (&active_streams_mutex);
+  return ret;
+}
+
+static int liballuris_stream_command (struct liballuris_stream* stream, const char* funcname,
+                                      unsigned char *out_buf, int send_len, unsigned int send_timeout,
+                                      unsigned char *in_buf, int reply_len, unsigned int receive_timeout);
+
 //! Internal send and receive wrapper around libusb_interrupt_transfer
 static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
     const char* funcname,
@@ -177,22 +666,28 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
       exit (-1);
     }
 
+  // the queued transfers of a stream would consume the reply
+  if (send_len > 0 && reply_len > 0)
+    {
+      struct liballuris_stream* stream = liballuris_active_stream (dev_handle);
+      if (stream)
+        return liballuris_stream_command (stream, funcname, out_buf, send_len, send_timeout,
+                                          in_buf, reply_len, receive_timeout);
+    }
+
   if (send_len > 0)
     {
       // check length in out_buf
       assert (out_buf[1] == send_len);
 
-      if (liballuris_debug_level)
-        gettimeofday (&t1, NULL);
+      gettimeofday (&t1, NULL);
 
-      r = libusb_interrupt_transfer (dev_handle, (0x1 | LIBUSB_ENDPOINT_OUT), out_buf, send_len, &actual, send_timeout);
+      r = liballuris_transfer (dev_handle, (0x1 | LIBUSB_ENDPOINT_OUT), out_buf, send_len, &actual, send_timeout);
 
+      gettimeofday (&t2, NULL);
+      liballuris_record_latency (dev_handle, funcname, 0, 1, &t1, &t2);
       if (liballuris_debug_level)
-        {
-          gettimeofday (&t2, NULL);
-          double diff = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1.0e6;
-          fprintf (stderr, "DEBUG-INFO: %s send  took %f s\n", funcname, diff);
-        }
+        fprintf (stderr, "DEBUG-INFO: %s send  took %f s\n", funcname, timeval_diff (&t1, &t2));
 
       if (liballuris_debug_level > 1 && r == LIBUSB_SUCCESS)
         {
@@ -202,6 +697,7 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
 
       if (r != LIBUSB_SUCCESS || actual != send_len)
         {
+          liballuris_count_error (dev_handle, r);
           fprintf(stderr, "Write error in '%s': '%s', wrote %i of %i bytes.\n", funcname, libusb_error_name(r), actual, send_len);
           return r;
         }
@@ -216,17 +712,14 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
         {
           //~ if (sample_ignore_cnt < 3)
             //~ printf ("retry...\n");
-          if (liballuris_debug_level)
-            gettimeofday (&t1, NULL);
+          gettimeofday (&t1, NULL);
 
-          r = libusb_interrupt_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, tmp_in_buf, DEFAULT_RECV_BUF_LEN, &actual, receive_timeout);
+          r = liballuris_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, tmp_in_buf, DEFAULT_RECV_BUF_LEN, &actual, receive_timeout);
 
+          gettimeofday (&t2, NULL);
+          liballuris_record_latency (dev_handle, funcname, 1, send_len <= 0 && sample_ignore_cnt == 3, &t1, &t2);
           if (liballuris_debug_level)
-            {
-              gettimeofday (&t2, NULL);
-              double diff = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1.0e6;
-              fprintf (stderr, "DEBUG-INFO: %s reply took %f s\n", funcname, diff);
-            }
+            fprintf (stderr, "DEBUG-INFO: %s reply took %f s\n", funcname, timeval_diff (&t1, &t2));
 
           if (liballuris_debug_level > 1 && r == LIBUSB_SUCCESS)
             {
@@ -236,6 +729,7 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
 
           if (r != LIBUSB_SUCCESS)
             {
+              liballuris_count_error (dev_handle, r);
               if (r == LIBUSB_ERROR_OVERFLOW)
                 {
                   if (liballuris_debug_level)
@@ -249,6 +743,9 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
 
               return r;
             }
+
+          if (sample_ignore_cnt > 0 && tmp_in_buf[0] == 0x02 && send_len > 0)
+            liballuris_count (dev_handle, METRICS_SAMPLES_IGNORED);
         }
       // ID_SAMPLE bis zu sample_ignore_cnt mal igorieren/verwerfen wenn nicht gewünscht (falls streaming aktiv ist)
       while (sample_ignore_cnt-- > 0 && tmp_in_buf[0] == 0x02 && send_len > 0);
@@ -258,6 +755,7 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
         {
           fprintf(stderr, "Error: Malformed reply. Check physical connection and EMI.\n");
           fprintf(stderr, "(send_cmd=0x%02X != recv_cmd=0x%02X) || (recv_len=%i != reply_len=%i),\n", out_buf[0], tmp_in_buf[0], tmp_in_buf[1], reply_len);
+          liballuris_count (dev_handle, METRICS_ERROR);
 
           return LIBALLURIS_MALFORMED_REPLY;
         }
@@ -269,6 +767,8 @@ static int liballuris_interrupt_transfer (libusb_device_handle* dev_handle,
 
 /****************************************************************************************/
 
+static void liballuris_device_cache_store (const char* serial_number, libusb_device* dev);
+
 /*!
  * \brief List accessible alluris devices
  *
@@ -345,6 +845,8 @@ int liballuris_get_device_list (libusb_context* ctx, struct alluris_device_descr
                           if (r == LIBALLURIS_DEVICE_BUSY)
                             // measurement is running, serial cannot be read
                             strcpy (alluris_devs[num_alluris_devices].serial_number, "*BUSY*");
+                          else if (r == LIBALLURIS_SUCCESS)
+                            liballuris_device_cache_store (alluris_devs[num_alluris_devices].serial_number, dev);
                         }
 
                       num_alluris_devices++;
@@ -417,8 +919,273 @@ void liballuris_print_device_list (FILE *sink, libusb_context* ctx)
   liballuris_free_device_list (alluris_devs, MAX_NUM_DEVICES);
 }
 
+/****************************************************************************************/
+/* serial number -> USB port path cache                                                 */
+/****************************************************************************************/
+
+// The bus number and port path of a device don't change on reconnect (the device address does)
+// so liballuris_open_device can open a known serial directly instead of querying every device.
+// Format: one device per line "serial bus port.port.port"
+
+struct liballuris_cache_entry
+{
+  char serial_number[30];
+  int bus;
+  char path[LIBALLURIS_PORT_PATH_LEN];
+};
+
+static char device_cache_fn[FILENAME_MAX];
+static char device_cache_initialized = 0;
+static pthread_mutex_t device_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// call with device_cache_mutex locked
+static const char* liballuris_device_cache_fn (void)
+{
+  if (! device_cache_initialized)
+    {
+      device_cache_initialized = 1;
+      const char* env = getenv ("LIBALLURIS_DEVICE_CACHE");
+#ifdef _WIN32
+      const char* home = getenv ("LOCALAPPDATA");
+      const char* name = "liballuris_device_cache";
+#else
+      const char* home = getenv ("HOME");
+      const char* name = ".liballuris_device_cache";
+#endif
+      if (env)
+        snprintf (device_cache_fn, sizeof (device_cache_fn), "%s", env);
+      else if (home)
+        snprintf (device_cache_fn, sizeof (device_cache_fn), "%s/%s", home, name);
+    }
+  return device_cache_fn;
+}
+
+/*!
+ * \brief Set the file for the serial number -> USB port cache
+ *
+ * Default is $LIBALLURIS_DEVICE_CACHE or ~/.liballuris_device_cache
+ * \param[in] fn filename, NULL or "" disables the cache
+ */
+void liballuris_set_device_cache (const char* fn)
+{
+  pthread_mutex_lock (&device_cache_mutex);
+  device_cache_initialized = 1;
+  snprintf (device_cache_fn, sizeof (device_cache_fn), "%s", fn ? fn : "");
+  pthread_mutex_unlock (&device_cache_mutex);
+}
+
+/*!
+ * \brief Get bus number and port path like "1.4.2" of a device
+ * \param[in] dev the device
+ * \param[out] path output location for the port path
+ * \param[in] length length of path in bytes
+ * \return bus number or \ref liballuris_error if negative
+ */
+int liballuris_get_port_path (libusb_device* dev, char* path, size_t length)
+{
+  uint8_t ports[7];
+  int n = libusb_get_port_numbers (dev, ports, sizeof (ports));
+  if (n < 0)
+    return n;
+
+  path[0] = 0;
+  size_t pos = 0;
+  int k;
+  for (k=0; k < n && pos < length; ++k)
+    pos += snprintf (path + pos, length - pos, k ? ".%i" : "%i", ports[k]);
+  return libusb_get_bus_number (dev);
+}
+
+// call with device_cache_mutex locked, returns number of entries
+static int liballuris_read_device_cache (struct liballuris_cache_entry* entries, int length)
+{
+  const char* fn = liballuris_device_cache_fn ();
+  if (! fn[0])
+    return 0;
+
+  FILE* f = fopen (fn, "r");
+  if (! f)
+    return 0;
+
+  int num = 0;
+  char line[128];
+  while (num < length && fgets (line, sizeof (line), f))
+    {
+      struct liballuris_cache_entry *e = entries + num;
+      if (sscanf (line, "%29s %i %15s", e->serial_number, &e->bus, e->path) == 3)
+        num++;
+    }
+  fclose (f);
+  return num;
+}
+
+/*!
+ * \brief Lookup a serial number in the device cache
+ * \return bus number and port path in path, negative if the serial isn't in the cache
+ */
+static int liballuris_device_cache_lookup (const char* serial_number, char* path, size_t length)
+{
+  struct liballuris_cache_entry entries[LIBALLURIS_DEVICE_CACHE_SIZE];
+  int bus = -1;
+
+  pthread_mutex_lock (&device_cache_mutex);
+  int num = liballuris_read_device_cache (entries, LIBALLURIS_DEVICE_CACHE_SIZE);
+  int k;
+  for (k=0; k < num && bus < 0; ++k)
+    if (! strcmp (entries[k].serial_number, serial_number))
+      {
+        bus = entries[k].bus;
+        snprintf (path, length, "%s", entries[k].path);
+      }
+  pthread_mutex_unlock (&device_cache_mutex);
+  return bus;
+}
+
+/*!
+ * \brief Store serial -> port path of dev in the device cache
+ *
+ * The file is only written if the entry changed. Another device which
+ * was cached on the same port is removed.
+ */
+static void liballuris_device_cache_store (const char* serial_number, libusb_device* dev)
+{
+  struct liballuris_cache_entry entries[LIBALLURIS_DEVICE_CACHE_SIZE + 1];
+  char path[LIBALLURIS_PORT_PATH_LEN];
+  int bus = liballuris_get_port_path (dev, path, sizeof (path));
+  if (bus < 0 || ! strcmp (serial_number, "*BUSY*"))
+    return;
+
+  pthread_mutex_lock (&device_cache_mutex);
+  const char* fn = liballuris_device_cache_fn ();
+  int num = liballuris_read_device_cache (entries, LIBALLURIS_DEVICE_CACHE_SIZE);
+
+  int k, i = 0;
+  char found = 0;
+  for (k=0; k < num; ++k)
+    {
+      char same_serial = ! strcmp (entries[k].serial_number, serial_number);
+      char same_port = (entries[k].bus == bus && ! strcmp (entries[k].path, path));
+      if (same_serial && same_port)
+        found = 1;
+      else if (same_serial || same_port)
+        continue;  // outdated entry
+      entries[i++] = entries[k];
+    }
+
+  if (fn[0] && ! (found && i == num))
+    {
+      if (! found)
+        {
+          // newest entry first, drop the oldest if full
+          if (i == LIBALLURIS_DEVICE_CACHE_SIZE)
+            i--;
+          memmove (entries + 1, entries, i * sizeof (entries[0]));
+          snprintf (entries[0].serial_number, sizeof (entries[0].serial_number), "%s", serial_number);
+          entries[0].bus = bus;
+          snprintf (entries[0].path, sizeof (entries[0].path), "%s", path);
+          i++;
+        }
+
+      // write to temp file and rename, other processes may read the cache concurrently
+      char tmp_fn[FILENAME_MAX + 16];
+      snprintf (tmp_fn, sizeof (tmp_fn), "%s.%i", fn, (int) getpid ());
+      FILE* f = fopen (tmp_fn, "w");
+      if (f)
+        {
+          for (k=0; k < i; ++k)
+            fprintf (f, "%s %i %s\n", entries[k].serial_number, entries[k].bus, entries[k].path);
+          fclose (f);
+#ifdef _WIN32
+          remove (fn);
+#endif
+          if (rename (tmp_fn, fn))
+            remove (tmp_fn);
+        }
+      else if (liballuris_debug_level)
+        fprintf (stderr, "DEBUG-INFO: Couldn't write device cache '%s'\n", fn);
+    }
+  pthread_mutex_unlock (&device_cache_mutex);
+}
+
+/*!
+ * \brief Try to open a device with serial_number via the port path stored in the device cache
+ *
+ * The serial number is queried once after opening to make sure the cached entry is still valid.
+ * \return 0 if successful else LIBUSB_ERROR_NOT_FOUND
+ */
+static int liballuris_open_cached_device (libusb_context* ctx, const char* serial_number, libusb_device_handle** h)
+{
+  char cached_path[LIBALLURIS_PORT_PATH_LEN];
+  int bus = liballuris_device_cache_lookup (serial_number, cached_path, sizeof (cached_path));
+  if (bus < 0)
+    return LIBUSB_ERROR_NOT_FOUND;
+
+  libusb_device **devs;
+  libusb_device *dev = NULL;
+  ssize_t cnt = libusb_get_device_list (ctx, &devs);
+  ssize_t k;
+  for (k=0; k < cnt && ! dev; ++k)
+    {
+      char path[LIBALLURIS_PORT_PATH_LEN];
+      if (liballuris_get_port_path (devs[k], path, sizeof (path)) == bus && ! strcmp (path, cached_path))
+        dev = devs[k];
+    }
+
+  int r = LIBUSB_ERROR_NOT_FOUND;
+  if (dev)
+    {
+      struct libusb_device_descriptor desc;
+      if (   ! libusb_get_device_descriptor (dev, &desc)
+             && desc.idVendor == 0x04d8 && (desc.idProduct == 0xfc30 || desc.idProduct == 0xf25e)
+             && libusb_open (dev, h) == LIBUSB_SUCCESS)
+        {
+          char serial[30] = "";
+          if (libusb_claim_interface (*h, 0) == LIBUSB_SUCCESS)
+            {
+              liballuris_get_serial_number (*h, serial, sizeof (serial));
+              libusb_release_interface (*h, 0);
+            }
+
+          if (! strcmp (serial, serial_number))
+            r = LIBUSB_SUCCESS;
+          else
+            {
+              libusb_close (*h);
+              *h = NULL;
+            }
+        }
+    }
+  if (cnt >= 0)
+    libusb_free_device_list (devs, 1);
+
+  if (liballuris_debug_level)
+    fprintf (stderr, "DEBUG-INFO: liballuris_open_cached_device: %s at %i-%s %s\n", serial_number, bus, cached_path, r ? "not found" : "opened");
+  return r;
+}
+
+//! Internal: search a virtual device with serial_number or the first one if serial_number is NULL
+static int liballuris_open_virtual_device (const char* serial_number, libusb_device_handle** h)
+{
+  int ret = LIBUSB_ERROR_NOT_FOUND;
+  pthread_mutex_lock (&virtual_devices_mutex);
+  int k;
+  for (k=0; k < LIBALLURIS_MAX_VIRTUAL_DEVICES; ++k)
+    if (   virtual_devices[k].transfer
+        && (! serial_number || ! strncmp (serial_number, virtual_devices[k].serial_number, sizeof (virtual_devices[k].serial_number))))
+      {
+        *h = (libusb_device_handle *) &virtual_devices[k];
+        ret = LIBUSB_SUCCESS;
+        break;
+      }
+  pthread_mutex_unlock (&virtual_devices_mutex);
+  return ret;
+}
+
 /*!
  * \brief Open device with specified serial_number or the first available if NULL
+ *
+ * A device with serial_number is first searched at the port stored in the device cache
+ * (see \ref liballuris_set_device_cache). Only if this fails all devices are enumerated and queried.
  * \param[in] ctx pointer to libusb context
  * \param[in] serial_number of device or NULL
  * \param[out] h storage for handle to communicate with the device
@@ -426,6 +1193,12 @@ void liballuris_print_device_list (FILE *sink, libusb_context* ctx)
  */
 int liballuris_open_device (libusb_context* ctx, const char* serial_number, libusb_device_handle** h)
 {
+  if (liballuris_open_virtual_device (serial_number, h) == LIBUSB_SUCCESS)
+    return LIBUSB_SUCCESS;
+
+  if (serial_number && liballuris_open_cached_device (ctx, serial_number, h) == LIBUSB_SUCCESS)
+    return LIBUSB_SUCCESS;
+
   libusb_device *dev = NULL;
   struct alluris_device_description alluris_devs[MAX_NUM_DEVICES];
   int cnt = liballuris_get_device_list (ctx, alluris_devs, MAX_NUM_DEVICES, (serial_number != NULL));
@@ -565,6 +1338,39 @@ int liballuris_open_if_not_opened (libusb_context* ctx, const char* serial_or_bu
   return r;
 }
 
+/*!
+ * \brief Drain receive buffer until it's empty
+ *
+ * In contrast to \ref liballuris_clear_RX, which always waits the full timeout if nothing
+ * is pending, this reads until no packet arrives within idle_timeout or max_time is over.
+ * So a quiet device is drained after idle_timeout, a device which still sends packets
+ * (for example cyclic measurement after a crash) after max_time at the latest.
+ * \param[in] dev_handle a handle for the device to communicate with
+ * \param[in] idle_timeout in ms, should be longer than the interval of cyclic measurement packets
+ * \param[in] max_time in ms
+ * \return number of drained packets
+ */
+int liballuris_drain_RX (libusb_device_handle* dev_handle, unsigned int idle_timeout, unsigned int max_time)
+{
+  unsigned char data[64];
+  int actual, r;
+  int cnt = 0;
+  struct timeval t1, t2;
+  gettimeofday (&t1, NULL);
+  do
+    {
+      r = liballuris_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, data, 64, &actual, idle_timeout);
+      if (r == LIBUSB_SUCCESS)
+        cnt++;
+      gettimeofday (&t2, NULL);
+    }
+  while (r == LIBUSB_SUCCESS && timeval_diff (&t1, &t2) * 1000 < max_time);
+
+  if (liballuris_debug_level)
+    fprintf (stderr, "DEBUG-INFO: drain_RX: %i packets drained in %.3fs, last libusb_interrupt_transfer returned '%s'\n", cnt, timeval_diff (&t1, &t2), libusb_error_name(r));
+  return cnt;
+}
+
 /*!
  * \brief Clear receive buffer
  *
@@ -577,7 +1383,7 @@ void liballuris_clear_RX (libusb_device_handle* dev_handle, unsigned int timeout
 {
   unsigned char data[64];
   int actual;
-  int r = libusb_interrupt_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, data, 64, &actual, timeout);
+  int r = liballuris_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, data, 64, &actual, timeout);
 
   if (liballuris_debug_level)
     fprintf (stderr, "DEBUG-INFO: clear_RX: libusb_interrupt_transfer returned '%s', actual = %i\n", libusb_error_name(r), actual);
@@ -1202,7 +2008,7 @@ int liballuris_poll_measurement_no_wait (libusb_device_handle *dev_handle, int*
   size_t len = 5 + length * 3;
   unsigned char in_buf[len];
   *actual_num_values = 0;
-  r = libusb_interrupt_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, len, &actual, 1);
+  r = liballuris_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, len, &actual, 1);
   //printf ("actual = %i, %s\n", actual, libusb_error_name(r));
 
   if ((r == LIBUSB_SUCCESS || r == LIBUSB_ERROR_TIMEOUT ) && actual == (int) len)
@@ -1223,6 +2029,411 @@ int liballuris_poll_measurement_no_wait (libusb_device_handle *dev_handle, int*
   return r;
 }
 
+/*!
+ * \brief Internal state of an asynchronous stream
+ * \sa liballuris_start_streaming
+ */
+struct liballuris_stream
+{
+  libusb_context* ctx;                  //!< context used for event handling
+  libusb_device_handle* dev_handle;     //!< device which sends the packets
+  size_t length;                        //!< number of samples per packet
+  liballuris_stream_sink sink;          //!< receives the samples of each completed packet
+  void* user_data;                      //!< passed to sink
+  struct libusb_transfer* transfers[LIBALLURIS_NUM_STREAM_TRANSFERS];
+  unsigned char buf[LIBALLURIS_NUM_STREAM_TRANSFERS][LIBALLURIS_STREAM_BUF_LEN];
+  int num_active;                       //!< submitted transfers which are not finished yet
+  char stopping;                        //!< don't resubmit completed transfers
+  int error;                            //!< first error which terminated a transfer
+
+  // reply to a command sent while streaming, see liballuris_stream_command
+  pthread_mutex_t command_mutex;        //!< one command at a time
+  pthread_mutex_t poll_mutex;           //!< serializes liballuris_poll_virtual_stream
+  unsigned char pending_cmd;            //!< command byte of the expected reply, 0 = none
+  int reply_received;                   //!< completion flag for libusb_handle_events_timeout_completed
+  int reply_length;
+  unsigned char reply[LIBALLURIS_STREAM_BUF_LEN];
+};
+
+//! Internal: pass the samples of a received packet to the sink of the stream
+static void liballuris_stream_packet (struct liballuris_stream *stream, unsigned char *in_buf, int actual_length)
+{
+  int len = 5 + stream->length * 3;
+  if (actual_length == len && in_buf[0] == 0x02)
+    {
+      int values[19];
+      size_t k;
+      for (k=0; k < stream->length; k++)
+        values[k] = char_to_int24 (in_buf + 5 + k*3);
+      liballuris_record_stream_packet (stream->dev_handle, stream->length);
+      stream->sink (stream->user_data, values, stream->length);
+    }
+  else if (stream->pending_cmd && ! stream->reply_received
+           && actual_length >= 2 && in_buf[0] == stream->pending_cmd)
+    {
+      memcpy (stream->reply, in_buf, actual_length);
+      stream->reply_length = actual_length;
+      stream->reply_received = 1;
+    }
+  else
+    {
+      liballuris_count (stream->dev_handle, METRICS_STREAM_IGNORED);
+      if (liballuris_debug_level)
+        {
+          fprintf (stderr, "DEBUG-INFO: liballuris_stream_packet ignored %i bytes: ", actual_length);
+          print_buffer (in_buf, actual_length);
+        }
+    }
+}
+
+//! Internal completion callback for streaming transfers
+static void LIBUSB_CALL liballuris_stream_cb (struct libusb_transfer *transfer)
+{
+  struct liballuris_stream *stream = (struct liballuris_stream *) transfer->user_data;
+
+  switch (transfer->status)
+    {
+    case LIBUSB_TRANSFER_COMPLETED:
+      liballuris_capture (stream->dev_handle, LIBALLURIS_CAPTURE_STREAM, transfer->buffer, transfer->actual_length, 0, 0);
+      liballuris_stream_packet (stream, transfer->buffer, transfer->actual_length);
+      break;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      liballuris_count (stream->dev_handle, METRICS_TIMEOUT);
+      break;
+    case LIBUSB_TRANSFER_CANCELLED:
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      liballuris_capture (stream->dev_handle, LIBALLURIS_CAPTURE_STREAM, NULL, 0, LIBUSB_ERROR_NO_DEVICE, 0);
+      liballuris_count (stream->dev_handle, METRICS_ERROR);
+      if (! stream->error)
+        stream->error = LIBUSB_ERROR_NO_DEVICE;
+      break;
+    case LIBUSB_TRANSFER_OVERFLOW:
+      liballuris_count (stream->dev_handle, METRICS_OVERFLOW);
+      if (! stream->error)
+        stream->error = LIBUSB_ERROR_OVERFLOW;
+      break;
+    default:
+      liballuris_count (stream->dev_handle, METRICS_ERROR);
+      if (! stream->error)
+        stream->error = LIBUSB_ERROR_IO;
+      break;
+    }
+
+  if (! stream->stopping
+      && (   transfer->status == LIBUSB_TRANSFER_COMPLETED
+          || transfer->status == LIBUSB_TRANSFER_TIMED_OUT))
+    {
+      // requeue at the end, the other transfers are still waiting for data
+      int r = libusb_submit_transfer (transfer);
+      if (r == LIBUSB_SUCCESS)
+        return;
+
+      fprintf (stderr, "Error in liballuris_stream_cb: resubmit failed: '%s'\n", libusb_error_name (r));
+      if (! stream->error)
+        stream->error = r;
+    }
+  stream->num_active--;
+}
+
+//! Internal: cancel all active transfers and wait until they are finished
+static void liballuris_cancel_stream_transfers (struct liballuris_stream* stream)
+{
+  stream->stopping = 1;
+
+  int k;
+  for (k=0; k < LIBALLURIS_NUM_STREAM_TRANSFERS; ++k)
+    if (stream->transfers[k])
+      libusb_cancel_transfer (stream->transfers[k]);
+
+  // the cancelled transfers are reaped within event handling
+  int retries = 20;
+  while (stream->num_active > 0 && retries-- > 0)
+    {
+      struct timeval tv = {0, 100000};
+      libusb_handle_events_timeout_completed (stream->ctx, &tv, NULL);
+    }
+
+  if (stream->num_active > 0)
+    fprintf (stderr, "Error in liballuris_stop_streaming: %i transfers couldn't be cancelled\n", stream->num_active);
+  else
+    for (k=0; k < LIBALLURIS_NUM_STREAM_TRANSFERS; ++k)
+      if (stream->transfers[k])
+        {
+          libusb_free_transfer (stream->transfers[k]);
+          stream->transfers[k] = NULL;
+        }
+}
+
+/*!
+ * \brief Start asynchronous streaming of cyclic measurements
+ *
+ * Enables cyclic measurements and keeps LIBALLURIS_NUM_STREAM_TRANSFERS IN transfers
+ * queued so that the host controller continues to fetch packets even if the application
+ * doesn't handle events for some time. With a packet length of 19 samples at 900Hz
+ * this bridges approximately 670ms.
+ *
+ * Every completed packet is passed to sink from within \ref liballuris_handle_stream_events.
+ * Other commands (for example liballuris_set_motor_start) can be sent while streaming,
+ * their reply is taken out of the stream (max. LIBALLURIS_STREAM_BUF_LEN bytes).
+ * Long running commands like \ref liballuris_tare should be sent after \ref liballuris_stop_streaming.
+ *
+ * \param[in] ctx pointer to libusb context, used for event handling
+ * \param[in] dev_handle a handle for the device to communicate with
+ * \param[in] length of block 1..19, see \ref liballuris_cyclic_measurement
+ * \param[in] sink callback for the samples of each packet
+ * \param[in] user_data passed to sink
+ * \param[out] stream storage for the stream handle. Only populated if the return code is 0.
+ * \return 0 if successful else \ref liballuris_error
+ * \sa liballuris_stop_streaming
+ */
+int liballuris_start_streaming (libusb_context* ctx, libusb_device_handle *dev_handle, size_t length,
+                                liballuris_stream_sink sink, void* user_data, struct liballuris_stream** stream)
+{
+  struct liballuris_stream *s = (struct liballuris_stream *) calloc (1, sizeof (struct liballuris_stream));
+  if (! s)
+    return LIBUSB_ERROR_NO_MEM;
+
+  s->ctx = ctx;
+  s->dev_handle = dev_handle;
+  s->length = length;
+  s->sink = sink;
+  s->user_data = user_data;
+
+  // liballuris_cyclic_measurement checks length
+  int r = liballuris_cyclic_measurement (dev_handle, 1, length);
+  if (r != LIBALLURIS_SUCCESS)
+    {
+      free (s);
+      return r;
+    }
+
+  pthread_mutex_init (&s->command_mutex, NULL);
+  pthread_mutex_init (&s->poll_mutex, NULL);
+  liballuris_record_stream_start (dev_handle);
+
+  // virtual devices are polled in liballuris_handle_stream_events
+  if (liballuris_virtual_device (dev_handle))
+    {
+      liballuris_set_active_stream (dev_handle, s);
+      *stream = s;
+      return LIBALLURIS_SUCCESS;
+    }
+
+  int k;
+  for (k=0; k < LIBALLURIS_NUM_STREAM_TRANSFERS; ++k)
+    {
+      s->transfers[k] = libusb_alloc_transfer (0);
+      if (! s->transfers[k])
+        {
+          r = LIBUSB_ERROR_NO_MEM;
+          break;
+        }
+
+      libusb_fill_interrupt_transfer (s->transfers[k], dev_handle, 0x81 | LIBUSB_ENDPOINT_IN,
+                                      s->buf[k], LIBALLURIS_STREAM_BUF_LEN, liballuris_stream_cb, s, 0);
+
+      r = libusb_submit_transfer (s->transfers[k]);
+      if (r != LIBUSB_SUCCESS)
+        break;
+      s->num_active++;
+    }
+
+  if (r != LIBUSB_SUCCESS)
+    {
+      fprintf (stderr, "Error in liballuris_start_streaming: '%s'\n", libusb_error_name (r));
+      liballuris_cancel_stream_transfers (s);
+      liballuris_cyclic_measurement (dev_handle, 0, length);
+      pthread_mutex_destroy (&s->command_mutex);
+      pthread_mutex_destroy (&s->poll_mutex);
+      free (s);
+      return r;
+    }
+
+  liballuris_set_active_stream (dev_handle, s);
+  *stream = s;
+  return LIBALLURIS_SUCCESS;
+}
+
+//! Internal: liballuris_handle_stream_events for a virtual device, read all packets which are due
+static int liballuris_poll_virtual_stream (struct liballuris_stream* stream, unsigned int timeout)
+{
+  unsigned char in_buf[LIBALLURIS_STREAM_BUF_LEN];
+  int actual;
+
+  // the acquisition thread and a command (liballuris_stream_command) may poll at the same time
+  pthread_mutex_lock (&stream->poll_mutex);
+
+  // timeout 0 would wait forever in the transfer function
+  int r = liballuris_transfer (stream->dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, sizeof (in_buf), &actual, timeout ? timeout : 1);
+  while (r == LIBUSB_SUCCESS)
+    {
+      liballuris_stream_packet (stream, in_buf, actual);
+      r = liballuris_transfer (stream->dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, sizeof (in_buf), &actual, 1);
+    }
+
+  if (r != LIBUSB_ERROR_TIMEOUT)
+    {
+      liballuris_count_error (stream->dev_handle, r);
+      if (! stream->error)
+        stream->error = r;
+    }
+  pthread_mutex_unlock (&stream->poll_mutex);
+  return stream->error;
+}
+
+/*!
+ * \brief Internal: send a command while streaming
+ *
+ * The queued transfers of the stream receive the reply, liballuris_stream_packet
+ * puts it into the stream. Events are handled until the reply arrives, so this also
+ * works from another thread than the one which calls \ref liballuris_handle_stream_events
+ * (libusb serializes the event handling, see libusb_handle_events_timeout_completed).
+ * Replies longer than LIBALLURIS_STREAM_BUF_LEN aren't possible.
+ */
+static int liballuris_stream_command (struct liballuris_stream* stream, const char* funcname,
+                                      unsigned char *out_buf, int send_len, unsigned int send_timeout,
+                                      unsigned char *in_buf, int reply_len, unsigned int receive_timeout)
+{
+  int actual;
+  struct timeval t1, t2;
+
+  assert (out_buf[1] == send_len);
+  if (reply_len > LIBALLURIS_STREAM_BUF_LEN)
+    return LIBALLURIS_DEVICE_BUSY;
+
+  pthread_mutex_lock (&stream->command_mutex);
+  stream->reply_length = 0;
+  stream->reply_received = 0;
+  stream->pending_cmd = out_buf[0];
+
+  gettimeofday (&t1, NULL);
+  int r = liballuris_transfer (stream->dev_handle, (0x1 | LIBUSB_ENDPOINT_OUT), out_buf, send_len, &actual, send_timeout);
+  gettimeofday (&t2, NULL);
+  liballuris_record_latency (stream->dev_handle, funcname, 0, 1, &t1, &t2);
+
+  if (r != LIBUSB_SUCCESS || actual != send_len)
+    {
+      liballuris_count_error (stream->dev_handle, r);
+      fprintf (stderr, "Write error in '%s' while streaming: '%s', wrote %i of %i bytes.\n", funcname, libusb_error_name (r), actual, send_len);
+      stream->pending_cmd = 0;
+      pthread_mutex_unlock (&stream->command_mutex);
+      return r;
+    }
+
+  char virtual_device = liballuris_virtual_device (stream->dev_handle) != NULL;
+  t1 = t2;
+  while (! stream->reply_received && ! stream->error && timeval_diff (&t1, &t2) * 1000 < receive_timeout)
+    {
+      if (virtual_device)
+        liballuris_poll_virtual_stream (stream, 1);
+      else
+        {
+          struct timeval tv = {0, 10000};
+          r = libusb_handle_events_timeout_completed (stream->ctx, &tv, &stream->reply_received);
+          if (r != LIBUSB_SUCCESS)
+            break;
+        }
+      gettimeofday (&t2, NULL);
+    }
+  liballuris_record_latency (stream->dev_handle, funcname, 1, 0, &t1, &t2);
+  stream->pending_cmd = 0;
+
+  if (! stream->reply_received)
+    {
+      if (r == LIBUSB_SUCCESS)
+        r = stream->error ? stream->error : LIBUSB_ERROR_TIMEOUT;
+      liballuris_count_error (stream->dev_handle, r);
+      fprintf (stderr, "Read error in '%s' while streaming: '%s'\n", funcname, liballuris_error_name (r));
+      pthread_mutex_unlock (&stream->command_mutex);
+      return r;
+    }
+
+  if (stream->reply[1] != reply_len)
+    {
+      fprintf (stderr, "Error: Malformed reply while streaming, (recv_len=%i != reply_len=%i)\n", stream->reply[1], reply_len);
+      liballuris_count (stream->dev_handle, METRICS_ERROR);
+      pthread_mutex_unlock (&stream->command_mutex);
+      return LIBALLURIS_MALFORMED_REPLY;
+    }
+
+  memcpy (in_buf, stream->reply, reply_len);
+  pthread_mutex_unlock (&stream->command_mutex);
+  return LIBALLURIS_SUCCESS;
+}
+
+/*!
+ * \brief Handle pending events of a stream
+ *
+ * Completed packets are passed to the sink of the stream and the transfers are requeued.
+ * Use timeout 0 to only process already completed transfers.
+ *
+ * \param[in] stream handle from \ref liballuris_start_streaming
+ * \param[in] timeout maximum time in milliseconds to wait for events
+ * \return 0 if successful else \ref liballuris_error, for example LIBUSB_ERROR_NO_DEVICE if the device was disconnected
+ */
+int liballuris_handle_stream_events (struct liballuris_stream* stream, unsigned int timeout)
+{
+  if (liballuris_virtual_device (stream->dev_handle))
+    return liballuris_poll_virtual_stream (stream, timeout);
+
+  struct timeval tv;
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+
+  int r = libusb_handle_events_timeout_completed (stream->ctx, &tv, NULL);
+  if (r != LIBUSB_SUCCESS)
+    return r;
+
+  return stream->error;
+}
+
+/*!
+ * \brief Error state of a stream
+ *
+ * Use this instead of \ref liballuris_handle_stream_events if the events of the
+ * libusb context are handled by another thread (for example one thread for several devices).
+ *
+ * \param[in] stream handle from \ref liballuris_start_streaming
+ * \return 0 if the stream is running, else the first error which terminated a transfer
+ */
+int liballuris_stream_error (struct liballuris_stream* stream)
+{
+  return stream->error;
+}
+
+/*!
+ * \brief Stop asynchronous streaming
+ *
+ * Cancels all queued transfers and disables cyclic measurements.
+ * The stream handle is freed and mustn't be used afterwards.
+ *
+ * \param[in] stream handle from \ref liballuris_start_streaming
+ * \return 0 if successful else \ref liballuris_error
+ */
+int liballuris_stop_streaming (struct liballuris_stream* stream)
+{
+  // a command from another thread may still wait for its reply
+  pthread_mutex_lock (&stream->command_mutex);
+  liballuris_set_active_stream (stream->dev_handle, NULL);
+  pthread_mutex_unlock (&stream->command_mutex);
+
+  liballuris_cancel_stream_transfers (stream);
+
+  int r = stream->error;
+  if (r != LIBUSB_ERROR_NO_DEVICE)
+    r = liballuris_cyclic_measurement (stream->dev_handle, 0, stream->length);
+
+  // leaking the stream is better than freeing memory which is still used by libusb
+  if (stream->num_active == 0)
+    {
+      pthread_mutex_destroy (&stream->command_mutex);
+      pthread_mutex_destroy (&stream->poll_mutex);
+      free (stream);
+    }
+  return r;
+}
+
 /*!
  * \brief Tare measurement
  *
@@ -1783,7 +2994,7 @@ int liballuris_get_mem_mode (libusb_device_handle *dev_handle, enum liballuris_m
   // workaround for a firmware bug in versions < FIXME: add version number!
   // check if we get a second reply
   int actual;
-  int temp_ret = libusb_interrupt_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, 3, &actual, 100);
+  int temp_ret = liballuris_transfer (dev_handle, 0x81 | LIBUSB_ENDPOINT_IN, in_buf, 3, &actual, 100);
   if (temp_ret == LIBALLURIS_SUCCESS)
     {
       // discard first reply
@@ -2040,6 +3251,96 @@ int liballuris_read_memory (libusb_device_handle *dev_handle, int adr, int* mem_
   return ret;
 }
 
+/*!
+ * \brief Read a block of the measurement memory
+ *
+ * Instead of one request/reply round trip per value, up to LIBALLURIS_MEM_READ_WINDOW
+ * read requests are kept in flight. The device answers in order, so the replies are
+ * assigned by sequence. If the pipelined read fails (for example a device which drops
+ * queued requests) the remaining values are read one by one.
+ *
+ * \param[in] dev_handle a handle for the device to communicate with
+ * \param[in] first address of the first value 0..999
+ * \param[in] count number of values to read
+ * \param[out] values output location for count values
+ * \param[in] progress called after every value, may be NULL. A return value != 0 aborts the readout
+ * \param[in] user_data passed to progress
+ * \return 0 if successful, LIBUSB_ERROR_INTERRUPTED if aborted, else \ref liballuris_error
+ * \sa liballuris_get_mem_count, liballuris_read_memory
+ */
+int liballuris_read_memory_block (libusb_device_handle *dev_handle, int first, int count, int* values,
+                                  liballuris_progress_cb progress, void* user_data)
+{
+  if (first < 0 || count < 0 || first + count > 1000)
+    return LIBALLURIS_OUT_OF_RANGE;
+
+  unsigned char out_buf[4];
+  unsigned char in_buf[5];
+  int sent = 0;
+  int received = 0;
+  int ret = LIBALLURIS_SUCCESS;
+
+  while (received < count && ret == LIBALLURIS_SUCCESS)
+    {
+      while (sent < count && sent - received < LIBALLURIS_MEM_READ_WINDOW && ret == LIBALLURIS_SUCCESS)
+        {
+          int adr = first + sent;
+          out_buf[0] = 0x06;
+          out_buf[1] = 4;
+          out_buf[2] = adr & 0xFF;
+          out_buf[3] = (adr >> 8) & 0xFF;
+          ret = liballuris_interrupt_transfer (dev_handle, __FUNCTION__,
+                                               out_buf, sizeof (out_buf), DEFAULT_SEND_TIMEOUT,
+                                               NULL, 0, DEFAULT_RECEIVE_TIMEOUT);
+          if (ret == LIBALLURIS_SUCCESS)
+            sent++;
+        }
+
+      if (ret == LIBALLURIS_SUCCESS)
+        {
+          ret = liballuris_interrupt_transfer (dev_handle, __FUNCTION__,
+                                               NULL, 0, DEFAULT_SEND_TIMEOUT,
+                                               in_buf, sizeof (in_buf), DEFAULT_RECEIVE_TIMEOUT);
+          if (ret == LIBALLURIS_SUCCESS && (in_buf[0] != 0x06 || in_buf[1] != sizeof (in_buf)))
+            {
+              liballuris_count (dev_handle, METRICS_ERROR);
+              ret = LIBALLURIS_MALFORMED_REPLY;
+            }
+        }
+
+      if (ret == LIBALLURIS_SUCCESS)
+        {
+          values[received++] = char_to_int24 (in_buf + 2);
+          if (progress && progress (user_data, received, count))
+            {
+              // up to LIBALLURIS_MEM_READ_WINDOW - 1 replies are still in flight
+              if (sent > received)
+                liballuris_drain_RX (dev_handle, LIBALLURIS_DRAIN_IDLE_TIMEOUT, 1000);
+              return LIBUSB_ERROR_INTERRUPTED;
+            }
+        }
+    }
+
+  if (ret != LIBALLURIS_SUCCESS)
+    {
+      // forget outstanding replies and continue without pipelining
+      if (liballuris_debug_level)
+        fprintf (stderr, "DEBUG-INFO: liballuris_read_memory_block: pipelined read failed at %i with '%s', falling back to single reads\n",
+                 first + received, liballuris_error_name (ret));
+      liballuris_drain_RX (dev_handle, LIBALLURIS_DRAIN_IDLE_TIMEOUT, 1000);
+
+      for (; received < count; ++received)
+        {
+          ret = liballuris_read_memory (dev_handle, first + received, values + received);
+          if (ret != LIBALLURIS_SUCCESS)
+            return ret;
+          if (progress && progress (user_data, received + 1, count))
+            return LIBUSB_ERROR_INTERRUPTED;
+        }
+    }
+  return LIBALLURIS_SUCCESS;
+}
+
 /*!
  * \brief Delete the measurement memory
  *
@@ -2265,6 +3566,171 @@ int liballuris_set_data_ratio (libusb_device_handle *dev_handle, int v)
   return ret;
 }
 
+/*!
+ * \brief Get USB transport metrics
+ *
+ * The metrics are collected for every device handle since the first transfer or
+ * the last \ref liballuris_reset_metrics. Up to MAX_NUM_DEVICES handles are tracked.
+ *
+ * \param[in] dev_handle a handle for the device or NULL for the sum over all devices
+ * \param[out] m metrics
+ * \return 0 if successful else \ref liballuris_error
+ */
+int liballuris_get_metrics (libusb_device_handle *dev_handle, struct liballuris_metrics *m)
+{
+  memset (m, 0, sizeof (*m));
+  int ret = LIBALLURIS_OUT_OF_RANGE;
+
+  pthread_mutex_lock (&metrics_mutex);
+  int k;
+  for (k=0; k < MAX_NUM_DEVICES; ++k)
+    {
+      struct liballuris_metrics_entry* e = &metrics_registry[k];
+      if (! e->dev_handle || (dev_handle && e->dev_handle != dev_handle))
+        continue;
+
+      ret = LIBALLURIS_SUCCESS;
+      if (dev_handle)
+        {
+          *m = e->m;
+          break;
+        }
+
+      // aggregate
+      int i, j;
+      for (i=0; i < e->m.num_cmds; ++i)
+        {
+          const struct liballuris_cmd_metrics* src = &e->m.cmd[i];
+          struct liballuris_cmd_metrics* c = NULL;
+          for (j=0; j < m->num_cmds && ! c; ++j)
+            if (! strcmp (m->cmd[j].name, src->name))
+              c = &m->cmd[j];
+          if (! c && m->num_cmds < LIBALLURIS_METRICS_MAX_CMDS)
+            {
+              c = &m->cmd[m->num_cmds++];
+              c->name = src->name;
+            }
+          if (! c)
+            continue;
+
+          c->count += src->count;
+          for (j=0; j < LIBALLURIS_METRICS_HIST_BINS; ++j)
+            {
+              c->send_hist[j] += src->send_hist[j];
+              c->recv_hist[j] += src->recv_hist[j];
+            }
+          if (src->send_max_us > c->send_max_us)
+            c->send_max_us = src->send_max_us;
+          if (src->recv_max_us > c->recv_max_us)
+            c->recv_max_us = src->recv_max_us;
+        }
+
+      m->samples_ignored    += e->m.samples_ignored;
+      m->overflows          += e->m.overflows;
+      m->timeouts           += e->m.timeouts;
+      m->errors             += e->m.errors;
+      m->stream_packets     += e->m.stream_packets;
+      m->stream_samples     += e->m.stream_samples;
+      m->stream_ignored     += e->m.stream_ignored;
+      m->stream_gaps        += e->m.stream_gaps;
+      m->stream_dropped_est += e->m.stream_dropped_est;
+      if (e->m.stream_seconds > m->stream_seconds)
+        m->stream_seconds = e->m.stream_seconds;
+    }
+  pthread_mutex_unlock (&metrics_mutex);
+  return ret;
+}
+
+/*!
+ * \brief Reset USB transport metrics
+ *
+ * Call this before the handle is closed, so that the entry can be reused.
+ * \param[in] dev_handle a handle for the device or NULL for all devices
+ */
+void liballuris_reset_metrics (libusb_device_handle *dev_handle)
+{
+  pthread_mutex_lock (&metrics_mutex);
+  int k;
+  for (k=0; k < MAX_NUM_DEVICES; ++k)
+    if (! dev_handle || metrics_registry[k].dev_handle == dev_handle)
+      memset (&metrics_registry[k], 0, sizeof (metrics_registry[k]));
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+/*!
+ * \brief Set the nominal sampling rate for the estimation of lost samples while streaming
+ *
+ * \param[in] dev_handle a handle for the device to communicate with
+ * \param[in] sps samples per second, for example 900 in LIBALLURIS_MODE_PEAK
+ * \sa liballuris_metrics
+ */
+void liballuris_set_expected_sample_rate (libusb_device_handle *dev_handle, double sps)
+{
+  pthread_mutex_lock (&metrics_mutex);
+  struct liballuris_metrics_entry* e = liballuris_metrics_entry (dev_handle);
+  if (e)
+    e->m.stream_expected_sps = sps;
+  pthread_mutex_unlock (&metrics_mutex);
+}
+
+//! Internal: print one latency histogram, only the used range
+static void liballuris_print_hist (FILE *sink, const char *title, const unsigned long *hist, unsigned long max_us)
+{
+  int first = 0, last = LIBALLURIS_METRICS_HIST_BINS - 1;
+  while (first < last && ! hist[first])
+    first++;
+  while (last > first && ! hist[last])
+    last--;
+
+  fprintf (sink, "    %s (max %lu us):", title, max_us);
+  int k;
+  for (k=first; k <= last; ++k)
+    fprintf (sink, " <%luus:%lu", 2UL << k, hist[k]);
+  fprintf (sink, "\n");
+}
+
+/*!
+ * \brief Print USB transport metrics in human readable form
+ *
+ * \param[in] sink for example stdout or stderr
+ * \param[in] dev_handle a handle for the device or NULL for the sum over all devices
+ * \sa liballuris_get_metrics
+ */
+void liballuris_print_metrics (FILE *sink, libusb_device_handle *dev_handle)
+{
+  struct liballuris_metrics m;
+  if (liballuris_get_metrics (dev_handle, &m) != LIBALLURIS_SUCCESS)
+    {
+      fprintf (sink, "No USB metrics available\n");
+      return;
+    }
+
+  fprintf (sink, "USB metrics:\n");
+  fprintf (sink, "  ID_SAMPLE ignored while waiting for reply = %lu\n", m.samples_ignored);
+  fprintf (sink, "  overflows = %lu, timeouts = %lu, errors = %lu\n", m.overflows, m.timeouts, m.errors);
+
+  if (m.stream_packets)
+    {
+      fprintf (sink, "  streaming: %lu packets, %lu samples, %lu ignored packets in %.3f s",
+               m.stream_packets, m.stream_samples, m.stream_ignored, m.stream_seconds);
+      if (m.stream_seconds > 0)
+        fprintf (sink, " (%.1f packets/s)", (m.stream_packets - 1) / m.stream_seconds);
+      fprintf (sink, "\n");
+      fprintf (sink, "  streaming: %lu gaps", m.stream_gaps);
+      if (m.stream_expected_sps > 0)
+        fprintf (sink, ", estimated lost samples = %li at %.1f samples/s", m.stream_dropped_est, m.stream_expected_sps);
+      fprintf (sink, "\n");
+    }
+
+  int k;
+  for (k=0; k < m.num_cmds; ++k)
+    {
+      fprintf (sink, "  %s: %lu calls\n", m.cmd[k].name, m.cmd[k].count);
+      liballuris_print_hist (sink, "send", m.cmd[k].send_hist, m.cmd[k].send_max_us);
+      liballuris_print_hist (sink, "recv", m.cmd[k].recv_hist, m.cmd[k].recv_max_us);
+    }
+}
+
 void liballuris_set_debug_level (int l)
 {
   liballuris_debug_level = l;
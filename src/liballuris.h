@@ -53,15 +53,35 @@ extern int liballuris_debug_level;
 //! Number of device which can be enumerated and simultaneously opened
 #define MAX_NUM_DEVICES 8
 
+//! maximum number of entries in the serial number -> USB port cache, see \ref liballuris_set_device_cache
+#define LIBALLURIS_DEVICE_CACHE_SIZE 32
+//! maximum length of a port path like "1.4.2" including terminating 0
+#define LIBALLURIS_PORT_PATH_LEN 16
+
+//! maximum number of devices registered with \ref liballuris_add_virtual_device
+#define LIBALLURIS_MAX_VIRTUAL_DEVICES 8
+
 //! Default timeout in milliseconds while writing to the device
 #define DEFAULT_SEND_TIMEOUT 50
 
 //! Default timeout in milliseconds while reading from the device (>800ms)
 #define DEFAULT_RECEIVE_TIMEOUT 4000
 
+//! Number of memory read requests which are kept in flight by \ref liballuris_read_memory_block
+#define LIBALLURIS_MEM_READ_WINDOW 4
+
+//! Idle timeout in milliseconds for \ref liballuris_drain_RX (cyclic packets with 19 samples at 900Hz come every 21ms)
+#define LIBALLURIS_DRAIN_IDLE_TIMEOUT 50
+
 //! Default receive buffer size. Should be multiple of wMaxPacketSize
 #define DEFAULT_RECV_BUF_LEN 256
 
+//! Number of IN transfers which are kept queued while streaming (one packet has up to 19 samples)
+#define LIBALLURIS_NUM_STREAM_TRANSFERS 32
+
+//! Buffer size for one streaming packet (5 bytes header + 19 * 3 bytes, rounded up to wMaxPacketSize)
+#define LIBALLURIS_STREAM_BUF_LEN 64
+
 //! liballuris specific errors
 enum liballuris_error
 {
@@ -195,6 +215,114 @@ struct alluris_device_description
   char serial_number[30]; //!< serial number of device, for example "P.25412"
 };
 
+/*!
+ * \brief Callback which receives the samples of one completed streaming packet
+ *
+ * The callback is called from within libusb event handling, see \ref liballuris_handle_stream_events.
+ * \param user_data pointer given to \ref liballuris_start_streaming
+ * \param values raw measurement values, see \ref liballuris_get_digits
+ * \param num_values number of values in this packet
+ */
+typedef void (*liballuris_stream_sink) (void* user_data, const int* values, size_t num_values);
+
+/*!
+ * \brief Progress of a long running operation, see \ref liballuris_read_memory_block
+ * \param user_data pointer given to the operation
+ * \param done number of processed items
+ * \param total number of items
+ * \return 0 to continue, != 0 to abort
+ */
+typedef int (*liballuris_progress_cb) (void* user_data, int done, int total);
+
+/*
+ * USB capture file, see liballuris_set_capture_file (all values little endian)
+ *
+ * header:
+ *   char[8]   LIBALLURIS_CAPTURE_MAGIC
+ *   uint64    start of capture, microseconds since 1.1.1970
+ *
+ * followed by records with a LIBALLURIS_CAPTURE_RECORD_SIZE bytes header:
+ *   uint64    microseconds since start of capture (after the transfer)
+ *   uint8     direction, see enum liballuris_capture_direction
+ *   uint8     device, index of the device handle in this capture (0 for host events)
+ *   uint8     command id (first byte of payload, 0x02 = sample packet) or 0 if no payload
+ *   int8      result, 0 or libusb error code
+ *   uint16    timeout of the transfer in ms (saturated)
+ *   uint16    payload length
+ *   uint8[]   payload: sent bytes or received bytes (no payload if the IN transfer failed)
+ */
+#define LIBALLURIS_CAPTURE_MAGIC "LACAP1\r\n"
+#define LIBALLURIS_CAPTURE_RECORD_SIZE 16
+
+//! direction of a capture record
+enum liballuris_capture_direction
+{
+  LIBALLURIS_CAPTURE_OUT    = 0, //!< command sent to the device
+  LIBALLURIS_CAPTURE_IN     = 1, //!< synchronous read (reply, sample packet or timeout)
+  LIBALLURIS_CAPTURE_STREAM = 2, //!< completed transfer of \ref liballuris_start_streaming
+  LIBALLURIS_CAPTURE_HOST   = 3  //!< input of the application, see \ref liballuris_capture_host_event
+};
+
+/*!
+ * \brief Transfer function of a virtual device, see \ref liballuris_add_virtual_device
+ *
+ * Same semantics as libusb_interrupt_transfer: endpoint 0x01 sends a command,
+ * endpoint 0x81 receives a reply or a streaming packet, timeout 0 waits forever.
+ * \param user_data pointer given to \ref liballuris_add_virtual_device
+ * \return 0 if successful else a libusb error code, for example LIBUSB_ERROR_TIMEOUT
+ */
+typedef int (*liballuris_virtual_transfer) (void* user_data, unsigned char endpoint,
+    unsigned char *data, int length, int *transferred, unsigned int timeout);
+
+//! Opaque handle for an asynchronous stream, see \ref liballuris_start_streaming
+struct liballuris_stream;
+
+//! Number of commands (function names) which are tracked per device, see \ref liballuris_metrics
+#define LIBALLURIS_METRICS_MAX_CMDS 48
+
+//! Number of latency histogram bins. Bin k counts latencies from 2^k to 2^(k+1) microseconds, the last bin is open ended
+#define LIBALLURIS_METRICS_HIST_BINS 24
+
+//! Latencies of one command, see \ref liballuris_metrics
+struct liballuris_cmd_metrics
+{
+  const char* name;                                     //!< name of the liballuris function
+  unsigned long count;                                  //!< number of calls
+  unsigned long send_hist[LIBALLURIS_METRICS_HIST_BINS]; //!< send latency histogram
+  unsigned long recv_hist[LIBALLURIS_METRICS_HIST_BINS]; //!< receive latency histogram
+  unsigned long send_max_us;                            //!< maximum send latency in microseconds
+  unsigned long recv_max_us;                            //!< maximum receive latency in microseconds
+};
+
+/*!
+ * \brief USB transport statistics of a device handle
+ * \sa liballuris_get_metrics
+ */
+struct liballuris_metrics
+{
+  struct liballuris_cmd_metrics cmd[LIBALLURIS_METRICS_MAX_CMDS]; //!< per command
+  int num_cmds;                         //!< used entries in cmd
+
+  unsigned long samples_ignored;        //!< ID_SAMPLE packets discarded while waiting for a command reply
+  unsigned long overflows;              //!< LIBUSB_ERROR_OVERFLOW / LIBUSB_TRANSFER_OVERFLOW
+  unsigned long timeouts;               //!< LIBUSB_ERROR_TIMEOUT while waiting for a reply
+  unsigned long errors;                 //!< other transfer errors and malformed replies
+
+  // streaming, see \ref liballuris_start_streaming
+  unsigned long stream_packets;         //!< received sample packets
+  unsigned long stream_samples;         //!< received samples
+  unsigned long stream_ignored;         //!< received packets which weren't sample packets
+  unsigned long stream_gaps;            //!< packet intervals > 1.5 * expected (or mean) interval
+  double stream_seconds;                //!< time between first and last packet
+  double stream_mean_interval;          //!< mean packet interval in s (moving average)
+
+  //! \brief Nominal sampling rate, set with \ref liballuris_set_expected_sample_rate. 0 = unknown
+  double stream_expected_sps;
+  //! \brief Estimated lost samples: stream_seconds * stream_expected_sps - received samples.
+  //! Only available if stream_expected_sps is set. Includes the clock deviation between device and host.
+  long stream_dropped_est;
+};
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -210,8 +338,18 @@ int liballuris_open_device_with_id (libusb_context* ctx, int bus, int device, li
 int liballuris_open_if_not_opened (libusb_context* ctx, const char* serial_or_bus_id, libusb_device_handle** h);
 void liballuris_free_device_list (struct alluris_device_description* alluris_devs, size_t length);
 void liballuris_print_device_list (FILE *sink, libusb_context* ctx);
+void liballuris_set_device_cache (const char* fn);
+int liballuris_get_port_path (libusb_device* dev, char* path, size_t length);
+
+int liballuris_set_capture_file (const char* fn);
+void liballuris_capture_host_event (const unsigned char* data, int len);
+
+int liballuris_add_virtual_device (const char* serial_number, liballuris_virtual_transfer transfer, void* user_data, libusb_device_handle** h);
+void liballuris_remove_virtual_device (libusb_device_handle* h);
+int liballuris_is_virtual_device (libusb_device_handle* h);
 
 void liballuris_clear_RX (libusb_device_handle* dev_handle, unsigned int timeout);
+int liballuris_drain_RX (libusb_device_handle* dev_handle, unsigned int idle_timeout, unsigned int max_time);
 
 int liballuris_get_serial_number (libusb_device_handle *dev_handle, char* buf, size_t length);
 int liballuris_get_firmware (libusb_device_handle *dev_handle, int dev, char* buf, size_t length);
@@ -238,6 +376,12 @@ int liballuris_cyclic_measurement (libusb_device_handle *dev_handle, char enable
 int liballuris_poll_measurement (libusb_device_handle *dev_handle, int* buf, size_t length);
 int liballuris_poll_measurement_no_wait (libusb_device_handle *dev_handle, int* buf, size_t length, size_t *actual_num_values);
 
+int liballuris_start_streaming (libusb_context* ctx, libusb_device_handle *dev_handle, size_t length,
+                                liballuris_stream_sink sink, void* user_data, struct liballuris_stream** stream);
+int liballuris_handle_stream_events (struct liballuris_stream* stream, unsigned int timeout);
+int liballuris_stream_error (struct liballuris_stream* stream);
+int liballuris_stop_streaming (struct liballuris_stream* stream);
+
 int liballuris_tare (libusb_device_handle *dev_handle);
 int liballuris_clear_pos_peak (libusb_device_handle *dev_handle);
 int liballuris_clear_neg_peak (libusb_device_handle *dev_handle);
@@ -269,6 +413,8 @@ int liballuris_restore_factory_defaults (libusb_device_handle *dev_handle);
 int liballuris_power_off (libusb_device_handle *dev_handle);
 
 int liballuris_read_memory (libusb_device_handle *dev_handle, int adr, int* mem_value);
+int liballuris_read_memory_block (libusb_device_handle *dev_handle, int first, int count, int* values,
+                                  liballuris_progress_cb progress, void* user_data);
 int liballuris_delete_memory (libusb_device_handle *dev_handle);
 int liballuris_get_mem_count (libusb_device_handle *dev_handle, int* v);
 
@@ -296,6 +442,11 @@ int liballuris_set_motor_stopp (libusb_device_handle *dev_handle, char state);
 
 int liballuris_set_data_ratio (libusb_device_handle *dev_handle, int v);
 
+int liballuris_get_metrics (libusb_device_handle *dev_handle, struct liballuris_metrics *m);
+void liballuris_reset_metrics (libusb_device_handle *dev_handle);
+void liballuris_set_expected_sample_rate (libusb_device_handle *dev_handle, double sps);
+void liballuris_print_metrics (FILE *sink, libusb_device_handle *dev_handle);
+
 void liballuris_set_debug_level (int l);
 
 #ifdef __cplusplus
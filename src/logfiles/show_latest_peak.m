@@ -1,15 +1,29 @@
 ## 02.02.2016 Andreas Weber
 ## in einer Schleife immer den letzen Peak anzeigen
 
+## Die Messdaten werden binär geschrieben (*.raw, siehe raw_data_writer.h)
+## und in Blöcken von 64KiB (ca. 9s) auf die Platte geschrieben.
+
 pkg load signal
-FS = 900;
 
-last_fn = sort (glob ("*.log"), "ascend"){end};
+last_fn = sort (glob ("*.raw"), "ascend"){end};
 printf ("Opening file \"%s\"...\n", last_fn);
-fid = fopen (last_fn, "r");
+fid = fopen (last_fn, "r", "ieee-le");
+
+## Header
+magic = fread (fid, [1 8], "char=>char");
+if (! strcmp (magic, "TTTRAW\r\n"))
+  error ("\"%s\" is not a raw data file", last_fn);
+endif
+version = fread (fid, 1, "uint32");
+FS = fread (fid, 1, "uint32");
+scale = fread (fid, 1, "double");
+meta_len = fread (fid, 1, "uint32");
+disp (fread (fid, [1 meta_len], "char=>char"));
 
-disp (fgetl (fid));
-disp (fgetl (fid));
+## Records: uint32 index, int24 raw, uint8 flags
+RECORD_SIZE = 8;
+rest = zeros (0, 1);
 
 live_plot_len = 6 * FS;
 steady_plot_len = 3 * FS;
@@ -23,8 +37,13 @@ xlabel ("t [s]");
 ylabel ("M [Nm]");
 
 do
-  [tmp, cnt] = fscanf (fid, "%f");
-  tmp = tmp(1:2:end);
+  b = [rest; fread(fid, Inf, "uint8")];
+  n = floor (numel (b) / RECORD_SIZE);
+  rest = b(n * RECORD_SIZE + 1:end);
+  b = reshape (b(1:n * RECORD_SIZE), RECORD_SIZE, n);
+  raw = b(5,:) + 256 * b(6,:) + 65536 * b(7,:);
+  raw(raw >= 2^23) -= 2^24;
+  tmp = scale * raw(:);
   if (numel (tmp) >= live_plot_len);
     v = tmp (end-live_plot_len+1:end);
   else
@@ -0,0 +1,78 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+raw2log: convert raw data files to the text format for octave and measurement_input
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fstream>
+#include <cstring>
+#include "raw_data_writer.h"
+#include "raw_log_reader.h"
+
+#define USAGE "Usage: raw2log RAW_FN [LOG_FN]\n       raw2log -p FN"
+
+/*
+  Usage: raw2log RAW_FN [LOG_FN]
+  writes to stdout if LOG_FN is omitted
+
+  raw2log -p FN
+  lists the peak windows (clicks) of a raw data file or text log FN
+  (see raw_log_reader::peaks), one per line: first last peak_index peak
+*/
+int main (int argc, char **argv)
+{
+  if (argc < 2 || argc > 3)
+    {
+      cerr << USAGE << endl;
+      return -1;
+    }
+
+  try
+    {
+      if (! strcmp (argv[1], "-p"))
+        {
+          if (argc != 3)
+            {
+              cerr << USAGE << endl;
+              return -1;
+            }
+          raw_log_reader in (argv[2]);
+          const vector<raw_log_peak> &p = in.peaks ();
+          for (size_t k = 0; k < p.size (); ++k)
+            cout << p[k].first << "\t" << p[k].last << "\t" << p[k].peak_index << "\t" << p[k].peak << endl;
+        }
+      else if (argc == 3)
+        {
+          ofstream out (argv[2]);
+          if (! out)
+            throw runtime_error (string ("Can't create ") + argv[2]);
+          raw_data_to_text (argv[1], out);
+        }
+      else
+        raw_data_to_text (argv[1], cout);
+    }
+  catch (exception& e)
+    {
+      cerr << "raw2log: " << e.what () << endl;
+      return -1;
+    }
+  return 0;
+}
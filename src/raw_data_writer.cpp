@@ -0,0 +1,182 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class raw_data_writer: buffered binary sink for raw torque samples
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "raw_data_writer.h"
+#include <cstring>
+#include <cstdint>
+
+static void put_u32 (vector<unsigned char> &v, uint32_t x)
+{
+  for (int k=0; k<4; ++k)
+    v.push_back (x >> (8*k));
+}
+
+static uint32_t get_u32 (const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+raw_data_writer::raw_data_writer ()
+  : fp(0), stopping(false), write_failed(false)
+{
+  buf.reserve (RAW_DATA_BUFFER_SIZE + RAW_DATA_RECORD_SIZE);
+}
+
+raw_data_writer::~raw_data_writer ()
+{
+  close ();
+}
+
+void raw_data_writer::open (string fn, double scale, unsigned int sps, string metadata)
+{
+  if (fp)
+    throw runtime_error ("raw_data_writer::open already open");
+
+  fp = fopen (fn.c_str (), "wb");
+  if (! fp)
+    throw runtime_error (string ("raw_data_writer::open can't create ") + fn);
+
+  vector<unsigned char> h (RAW_DATA_MAGIC, RAW_DATA_MAGIC + 8);
+  put_u32 (h, RAW_DATA_VERSION);
+  put_u32 (h, sps);
+
+  uint64_t s;
+  memcpy (&s, &scale, sizeof (s));
+  put_u32 (h, s);
+  put_u32 (h, s >> 32);
+
+  put_u32 (h, metadata.size ());
+  h.insert (h.end (), metadata.begin (), metadata.end ());
+  fwrite (h.data (), 1, h.size (), fp);
+  fflush (fp);
+
+  stopping = false;
+  write_failed = false;
+  buf.clear ();
+  flusher = thread (&raw_data_writer::flush_loop, this);
+}
+
+void raw_data_writer::close ()
+{
+  if (! fp)
+    return;
+
+  if (! buf.empty ())
+    hand_over ();
+
+  {
+    lock_guard<mutex> lock (pending_mutex);
+    stopping = true;
+  }
+  pending_cv.notify_one ();
+  flusher.join ();
+
+  fclose (fp);
+  fp = 0;
+
+  if (write_failed)
+    cerr << "ERROR: raw_data_writer couldn't write all samples" << endl;
+}
+
+// move buf to the flush thread
+void raw_data_writer::hand_over ()
+{
+  {
+    lock_guard<mutex> lock (pending_mutex);
+    pending.push_back (vector<unsigned char> ());
+    pending.back ().swap (buf);
+  }
+  pending_cv.notify_one ();
+  buf.reserve (RAW_DATA_BUFFER_SIZE + RAW_DATA_RECORD_SIZE);
+}
+
+void raw_data_writer::flush_loop ()
+{
+  unique_lock<mutex> lock (pending_mutex);
+  while (1)
+    {
+      pending_cv.wait (lock, [this] { return stopping || ! pending.empty (); });
+      if (pending.empty ())
+        break;   // stopping and nothing left
+
+      vector<unsigned char> b;
+      b.swap (pending.front ());
+      pending.pop_front ();
+
+      // don't block append while writing
+      lock.unlock ();
+      if (fwrite (b.data (), 1, b.size (), fp) != b.size () || fflush (fp))
+        write_failed = true;
+      lock.lock ();
+    }
+}
+
+void raw_data_to_text (string fn, ostream &out)
+{
+  FILE *fp = fopen (fn.c_str (), "rb");
+  if (! fp)
+    throw runtime_error (string ("raw_data_to_text can't open ") + fn);
+
+  unsigned char h[28];
+  if (fread (h, 1, sizeof (h), fp) != sizeof (h) || memcmp (h, RAW_DATA_MAGIC, 8))
+    {
+      fclose (fp);
+      throw runtime_error (fn + " is not a raw data file");
+    }
+
+  uint32_t version = get_u32 (h + 8);
+  if (version != RAW_DATA_VERSION)
+    {
+      fclose (fp);
+      throw runtime_error (fn + ": unknown raw data version");
+    }
+
+  uint64_t s = get_u32 (h + 16) | ((uint64_t) get_u32 (h + 20) << 32);
+  double scale;
+  memcpy (&scale, &s, sizeof (scale));
+
+  string metadata (get_u32 (h + 24), '\0');
+  if (fread (&metadata[0], 1, metadata.size (), fp) != metadata.size ())
+    {
+      fclose (fp);
+      throw runtime_error (fn + ": truncated header");
+    }
+  out << metadata;
+
+  unsigned char r[RAW_DATA_RECORD_SIZE * 1024];
+  size_t n;
+  while ((n = fread (r, RAW_DATA_RECORD_SIZE, 1024, fp)) > 0)
+    for (size_t k=0; k<n; ++k)
+      {
+        const unsigned char *p = r + k * RAW_DATA_RECORD_SIZE;
+
+        // sign extend int24
+        int raw = p[4] | (p[5] << 8) | (p[6] << 16);
+        if (raw & 0x800000)
+          raw -= 0x1000000;
+
+        out << raw * scale << "\t" << (p[7] & RAW_DATA_FLAG_CONFIRMATION) << "\n";
+      }
+  fclose (fp);
+}
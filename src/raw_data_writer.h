@@ -0,0 +1,124 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class raw_data_writer: buffered binary sink for raw torque samples
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RAW_DATA_WRITER_H
+#define RAW_DATA_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/*
+ * File format (all values little endian):
+ *
+ * header:
+ *   char[8]   RAW_DATA_MAGIC
+ *   uint32    RAW_DATA_VERSION
+ *   uint32    sampling rate in samples per second
+ *   double    scale, torque [Nm] = raw * scale (IEEE 754)
+ *   uint32    length of metadata text
+ *   char[]    metadata text, lines starting with "# "
+ *
+ * followed by records of RAW_DATA_RECORD_SIZE bytes:
+ *   uint32    sample index (lower 32 bits)
+ *   int24     raw count
+ *   uint8     flags, bit 0 = confirmation
+ */
+
+#define RAW_DATA_MAGIC "TTTRAW\r\n"
+#define RAW_DATA_VERSION 1
+#define RAW_DATA_RECORD_SIZE 8
+#define RAW_DATA_FLAG_CONFIRMATION 0x01
+
+// size of one buffer which is handed over to the flush thread (approx. 9s at 900Hz)
+#define RAW_DATA_BUFFER_SIZE (1 << 16)
+
+class raw_data_writer
+{
+private:
+  FILE *fp;
+  vector<unsigned char> buf;      // filled by append ()
+
+  // full buffers, written by flush_loop
+  deque< vector<unsigned char> > pending;
+  mutex pending_mutex;
+  condition_variable pending_cv;
+  bool stopping;
+  bool write_failed;
+  thread flusher;
+
+  void flush_loop ();
+  void hand_over ();
+
+public:
+  raw_data_writer ();
+  ~raw_data_writer ();
+
+  /*!
+   * create fn and write the header
+   * metadata: free text, written as comment header by raw_data_to_text
+   */
+  void open (string fn, double scale, unsigned int sps, string metadata);
+  bool is_open ()
+  {
+    return fp != 0;
+  }
+
+  //! write remaining samples and close the file
+  void close ();
+
+  void append (unsigned long index, int raw, bool confirmation)
+  {
+    unsigned char r[RAW_DATA_RECORD_SIZE];
+    r[0] = index;
+    r[1] = index >> 8;
+    r[2] = index >> 16;
+    r[3] = index >> 24;
+    r[4] = raw;
+    r[5] = raw >> 8;
+    r[6] = raw >> 16;
+    r[7] = confirmation? RAW_DATA_FLAG_CONFIRMATION : 0;
+    buf.insert (buf.end (), r, r + RAW_DATA_RECORD_SIZE);
+
+    if (buf.size () >= RAW_DATA_BUFFER_SIZE)
+      hand_over ();
+  }
+};
+
+/*!
+ * Convert a file written by raw_data_writer to the text format
+ * (torque<TAB>confirmation, header lines starting with #)
+ * which is used for measurement_input and the octave scripts in logfiles.
+ */
+void raw_data_to_text (string fn, ostream &out);
+
+#endif
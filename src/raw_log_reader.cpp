@@ -0,0 +1,508 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class raw_log_reader: random access to recorded torque data (text logs and raw_data_writer files)
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "raw_log_reader.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <stdlib.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#endif
+
+static uint32_t get_u32 (const char *p)
+{
+  const unsigned char *u = (const unsigned char *) p;
+  return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+/*
+ * Parses a decimal number like -12.345e-2 at p.
+ * Don't use strtod here: it depends on LC_NUMERIC and the GUIs call setlocale (LC_ALL, "")
+ * returns the position after the number or 0 if there is no number at p
+ */
+static const char* parse_number (const char *p, const char *end, double &value)
+{
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = (*p++ == '-');
+
+  // mantissa as integer and divided once by 10^frac_digits,
+  // this gives the same result as strtod for the usual "%.3f" values
+  double v = 0;
+  int digits = 0;
+  int frac_digits = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    {
+      v = v * 10 + (*p++ - '0');
+      digits++;
+    }
+
+  if (p < end && *p == '.')
+    {
+      p++;
+      while (p < end && *p >= '0' && *p <= '9')
+        {
+          v = v * 10 + (*p++ - '0');
+          digits++;
+          frac_digits++;
+        }
+    }
+
+  if (! digits)
+    return 0;
+
+  if (frac_digits)
+    v /= pow (10.0, frac_digits);
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      const char *q = p + 1;
+      bool eneg = false;
+      if (q < end && (*q == '-' || *q == '+'))
+        eneg = (*q++ == '-');
+      if (q < end && *q >= '0' && *q <= '9')
+        {
+          int e = 0;
+          while (q < end && *q >= '0' && *q <= '9')
+            e = e * 10 + (*q++ - '0');
+          v *= pow (10.0, eneg? -e : e);
+          p = q;
+        }
+    }
+
+  value = neg? -v : v;
+  return p;
+}
+
+raw_log_reader::raw_log_reader (string filename)
+  : fn (filename), data(0), len(0), binary(false), scale(1), data_offset(0),
+    num_samples(0), next_sample(0), next_offset(0)
+{
+  map_file ();
+  idx_fn = index_filename ();
+  try
+    {
+      parse_header ();
+      if (! load_index ())
+        {
+          build_index ();
+          save_index ();
+        }
+    }
+  catch (...)
+    {
+      unmap_file ();
+      throw;
+    }
+  seek (0);
+}
+
+raw_log_reader::~raw_log_reader ()
+{
+  unmap_file ();
+}
+
+void raw_log_reader::map_file ()
+{
+#ifdef _WIN32
+  ifstream in (fn.c_str (), ios::binary);
+  if (! in)
+    throw runtime_error (string ("raw_log_reader: Unable to open file ") + fn);
+  file_buf.assign (istreambuf_iterator<char> (in), istreambuf_iterator<char> ());
+  data = file_buf.data ();
+  len = file_buf.size ();
+#else
+  int fd = open (fn.c_str (), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error (string ("raw_log_reader: Unable to open file ") + fn);
+
+  struct stat st;
+  if (fstat (fd, &st))
+    {
+      close (fd);
+      throw runtime_error (string ("raw_log_reader: fstat failed for ") + fn);
+    }
+
+  len = st.st_size;
+  if (len > 0)
+    {
+      void *p = mmap (0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED)
+        {
+          close (fd);
+          throw runtime_error (string ("raw_log_reader: mmap failed for ") + fn);
+        }
+      data = (const char *) p;
+#ifdef MADV_SEQUENTIAL
+      madvise (p, len, MADV_SEQUENTIAL);
+#endif
+    }
+  close (fd);
+#endif
+}
+
+void raw_log_reader::unmap_file ()
+{
+#ifndef _WIN32
+  if (data)
+    munmap ((void *) data, len);
+#endif
+  data = 0;
+  len = 0;
+}
+
+void raw_log_reader::parse_header ()
+{
+  if (len >= 28 && ! memcmp (data, RAW_DATA_MAGIC, 8))
+    {
+      binary = true;
+      if (get_u32 (data + 8) != RAW_DATA_VERSION)
+        throw runtime_error (fn + ": unknown raw data version");
+
+      uint64_t s = get_u32 (data + 16) | ((uint64_t) get_u32 (data + 20) << 32);
+      memcpy (&scale, &s, sizeof (scale));
+
+      size_t hlen = get_u32 (data + 24);
+      if (28 + hlen > len)
+        throw runtime_error (fn + ": truncated header");
+      header.assign (data + 28, hlen);
+      data_offset = 28 + hlen;
+    }
+  else
+    {
+      data_offset = skip_comments (0);
+      header.assign (data, data_offset);
+    }
+}
+
+// skip empty lines and comments starting with #
+size_t raw_log_reader::skip_comments (size_t pos)
+{
+  while (pos < len)
+    {
+      char c = data[pos];
+      if (c == '#')
+        {
+          const char *nl = (const char *) memchr (data + pos, '\n', len - pos);
+          pos = nl? (nl - data) + 1 : len;
+        }
+      else if (c == '\n' || c == '\r' || c == ' ' || c == '\t')
+        pos++;
+      else
+        break;
+    }
+  return pos;
+}
+
+size_t raw_log_reader::parse_sample (size_t pos, double &torque, bool &confirmation)
+{
+  if (binary)
+    {
+      const unsigned char *p = (const unsigned char *) data + pos;
+      int raw = p[4] | (p[5] << 8) | (p[6] << 16);
+      if (raw & 0x800000)
+        raw -= 0x1000000;
+      torque = raw * scale;
+      confirmation = p[7] & RAW_DATA_FLAG_CONFIRMATION;
+      return pos + RAW_DATA_RECORD_SIZE;
+    }
+
+  const char *end = data + len;
+  const char *p = parse_number (data + pos, end, torque);
+  if (! p)
+    return 0;
+
+  // optional second column
+  confirmation = false;
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  double c;
+  const char *q = parse_number (p, end, c);
+  if (q)
+    {
+      confirmation = (c != 0);
+      p = q;
+    }
+
+  const char *nl = (const char *) memchr (p, '\n', end - p);
+  return skip_comments (nl? (nl - data) + 1 : len);
+}
+
+void raw_log_reader::build_index ()
+{
+  offsets.clear ();
+  v_peaks.clear ();
+  num_samples = 0;
+
+  // maximum absolute torque per stride
+  vector<double> stride_max;
+  vector<size_t> stride_max_index;
+  vector<double> stride_max_value;
+  double total_max = 0;
+
+  size_t pos = data_offset;
+  size_t end = len;
+  if (binary)
+    end = data_offset + (len - data_offset) / RAW_DATA_RECORD_SIZE * RAW_DATA_RECORD_SIZE;
+
+  while (pos < end)
+    {
+      double torque;
+      bool conf;
+      size_t next = parse_sample (pos, torque, conf);
+      if (! next)
+        {
+          cerr << "raw_log_reader: Couldn't read double in " << fn << " sample " << num_samples << endl;
+          break;
+        }
+
+      if (num_samples % RAW_LOG_INDEX_STRIDE == 0)
+        {
+          offsets.push_back (pos);
+          stride_max.push_back (-1);
+          stride_max_index.push_back (0);
+          stride_max_value.push_back (0);
+        }
+
+      double a = fabs (torque);
+      if (a > stride_max.back ())
+        {
+          stride_max.back () = a;
+          stride_max_index.back () = num_samples;
+          stride_max_value.back () = torque;
+        }
+      if (a > total_max)
+        total_max = a;
+
+      num_samples++;
+      pos = next;
+    }
+
+  // adjacent strides above threshold form a peak window
+  double thres = RAW_LOG_PEAK_THRESHOLD * total_max;
+  for (size_t k = 0; total_max > 0 && k < stride_max.size (); ++k)
+    if (stride_max[k] >= thres)
+      {
+        raw_log_peak p;
+        p.first = k * RAW_LOG_INDEX_STRIDE;
+        p.peak_index = stride_max_index[k];
+        p.peak = stride_max_value[k];
+        double m = stride_max[k];
+        while (k + 1 < stride_max.size () && stride_max[k + 1] >= thres)
+          {
+            k++;
+            if (stride_max[k] > m)
+              {
+                m = stride_max[k];
+                p.peak_index = stride_max_index[k];
+                p.peak = stride_max_value[k];
+              }
+          }
+        p.last = min ((k + 1) * RAW_LOG_INDEX_STRIDE, num_samples) - 1;
+        v_peaks.push_back (p);
+      }
+}
+
+string raw_log_reader::index_filename ()
+{
+  string abs_fn = fn;
+#ifdef _WIN32
+  char buf[_MAX_PATH];
+  if (_fullpath (buf, fn.c_str (), _MAX_PATH))
+    abs_fn = buf;
+#else
+  char buf[PATH_MAX];
+  if (realpath (fn.c_str (), buf))
+    abs_fn = buf;
+#endif
+
+  for (size_t k = 0; k < abs_fn.size (); ++k)
+    if (abs_fn[k] == '/' || abs_fn[k] == '\\' || abs_fn[k] == ':')
+      abs_fn[k] = '_';
+  return RAW_LOG_INDEX_DIR + abs_fn + ".idx";
+}
+
+/*
+ * index file: RAW_LOG_INDEX_MAGIC, size and mtime of the log, num_samples,
+ * offsets and peaks (native byte order, it's only a cache)
+ */
+bool raw_log_reader::load_index ()
+{
+  struct stat st;
+  if (stat (fn.c_str (), &st))
+    return false;
+
+  FILE *fp = fopen (idx_fn.c_str (), "rb");
+  if (! fp)
+    return false;
+
+  bool ok = false;
+  char magic[8];
+  uint64_t size, n_offsets, n_peaks, n;
+  int64_t mtime;
+  if (fread (magic, 8, 1, fp) == 1 && ! memcmp (magic, RAW_LOG_INDEX_MAGIC, 8)
+      && fread (&size, sizeof (size), 1, fp) == 1 && size == (uint64_t) st.st_size
+      && fread (&mtime, sizeof (mtime), 1, fp) == 1 && mtime == (int64_t) st.st_mtime
+      && fread (&n, sizeof (n), 1, fp) == 1
+      && fread (&n_offsets, sizeof (n_offsets), 1, fp) == 1)
+    {
+      offsets.resize (n_offsets);
+      if ((! n_offsets || fread (offsets.data (), sizeof (uint64_t), n_offsets, fp) == n_offsets)
+          && fread (&n_peaks, sizeof (n_peaks), 1, fp) == 1)
+        {
+          v_peaks.resize (n_peaks);
+          ok = true;
+          for (size_t k = 0; ok && k < n_peaks; ++k)
+            {
+              uint64_t u[3];
+              ok =    fread (u, sizeof (uint64_t), 3, fp) == 3
+                      && fread (&v_peaks[k].peak, sizeof (double), 1, fp) == 1;
+              v_peaks[k].first = u[0];
+              v_peaks[k].last = u[1];
+              v_peaks[k].peak_index = u[2];
+            }
+          num_samples = n;
+        }
+    }
+  fclose (fp);
+
+  if (! ok)
+    {
+      offsets.clear ();
+      v_peaks.clear ();
+      num_samples = 0;
+    }
+  return ok;
+}
+
+void raw_log_reader::save_index ()
+{
+  struct stat st;
+  if (stat (fn.c_str (), &st))
+    return;
+
+  // create RAW_LOG_INDEX_DIR and its parents, errors show up at fopen
+  string dir = RAW_LOG_INDEX_DIR;
+  for (size_t pos = dir.find ('/', 2); pos != string::npos; pos = dir.find ('/', pos + 1))
+#ifdef _WIN32
+    _mkdir (dir.substr (0, pos).c_str ());
+#else
+    mkdir (dir.substr (0, pos).c_str (), 0755);
+#endif
+
+  // the index is only a cache, ignore write errors (for example read-only directory)
+  // write to a temporary file and rename it, so that a concurrent reader never sees a partial index
+  ostringstream tmp_fn;
+  tmp_fn << idx_fn << ".tmp" << (uintptr_t) this;
+  FILE *fp = fopen (tmp_fn.str ().c_str (), "wb");
+  if (! fp)
+    return;
+
+  uint64_t size = st.st_size;
+  int64_t mtime = st.st_mtime;
+  uint64_t n = num_samples;
+  uint64_t n_offsets = offsets.size ();
+  uint64_t n_peaks = v_peaks.size ();
+
+  bool ok =    fwrite (RAW_LOG_INDEX_MAGIC, 8, 1, fp) == 1
+               && fwrite (&size, sizeof (size), 1, fp) == 1
+               && fwrite (&mtime, sizeof (mtime), 1, fp) == 1
+               && fwrite (&n, sizeof (n), 1, fp) == 1
+               && fwrite (&n_offsets, sizeof (n_offsets), 1, fp) == 1
+               && (! n_offsets || fwrite (offsets.data (), sizeof (uint64_t), n_offsets, fp) == n_offsets)
+               && fwrite (&n_peaks, sizeof (n_peaks), 1, fp) == 1;
+  for (size_t k = 0; ok && k < v_peaks.size (); ++k)
+    {
+      uint64_t u[3] = {v_peaks[k].first, v_peaks[k].last, v_peaks[k].peak_index};
+      ok =    fwrite (u, sizeof (uint64_t), 3, fp) == 3
+              && fwrite (&v_peaks[k].peak, sizeof (double), 1, fp) == 1;
+    }
+  if (fclose (fp))
+    ok = false;
+
+#ifdef _WIN32
+  // rename doesn't replace existing files on windows
+  if (ok)
+    remove (idx_fn.c_str ());
+#endif
+  if (! ok || rename (tmp_fn.str ().c_str (), idx_fn.c_str ()))
+    remove (tmp_fn.str ().c_str ());
+}
+
+void raw_log_reader::seek (size_t sample)
+{
+  if (sample >= num_samples)
+    {
+      next_sample = num_samples;
+      next_offset = len;
+      return;
+    }
+
+  size_t k = sample / RAW_LOG_INDEX_STRIDE;
+  next_sample = k * RAW_LOG_INDEX_STRIDE;
+  next_offset = offsets[k];
+
+  double torque;
+  bool conf;
+  while (next_sample < sample)
+    read_next (torque, conf);
+}
+
+bool raw_log_reader::read_next (double &torque, bool &confirmation)
+{
+  if (next_sample >= num_samples)
+    return false;
+
+  next_offset = parse_sample (next_offset, torque, confirmation);
+  next_sample++;
+  return true;
+}
+
+size_t raw_log_reader::read (size_t first, size_t count, vector<double> &torque, vector<bool> *confirmation)
+{
+  seek (first);
+
+  size_t n = 0;
+  double t;
+  bool c;
+  while (n < count && read_next (t, c))
+    {
+      torque.push_back (t);
+      if (confirmation)
+        confirmation->push_back (c);
+      n++;
+    }
+  return n;
+}
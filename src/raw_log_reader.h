@@ -0,0 +1,139 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class raw_log_reader: random access to recorded torque data (text logs and raw_data_writer files)
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RAW_LOG_READER_H
+#define RAW_LOG_READER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include "raw_data_writer.h"
+
+using namespace std;
+
+// every RAW_LOG_INDEX_STRIDE samples the file offset is stored in the index (0.1s at 900Hz)
+#define RAW_LOG_INDEX_STRIDE 90
+
+// a peak window starts where the absolute torque of a stride exceeds
+// RAW_LOG_PEAK_THRESHOLD * maximum absolute torque in the file
+#define RAW_LOG_PEAK_THRESHOLD 0.1
+
+#define RAW_LOG_INDEX_MAGIC "TTTIDX1\n"
+
+// the index files are a cache and aren't written next to the logs (read-only
+// directories, corpora under version control), see raw_log_reader::index_filename
+#define RAW_LOG_INDEX_DIR "./logfiles/index/"
+
+//! region of the log with a peak (click)
+struct raw_log_peak
+{
+  size_t first;       //!< first sample of the window
+  size_t last;        //!< last sample of the window
+  size_t peak_index;  //!< sample with the maximum absolute torque
+  double peak;        //!< torque at peak_index
+};
+
+/*!
+ * The file is mapped into memory and scanned once. The sample offsets
+ * (every RAW_LOG_INDEX_STRIDE samples) and the peak windows are stored in
+ * an index file in RAW_LOG_INDEX_DIR, so the next open doesn't need a full parse.
+ *
+ * Text logs: one sample per line, "torque[<TAB>confirmation]", lines starting with # are comments.
+ * Binary: see raw_data_writer.h
+ */
+class raw_log_reader
+{
+private:
+  string fn;
+  string idx_fn;
+
+  const char *data;
+  size_t len;
+#ifdef _WIN32
+  vector<char> file_buf;
+#endif
+
+  bool binary;
+  double scale;           // binary only
+  size_t data_offset;     // first sample
+  string header;
+
+  size_t num_samples;
+  vector<uint64_t> offsets;   // offsets[k] = file offset of sample k*RAW_LOG_INDEX_STRIDE
+  vector<raw_log_peak> v_peaks;
+
+  // position of read_next ()
+  size_t next_sample;
+  size_t next_offset;
+
+  void map_file ();
+  void unmap_file ();
+  void parse_header ();
+
+  // RAW_LOG_INDEX_DIR + absolute path of fn with '_' for the separators + ".idx"
+  string index_filename ();
+  void build_index ();
+  bool load_index ();
+  void save_index ();
+
+  // parse the sample at offset pos, returns the offset of the next sample
+  size_t parse_sample (size_t pos, double &torque, bool &confirmation);
+  size_t skip_comments (size_t pos);
+
+public:
+  raw_log_reader (string fn);
+  ~raw_log_reader ();
+
+  size_t size ()
+  {
+    return num_samples;
+  }
+
+  //! comment header (lines starting with #)
+  string get_header ()
+  {
+    return header;
+  }
+
+  //! windows with a click, see RAW_LOG_PEAK_THRESHOLD
+  const vector<raw_log_peak>& peaks ()
+  {
+    return v_peaks;
+  }
+
+  /*!
+   * read count samples starting at sample first
+   * returns the number of samples read (less than count at the end of file)
+   * confirmation may be NULL
+   */
+  size_t read (size_t first, size_t count, vector<double> &torque, vector<bool> *confirmation = 0);
+
+  //! sequential reading, returns false at end of file
+  bool read_next (double &torque, bool &confirmation);
+  void seek (size_t sample);
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class report_queue: creates the ISO 6789 reports of finished measurements in a background thread
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "report_queue.h"
+#include <iostream>
+
+report_queue::report_queue (string fn)
+  : database_fn (fn), busy (false), quit (false)
+{
+  th = thread (&report_queue::loop, this);
+}
+
+report_queue::~report_queue ()
+{
+  {
+    lock_guard<mutex> lock (mtx);
+    quit = true;
+  }
+  cv.notify_all ();
+  if (th.joinable ())
+    th.join ();
+}
+
+void report_queue::push (const report_job &j)
+{
+  {
+    lock_guard<mutex> lock (mtx);
+    todo.push_back (j);
+  }
+  cv.notify_all ();
+}
+
+size_t report_queue::pop_done (vector<report_job> &out)
+{
+  lock_guard<mutex> lock (mtx);
+  size_t n = done.size ();
+  out.insert (out.end (), done.begin (), done.end ());
+  done.clear ();
+  return n;
+}
+
+void report_queue::wait ()
+{
+  unique_lock<mutex> lock (mtx);
+  cv.wait (lock, [this] { return todo.empty () && ! busy; });
+}
+
+void report_queue::loop ()
+{
+  sqlite3 *db = 0;
+  int rc = sqlite3_open_v2 (database_fn.c_str (), &db, SQLITE_OPEN_READONLY, NULL);
+  if (rc != SQLITE_OK)
+    {
+      cerr << "report_queue: Can't open database " << database_fn << ": " << sqlite3_errmsg (db) << endl;
+      sqlite3_close (db);
+      db = 0;
+    }
+
+  unique_lock<mutex> lock (mtx);
+  while (true)
+    {
+      // the remaining jobs are done before quit
+      cv.wait (lock, [this] { return quit || ! todo.empty (); });
+      if (todo.empty ())
+        break;
+
+      report_job j = todo.front ();
+      todo.pop_front ();
+      busy = true;
+      lock.unlock ();
+
+      cout << "report_queue: measurement " << j.measurement_id << " -> " << j.filename << endl;
+      j.result.values_below_max_deviation = false;
+      j.result.timing_violation = false;
+      if (! db)
+        j.error = "report_queue: No database";
+      else
+        {
+          try
+            {
+              j.result = create_ISO6789_report (db, j.measurement_id, j.filename.c_str (), j.repeat_on_tolerance_violation);
+            }
+          catch (std::exception &e)
+            {
+              j.error = e.what ();
+            }
+        }
+
+      lock.lock ();
+      done.push_back (j);
+      busy = false;
+      cv.notify_all ();
+    }
+  lock.unlock ();
+
+  sqlite3_close (db);
+}
@@ -0,0 +1,83 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class report_queue: creates the ISO 6789 reports of finished measurements in a background thread
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REPORT_QUEUE_H
+#define REPORT_QUEUE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sqlite3.h>
+#include "cairo_drawing_functions.h"
+
+using namespace std;
+
+struct report_job
+{
+  int measurement_id;
+  string filename;
+  bool repeat_on_tolerance_violation;
+  report_result result;     // valid after the job was done
+  string error;             // not empty if the report failed
+};
+
+/*
+ * The batch mode of ttt measures the next test object while the report
+ * of the previous one is drawn. The thread uses its own (read only) connection
+ * to the database, the measurement has to be committed before push ().
+ * Jobs are done in the order of push ().
+ */
+class report_queue
+{
+private:
+  string database_fn;
+
+  mutex mtx;
+  condition_variable cv;
+  deque<report_job> todo;
+  deque<report_job> done;
+  bool busy;        // a job was taken from todo and isn't done yet
+  bool quit;
+  thread th;
+
+  void loop ();
+
+public:
+  report_queue (string database_fn);
+  // finishes the queued jobs
+  ~report_queue ();
+
+  void push (const report_job &j);
+
+  // append the jobs done since the last call to out, returns the number of jobs
+  size_t pop_done (vector<report_job> &out);
+
+  // block until all pushed jobs are done
+  void wait ();
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class spsc_ring: lock-free single producer/single consumer ring buffer
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/*
+ * Fixed capacity ring buffer without locks.
+ * push () must only be called from one thread (producer),
+ * pop () only from one other thread (consumer).
+ */
+template <typename T> class spsc_ring
+{
+private:
+  vector<T> buf;
+  size_t mask;
+  atomic<size_t> head;   // next write position, only modified by producer
+  atomic<size_t> tail;   // next read position, only modified by consumer
+
+public:
+  // capacity is rounded up to the next power of 2
+  explicit spsc_ring (size_t capacity)
+    : head (0), tail (0)
+  {
+    size_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+    buf.resize (n);
+    mask = n - 1;
+  }
+
+  size_t capacity () const
+  {
+    return buf.size ();
+  }
+
+  size_t size () const
+  {
+    return head.load (memory_order_acquire) - tail.load (memory_order_acquire);
+  }
+
+  // returns false if the ring is full
+  bool push (const T &v)
+  {
+    size_t h = head.load (memory_order_relaxed);
+    if (h - tail.load (memory_order_acquire) == buf.size ())
+      return false;
+
+    buf[h & mask] = v;
+    head.store (h + 1, memory_order_release);
+    return true;
+  }
+
+  // append all available elements to out, returns the number of elements
+  size_t pop_all (vector<T> &out)
+  {
+    size_t t = tail.load (memory_order_relaxed);
+    size_t h = head.load (memory_order_acquire);
+    for (size_t k = t; k != h; ++k)
+      out.push_back (buf[k & mask]);
+
+    tail.store (h, memory_order_release);
+    return h - t;
+  }
+};
+
+#endif
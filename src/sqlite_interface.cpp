@@ -30,6 +30,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <unistd.h>
 #include <climits>
+#include <fstream>
 #include "sqlite_interface.h"
 #include "cairo_print_devices.h"
 
@@ -142,16 +143,25 @@ void cairo_centered_text (cairo_t *cr, double x, double y, const char *str)
   cairo_show_text (cr, str);
 }
 
+void localtime_ts (const time_t *t, struct tm *result)
+{
+#ifdef _WIN32
+  localtime_s (result, t);
+#else
+  localtime_r (t, result);
+#endif
+}
+
 string get_localtime ()
 {
   time_t rawtime;
-  struct tm *timeinfo;
+  struct tm timeinfo;
   char buffer[80];
 
   time (&rawtime);
-  timeinfo = localtime (&rawtime);
+  localtime_ts (&rawtime, &timeinfo);
 
-  strftime (buffer, 80, "%Y-%m-%d %H:%M:%S", timeinfo);
+  strftime (buffer, 80, "%Y-%m-%d %H:%M:%S", &timeinfo);
   return buffer;
 }
 
@@ -162,6 +172,77 @@ string subst_wildcards (string in)
   return in;
 }
 
+void exec_sql_file (sqlite3 *db, string fn)
+{
+  ifstream in (fn.c_str ());
+  if (! in)
+    throw runtime_error (string ("exec_sql_file can't open ") + fn);
+
+  ostringstream sql;
+  sql << in.rdbuf ();
+
+  char *errmsg = 0;
+  int rc = sqlite3_exec (db, sql.str ().c_str (), 0, 0, &errmsg);
+  if (rc != SQLITE_OK)
+    {
+      string msg = string ("exec_sql_file ") + fn + ": " + (errmsg? errmsg : sqlite3_errstr (rc));
+      sqlite3_free (errmsg);
+      throw runtime_error (msg);
+    }
+}
+static bool has_column (sqlite3 *db, string table, string column)
+{
+  sqlite3_stmt *pStmt;
+  bool found = false;
+  int rc = sqlite3_prepare_v2 (db, (string ("PRAGMA table_info(") + table + ")").c_str (), -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      while (! found && sqlite3_step (pStmt) == SQLITE_ROW)
+        found = (column == (const char*) sqlite3_column_text (pStmt, 1));
+      sqlite3_finalize(pStmt);
+    }
+  return found;
+}
+
+static bool has_table (sqlite3 *db, string table)
+{
+  sqlite3_stmt *pStmt;
+  bool found = false;
+  int rc = sqlite3_prepare_v2 (db, "SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?1", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_text (pStmt, 1, table.c_str (), -1, SQLITE_TRANSIENT);
+      found = (sqlite3_step (pStmt) == SQLITE_ROW);
+      sqlite3_finalize(pStmt);
+    }
+  return found;
+}
+
+static void add_column (sqlite3 *db, string table, string column, string type)
+{
+  // an empty database gets the column from create_database.sql
+  if (! has_table (db, table) || has_column (db, table, column))
+    return;
+
+  cout << "migrate_database: add column " << column << " to " << table << endl;
+  string sql = string ("ALTER TABLE ") + table + " ADD COLUMN " + column + " " + type;
+  char *errmsg = 0;
+  int rc = sqlite3_exec (db, sql.c_str (), 0, 0, &errmsg);
+  if (rc != SQLITE_OK)
+    {
+      string msg = string ("migrate_database ") + sql + ": " + (errmsg? errmsg : sqlite3_errstr (rc));
+      sqlite3_free (errmsg);
+      throw runtime_error (msg);
+    }
+}
+
+void migrate_database (sqlite3 *db)
+{
+  add_column (db, "torque_tester", "digits", "INTEGER");
+  add_column (db, "measurement", "state", "TEXT");
+  add_column (db, "measurement", "repeat_on_timing_violation", "INTEGER");
+}
+
 void test_person::load_with_id (sqlite3 *db, int search_id)
 {
   sqlite3_stmt *pStmt;
@@ -509,6 +590,7 @@ void torque_tester::load_with_id (sqlite3 *db, int search_id)
               max_torque = sqlite3_column_double (pStmt, 7);
               resolution = sqlite3_column_double (pStmt, 8);
               uncertainty_of_measurement = sqlite3_column_double (pStmt, 9);
+              digits = (sqlite3_column_type (pStmt, 10) == SQLITE_NULL)? -1 : sqlite3_column_int (pStmt, 10);
             }
           sqlite3_finalize(pStmt);
           if (rc == SQLITE_DONE)
@@ -550,6 +632,44 @@ int torque_tester::search_serial_and_next_cal_date (sqlite3 *db, string serial,
   return tmp_id;
 }
 
+int torque_tester::search_serial_and_next_cal_date (sqlite3 *db, string serial, string next_cal_date)
+{
+  sqlite3_stmt *pStmt;
+  int tmp_id = -1;
+  int rc = sqlite3_prepare_v2 (db, "SELECT id FROM torque_tester WHERE serial_number = ?1 AND next_calibration_date = ?2 "
+                               "AND digits IS NOT NULL ORDER BY id DESC LIMIT 1", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_text (pStmt, 1, serial.c_str (), -1, SQLITE_STATIC);
+      sqlite3_bind_text (pStmt, 2, next_cal_date.c_str (), -1, SQLITE_STATIC);
+      rc = sqlite3_step (pStmt);
+      if (rc == SQLITE_ROW)
+        tmp_id = sqlite3_column_int (pStmt, 0);
+      sqlite3_finalize(pStmt);
+    }
+  else
+    fprintf(stderr, "SQL error from sqlite3_prepare_v2: %i = %s\n", rc, sqlite3_errmsg(db));
+  return tmp_id;
+}
+
+void torque_tester::update_digits (sqlite3 *db, int new_digits)
+{
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "UPDATE torque_tester SET digits = ?1 WHERE id = ?2", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_int (pStmt, 1, new_digits);
+      sqlite3_bind_int (pStmt, 2, id);
+      rc = sqlite3_step (pStmt);
+      sqlite3_finalize(pStmt);
+      if (rc != SQLITE_DONE)
+        throw runtime_error ("torque_tester::update_digits sqlite3_step failed");
+      digits = new_digits;
+    }
+  else
+    fprintf(stderr, "SQL error from sqlite3_prepare_v2: %i = %s\n", rc, sqlite3_errmsg(db));
+}
+
 void torque_tester::save (sqlite3 *db)
 {
   cout << "torque_tester::save" << endl;
@@ -562,8 +682,8 @@ void torque_tester::save (sqlite3 *db)
 
   sqlite3_stmt *pStmt;
   int rc = sqlite3_prepare_v2 (db, "INSERT INTO torque_tester (serial_number, manufacturer, model, next_calibration_date, calibration_date, "
-                               "calibration_number, max_torque, resolution, uncertainty_of_measurement)"
-                               "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);", -1, &pStmt, NULL);
+                               "calibration_number, max_torque, resolution, uncertainty_of_measurement, digits)"
+                               "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10);", -1, &pStmt, NULL);
   if (rc == SQLITE_OK)
     {
       sqlite3_bind_text (pStmt, 1, serial_number.c_str (), -1, SQLITE_STATIC);
@@ -575,6 +695,10 @@ void torque_tester::save (sqlite3 *db)
       sqlite3_bind_double (pStmt, 7, max_torque);
       sqlite3_bind_double (pStmt, 8, resolution);
       sqlite3_bind_double (pStmt, 9, uncertainty_of_measurement);
+      if (digits >= 0)
+        sqlite3_bind_int (pStmt, 10, digits);
+      else
+        sqlite3_bind_null (pStmt, 10);
       rc = sqlite3_step (pStmt);
       sqlite3_finalize(pStmt);
       if (rc != SQLITE_DONE)
@@ -618,7 +742,7 @@ double torque_tester::cairo_print (cairo_t *cr, double c1, double c2, double top
 }
 
 measurement::measurement ()
-  : id(-1), temperature(0), humidity(0)
+  : id(-1), temperature(0), humidity(0), repeat_on_timing_violation(false)
 {
 
 
@@ -665,8 +789,9 @@ void measurement::load_with_id (sqlite3 *db, int search_id)
   int test_object_id = -1;
   int torque_tester_id = -1;
 
-  // FIMXE: replace *
-  int rc = sqlite3_prepare_v2 (db, "SELECT * FROM measurement WHERE rowid = ?1", -1, &pStmt, NULL);
+  int rc = sqlite3_prepare_v2 (db, "SELECT id, norm, test_person_id, test_object_id, torque_tester_id,"
+                               "start_time, end_time, raw_data_filename, temperature, humidity,"
+                               "state, repeat_on_timing_violation FROM measurement WHERE rowid = ?1", -1, &pStmt, NULL);
   if (rc == SQLITE_OK)
     {
       rc = sqlite3_bind_int (pStmt, 1, search_id);
@@ -685,6 +810,8 @@ void measurement::load_with_id (sqlite3 *db, int search_id)
               raw_data_filename = (const char*) sqlite3_column_text (pStmt, 7);
               temperature = sqlite3_column_double (pStmt, 8);
               humidity = sqlite3_column_double (pStmt, 9);
+              state = (sqlite3_column_type (pStmt, 10) == SQLITE_NULL)? "" : (const char*) sqlite3_column_text (pStmt, 10);
+              repeat_on_timing_violation = sqlite3_column_int (pStmt, 11);
             }
           sqlite3_finalize(pStmt);
           if (rc == SQLITE_DONE)
@@ -703,9 +830,9 @@ void measurement::load_with_id (sqlite3 *db, int search_id)
   to.load_with_id (db, test_object_id);
   tt.load_with_id (db, torque_tester_id);
 
-  // load measurement_items
+  // load measurement_items (ts has only seconds, id is the order of insertion)
   rc = sqlite3_prepare_v2 (db, "SELECT ts,nominal_value,indicated_value,rise_time FROM measurement_item "
-                           "WHERE measurement = ?1 ORDER BY ts", -1, &pStmt, NULL);
+                           "WHERE measurement = ?1 ORDER BY ts, id", -1, &pStmt, NULL);
   if (rc == SQLITE_OK)
     {
       rc = sqlite3_bind_int (pStmt, 1, id);
@@ -736,9 +863,9 @@ void measurement::load_with_id (sqlite3 *db, int search_id)
     fprintf(stderr, "SQL error from sqlite3_prepare_v2: %i = %s\n", rc, sqlite3_errmsg(db));
 }
 
-void measurement::save (sqlite3 *db)
+void measurement::insert (sqlite3 *db)
 {
-  cout << "measurement::save (sqlite3 *db) tp.id="<< tp.id << " tt.id=" << tt.id << " to.id=" << to.id << endl;
+  cout << "measurement::insert (sqlite3 *db) tp.id="<< tp.id << " tt.id=" << tt.id << " to.id=" << to.id << endl;
 
   // check if we should create a new test_person entry
   if (tp.id == 0)
@@ -755,18 +882,18 @@ void measurement::save (sqlite3 *db)
   srand (time(NULL) + to.id);
 
   sqlite3_stmt *pStmt;
-  sqlite3_exec(db, "BEGIN;", 0, 0, 0);
   // insert measurement
   int rc = sqlite3_prepare_v2 (db, "INSERT INTO measurement"
                                "(norm, test_person_id, test_object_id, torque_tester_id, start_time,"
-                               "end_time, raw_data_filename, temperature, humidity)"
-                               "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);", -1, &pStmt, NULL);
+                               "end_time, raw_data_filename, temperature, humidity,"
+                               "state, repeat_on_timing_violation)"
+                               "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11);", -1, &pStmt, NULL);
   if (rc == SQLITE_OK)
     {
-      cout << "measurement::save norm = " << norm << endl;
-      cout << "measurement::save test_person.id = " << tp.id << endl;
-      cout << "measurement::save test_object.id = " << to.id << endl;
-      cout << "measurement::save torque_tester.id = " << tt.id << endl;
+      cout << "measurement::insert norm = " << norm << endl;
+      cout << "measurement::insert test_person.id = " << tp.id << endl;
+      cout << "measurement::insert test_object.id = " << to.id << endl;
+      cout << "measurement::insert torque_tester.id = " << tt.id << endl;
 
       sqlite3_bind_text (pStmt, 1, norm.c_str (), -1, SQLITE_STATIC);
       sqlite3_bind_int (pStmt, 2, tp.id);
@@ -777,6 +904,8 @@ void measurement::save (sqlite3 *db)
       sqlite3_bind_text (pStmt, 7, raw_data_filename.c_str (), -1, SQLITE_STATIC);
       sqlite3_bind_double (pStmt, 8, temperature);
       sqlite3_bind_double (pStmt, 9, humidity);
+      sqlite3_bind_text (pStmt, 10, state.c_str (), -1, SQLITE_STATIC);
+      sqlite3_bind_int (pStmt, 11, repeat_on_timing_violation);
 
       for (int j=0; j<5; ++j)
         {
@@ -795,48 +924,141 @@ void measurement::save (sqlite3 *db)
       sqlite3_finalize (pStmt);
       if (rc != SQLITE_DONE)
         {
-          fprintf(stderr, "measurement::save sqlite3_step for measurement failed %i = %s\n", rc, sqlite3_errmsg(db));
-          throw runtime_error ("measurement::save sqlite3_step for measurement failed");
+          fprintf(stderr, "measurement::insert sqlite3_step for measurement failed %i = %s\n", rc, sqlite3_errmsg(db));
+          throw runtime_error ("measurement::insert sqlite3_step for measurement failed");
         }
 
       id = sqlite3_last_insert_rowid (db);
     }
   else
     {
-      fprintf(stderr, "measurement::save sqlite3_prepare_v2 for measurement failed %i = %s\n", rc, sqlite3_errmsg(db));
-      throw runtime_error ("measurement::save sqlite3_prepare_v2 for measurement failed");
+      fprintf(stderr, "measurement::insert sqlite3_prepare_v2 for measurement failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("measurement::insert sqlite3_prepare_v2 for measurement failed");
     }
+}
 
-  // insert measurement_items
-  rc = sqlite3_prepare_v2 (db, "INSERT INTO measurement_item"
-                           "(ts, measurement, nominal_value, indicated_value, rise_time)"
-                           "VALUES (?1, ?2, ?3, ?4, ?5);", -1, &pStmt, NULL);
-  if (rc == SQLITE_OK)
+static sqlite3_stmt* prepare_insert_item (sqlite3 *db)
+{
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "INSERT INTO measurement_item"
+                               "(ts, measurement, nominal_value, indicated_value, rise_time)"
+                               "VALUES (?1, ?2, ?3, ?4, ?5);", -1, &pStmt, NULL);
+  if (rc != SQLITE_OK)
+    {
+      fprintf(stderr, "measurement::insert_item sqlite3_prepare_v2 for measurement_items failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("measurement::insert_item sqlite3_prepare_v2 for measurement_items failed");
+    }
+  return pStmt;
+}
+
+void measurement::insert_item (sqlite3 *db, sqlite3_stmt *pStmt, measurement_item *p)
+{
+  sqlite3_bind_text (pStmt, 1, p->ts.c_str (), -1, SQLITE_STATIC);
+  sqlite3_bind_int (pStmt, 2, id);
+  sqlite3_bind_double (pStmt, 3, p->nominal_value);
+  sqlite3_bind_double (pStmt, 4, p->indicated_value);
+  sqlite3_bind_double (pStmt, 5, p->rise_time);
+
+  int rc = sqlite3_step (pStmt);
+  if (rc != SQLITE_DONE)
+    {
+      fprintf(stderr, "measurement::insert_item sqlite3_step for measurement_items failed %i = %s\n", rc, sqlite3_errmsg(db));
+      sqlite3_finalize (pStmt);
+      throw runtime_error ("measurement::insert_item sqlite3_step for measurement_items failed");
+    }
+  sqlite3_reset (pStmt);
+}
+
+void measurement::save (sqlite3 *db)
+{
+  cout << "measurement::save (sqlite3 *db)" << endl;
+
+  sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+  try
     {
+      state = "finished";
+      insert (db);
+
+      // insert measurement_items
+      sqlite3_stmt *pStmt = prepare_insert_item (db);
       for (unsigned int k=0; k<measurement_items.size (); ++k)
-        {
-          sqlite3_bind_text (pStmt, 1, measurement_items[k]->ts.c_str (), -1, SQLITE_STATIC);
-          sqlite3_bind_int (pStmt, 2, id);
-          sqlite3_bind_double (pStmt, 3, measurement_items[k]->nominal_value);
-          sqlite3_bind_double (pStmt, 4, measurement_items[k]->indicated_value);
-          sqlite3_bind_double (pStmt, 5, measurement_items[k]->rise_time);
+        insert_item (db, pStmt, measurement_items[k]);
+      sqlite3_finalize(pStmt);
+    }
+  catch (std::runtime_error &e)
+    {
+      sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+      throw;
+    }
+  sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+}
 
-          rc = sqlite3_step (pStmt);
-          if (rc != SQLITE_DONE)
-            {
-              fprintf(stderr, "measurement::save sqlite3_step for measurement_items failed %i = %s\n", rc, sqlite3_errmsg(db));
-              throw runtime_error ("measurement::save sqlite3_step for measurement_items failed");
-            }
-          sqlite3_reset (pStmt);
+void measurement::begin (sqlite3 *db)
+{
+  state = "running";
+  end_time = "";
+  insert (db);
+  cout << "measurement::begin id=" << id << endl;
+}
+
+void measurement::append_item (sqlite3 *db, measurement_item *p)
+{
+  measurement_items.push_back (p);
+
+  // autocommit: the item is on disk when sqlite3_step returns
+  sqlite3_stmt *pStmt = prepare_insert_item (db);
+  insert_item (db, pStmt, p);
+  sqlite3_finalize(pStmt);
+}
+
+void measurement::finish (sqlite3 *db)
+{
+  cout << "measurement::finish id=" << id << endl;
+
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "UPDATE measurement SET end_time = ?1, state = 'finished' WHERE id = ?2;", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_text (pStmt, 1, end_time.c_str (), -1, SQLITE_STATIC);
+      sqlite3_bind_int (pStmt, 2, id);
+      rc = sqlite3_step (pStmt);
+      sqlite3_finalize(pStmt);
+      if (rc != SQLITE_DONE)
+        {
+          fprintf(stderr, "measurement::finish sqlite3_step failed %i = %s\n", rc, sqlite3_errmsg(db));
+          throw runtime_error ("measurement::finish sqlite3_step failed");
         }
+      state = "finished";
+    }
+  else
+    {
+      fprintf(stderr, "measurement::finish sqlite3_prepare_v2 failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("measurement::finish sqlite3_prepare_v2 failed");
+    }
+}
+
+void measurement::set_raw_data_filename (sqlite3 *db, string fn)
+{
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "UPDATE measurement SET raw_data_filename = ?1 WHERE id = ?2;", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_text (pStmt, 1, fn.c_str (), -1, SQLITE_STATIC);
+      sqlite3_bind_int (pStmt, 2, id);
+      rc = sqlite3_step (pStmt);
       sqlite3_finalize(pStmt);
+      if (rc != SQLITE_DONE)
+        {
+          fprintf(stderr, "measurement::set_raw_data_filename sqlite3_step failed %i = %s\n", rc, sqlite3_errmsg(db));
+          throw runtime_error ("measurement::set_raw_data_filename sqlite3_step failed");
+        }
+      raw_data_filename = fn;
     }
   else
     {
-      fprintf(stderr, "measurement::save sqlite3_prepare_v2 for measurement_items failed %i = %s\n", rc, sqlite3_errmsg(db));
-      throw runtime_error ("measurement::save sqlite3_prepare_v2 for measurement_items failed");
+      fprintf(stderr, "measurement::set_raw_data_filename sqlite3_prepare_v2 failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("measurement::set_raw_data_filename sqlite3_prepare_v2 failed");
     }
-  sqlite3_exec(db, "COMMIT;", 0, 0, 0);
 }
 
 // 5 Messungen pro Nominalwert
@@ -1386,6 +1608,7 @@ ostream& operator<< (ostream& os, const torque_tester &tt)
   os << "  max_torque                 = " << tt.max_torque << endl;
   os << "  resolution                 = " << tt.resolution << endl;
   os << "  uncertainty_of_measurement = " << tt.uncertainty_of_measurement << endl;
+  os << "  digits                     = " << tt.digits << endl;
   return os;
 }
 
@@ -1583,6 +1806,60 @@ bool test_object_has_measurement (sqlite3 *db, int id)
   return ret;
 }
 
+int find_unfinished_measurement (sqlite3 *db, int torque_tester_id, int &test_person_id, int &test_object_id)
+{
+  cout << "find_unfinished_measurement torque_tester_id=" << torque_tester_id << endl;
+  int ret = 0;
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "SELECT id, test_person_id, test_object_id FROM measurement "
+                               "WHERE state = 'running' AND norm LIKE 'ISO6789%' AND torque_tester_id = ?1 "
+                               "ORDER BY id DESC LIMIT 1;", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_int (pStmt, 1, torque_tester_id);
+      rc = sqlite3_step (pStmt);
+      if (rc == SQLITE_ROW)
+        {
+          ret = sqlite3_column_int (pStmt, 0);
+          test_person_id = sqlite3_column_int (pStmt, 1);
+          test_object_id = sqlite3_column_int (pStmt, 2);
+        }
+      sqlite3_finalize(pStmt);
+    }
+  else
+    {
+      fprintf(stderr, "find_unfinished_measurement sqlite3_prepare_v2 failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("find_unfinished_measurement sqlite3_prepare_v2 failed");
+    }
+  cout << "find_unfinished_measurement returns " << ret << endl;
+  return ret;
+}
+
+void set_measurement_state (sqlite3 *db, int id, string state)
+{
+  cout << "set_measurement_state id=" << id << " state=" << state << endl;
+
+  sqlite3_stmt *pStmt;
+  int rc = sqlite3_prepare_v2 (db, "UPDATE measurement SET state = ?1 WHERE id = ?2;", -1, &pStmt, NULL);
+  if (rc == SQLITE_OK)
+    {
+      sqlite3_bind_text (pStmt, 1, state.c_str (), -1, SQLITE_STATIC);
+      sqlite3_bind_int (pStmt, 2, id);
+      rc = sqlite3_step (pStmt);
+      sqlite3_finalize(pStmt);
+      if (rc != SQLITE_DONE)
+        {
+          fprintf(stderr, "set_measurement_state sqlite3_step failed %i = %s\n", rc, sqlite3_errmsg(db));
+          throw runtime_error ("set_measurement_state sqlite3_step failed");
+        }
+    }
+  else
+    {
+      fprintf(stderr, "set_measurement_state sqlite3_prepare_v2 failed %i = %s\n", rc, sqlite3_errmsg(db));
+      throw runtime_error ("set_measurement_state sqlite3_prepare_v2 failed");
+    }
+}
+
 void search_test_persons (sqlite3 *db, enum test_person_search_field field, string s, vector<test_person> &vtp)
 {
   cout << "search_test_persons field=" << field << " search_string=" << s << endl;
@@ -28,6 +28,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <string.h>
 #include <cmath>
+#include <ctime>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -56,11 +57,20 @@ double cairo_print_two_columns (cairo_t *cr, double c1, double c2, double top,
 double cairo_horizontal_line (cairo_t *cr, double c1, double top);
 void cairo_centered_text (cairo_t *cr, double x, double y, const char *str);
 
+// thread safe localtime (the sequencer runs in a ttt_worker, the reports in a report_queue)
+void localtime_ts (const time_t *t, struct tm *result);
+
 // get localtime for now in %Y-%m-%d %H:%M:%S format for sqlite
 string get_localtime ();
 
 string subst_wildcards (string in);
 
+// execute all SQL statements in file fn, for example create_database.sql
+void exec_sql_file (sqlite3 *db, string fn);
+
+// add columns which are missing in databases created with an older create_database.sql
+void migrate_database (sqlite3 *db);
+
 class test_person
 {
 
@@ -199,10 +209,14 @@ public:
   double max_torque;
   double resolution;      // Skalenteilung?
   double uncertainty_of_measurement;
+  int digits;             // -1 if unknown (entries created before the column existed)
 
-  torque_tester (): id(-1), max_torque(0), resolution(0), uncertainty_of_measurement(0) {}
+  torque_tester (): id(-1), max_torque(0), resolution(0), uncertainty_of_measurement(0), digits(-1) {}
   void load_with_id (sqlite3 *db, int search_id);
   int search_serial_and_next_cal_date (sqlite3 *db, string serial, string cal_date, string next_cal_date);
+  // newest entry with serial and next_cal_date which can be used as cache for the TTT metadata (digits known)
+  int search_serial_and_next_cal_date (sqlite3 *db, string serial, string next_cal_date);
+  void update_digits (sqlite3 *db, int new_digits);
   void save (sqlite3 *db);
 
   double cairo_print (cairo_t *cr, double c1, double c2, double top);
@@ -219,7 +233,7 @@ public:
   double rise_time;         // Only TypII, see DIN EN ISO 6789-1 6.2.4
 
   // loading and saving of measurement_item
-  // is done in measurement::load/save
+  // is done in measurement::load/save/append_item
 
 //  double rel_deviation ()
 //  {
@@ -256,11 +270,17 @@ public:
   friend ostream& operator<<(ostream& os, const measurement_item&);
 };
 
+// between the raw data files of the parts of a resumed measurement
+#define RAW_DATA_FILENAME_SEPARATOR ";"
+
 class measurement
 {
 private:
   vector<measurement_item *> measurement_items;
 
+  void insert (sqlite3 *db);
+  void insert_item (sqlite3 *db, sqlite3_stmt *pStmt, measurement_item *p);
+
 public:
   int id;
 
@@ -274,6 +294,8 @@ public:
   string raw_data_filename;
   double temperature;   // [°C]
   double humidity;      // [%rH]
+  string state;         // "running", "aborted", "finished", empty for measurements saved at the end
+  bool repeat_on_timing_violation;
 
   measurement ();
   ~measurement ();
@@ -282,9 +304,35 @@ public:
   void add_measurement_item (measurement_item *p);
   void clear_measurement_items ();
 
+  unsigned int get_measurement_item_count ()
+  {
+    return measurement_items.size ();
+  }
+
+  measurement_item* get_measurement_item (unsigned int k)
+  {
+    return measurement_items.at (k);
+  }
+
   void load_with_id (sqlite3 *db, int search_id);
+  // insert the measurement with all items at once
   void save (sqlite3 *db);
 
+  /*
+   * Incremental saving while the sequencer is running:
+   * begin inserts the measurement with state "running",
+   * append_item adds and inserts an item immediately (one transaction per item),
+   * finish sets the end_time and state "finished".
+   * A measurement which is still "running" after a crash can be continued,
+   * see find_unfinished_measurement.
+   */
+  void begin (sqlite3 *db);
+  void append_item (sqlite3 *db, measurement_item *p);
+  void finish (sqlite3 *db);
+  // update raw_data_filename, a resumed measurement has one raw data file
+  // per part, see RAW_DATA_FILENAME_SEPARATOR
+  void set_raw_data_filename (sqlite3 *db, string fn);
+
   double total_uncertainty () //Messunsicherheit
   {
     double ret = sqrt ( tt.uncertainty_of_measurement * tt.uncertainty_of_measurement / 4
@@ -319,6 +367,10 @@ void set_test_object_equipment_number (sqlite3 *db, int id, string equipment_num
 int search_active_adjacent_test_object (sqlite3 *db, int id);
 bool test_object_has_measurement (sqlite3 *db, int id);
 
+// latest ISO 6789 measurement with state "running" of the torque tester, 0 if there is none
+int find_unfinished_measurement (sqlite3 *db, int torque_tester_id, int &test_person_id, int &test_object_id);
+void set_measurement_state (sqlite3 *db, int id, string state);
+
 enum test_person_search_field
 {
   NAME,
@@ -25,8 +25,10 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include "step.h"
 
-step::step ()
-  : int_step(0), finished(0)
+step::step (step_kind k)
+  : kind(k), int_step(0), num_samples(0), first_index(0), last_index(0), prev_index(0), finished(0),
+    cached_instruction_step(-1),
+    run_max(0), run_min(0)
 {
   //cout << "step c'tor" << endl;
 }
@@ -36,23 +38,59 @@ step::~step()
   //cout << "step d'tor" << endl;
 }
 
-out_cmd step::inout (double torque, bool confirmation)
+out_cmd step::inout (double torque, bool confirmation, unsigned long index)
 {
-  // store currrent rorque
-  v_torque.push_back (torque);
-
-  if (v_time.empty ())
-    gettimeofday (&t1, NULL);
-
-  struct timeval t2;
-  gettimeofday (&t2, NULL);
-  v_time.push_back ((t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1.0e6);
+  if (! num_samples)
+    {
+      first_index = prev_index = index;
+      run_max = run_min = torque;
+    }
+  else
+    {
+      prev_index = last_index;
+      if (torque > run_max)
+        run_max = torque;
+      else if (torque < run_min)
+        run_min = torque;
+    }
+  last_index = index;
+  num_samples++;
 
   (void) confirmation;
   //cout << "step::input torque = " <<  torque << " confirmation = " << confirmation << endl;
   return NO_CMD;
 }
 
+step_block_result step::process (const step_sample *s, size_t n)
+{
+  step_block_result r = {0, NO_CMD, 0};
+  while (r.consumed < n && ! finished && r.cmd == NO_CMD)
+    {
+      const step_sample &x = s[r.consumed++];
+      r.cmd = inout (x.torque, x.confirmation, x.index);
+      r.index = x.index;
+    }
+  return r;
+}
+
+const string &step::get_instruction ()
+{
+  // the instructions only depend on int_step
+  if (int_step != cached_instruction_step)
+    {
+      cached_instruction = instruction ();
+      cached_instruction_step = int_step;
+    }
+  return cached_instruction;
+}
+
+const string &step::get_description ()
+{
+  if (cached_description.empty ())
+    cached_description = description ();
+  return cached_description;
+}
+
 bool step::is_finished ()
 {
   return this->finished;
@@ -66,38 +104,143 @@ double step::max_abs_torque ()
   if (abs (mi) > ma)
     ret = mi;
 
-  //cout << " step::max_abs_torque=" << ret << " size=" << v_torque.size() << endl;
+  //cout << " step::max_abs_torque=" << ret << " num_samples=" << num_samples << endl;
   return ret;
 }
 
 double step::max_torque ()
 {
-  if (v_torque.size ())
-    return *max_element (v_torque.begin (), v_torque.end ());
+  if (num_samples)
+    return run_max;
   else
     return 0;
 }
 
 double step::min_torque ()
 {
-  if (v_torque.size ())
-    return *min_element (v_torque.begin (), v_torque.end ());
+  if (num_samples)
+    return run_min;
   else
     return 0;
 }
 
+void step::clear_samples ()
+{
+  num_samples = 0;
+  first_index = last_index = prev_index = 0;
+  run_max = run_min = 0;
+}
+
+out_cmd step::drive_motor (double torque, unsigned long index, bool loading)
+{
+  if (! motor.is_enabled ())
+    return NO_CMD;
+  if (loading && ! motor.is_done ())
+    return motor.control (torque, index);
+  return motor.release ();
+}
+
+//************************ motor_ramp ********************************************
+
+motor_ramp::motor_ramp ()
+  : enabled (false), target (0), rise_time (0), limit (1), running (false), done (false),
+    returned (false), ramp_started (false), ramp_index (0), switched (false), switch_index (0)
+{
+}
+
+void motor_ramp::enable (double t, double rt, double limit_factor)
+{
+#ifdef TEST_DEBUG_COUT
+  cout << "motor_ramp::enable target=" << t << " rise_time=" << rt << " limit_factor=" << limit_factor << endl;
+#endif
+  enabled = true;
+  target = t;
+  rise_time = rt;
+  limit = limit_factor;
+  reset ();
+}
+
+void motor_ramp::reset ()
+{
+  running = false;
+  done = false;
+  returned = false;
+  ramp_started = false;
+  ramp_index = 0;
+  switched = false;
+  switch_index = 0;
+}
+
+out_cmd motor_ramp::set_running (bool r, unsigned long index)
+{
+  if (r == running)
+    return NO_CMD;
+
+  // don't chatter, every command takes some ms on USB
+  if (switched && index - switch_index < MOTOR_MIN_PULSE * TTT_SPS)
+    return NO_CMD;
+
+  running = r;
+  switched = true;
+  switch_index = index;
+  return running ? CMD_MOTOR_START : CMD_MOTOR_STOP;
+}
+
+out_cmd motor_ramp::control (double torque, unsigned long index)
+{
+  if (! enabled || done)
+    return NO_CMD;
+
+  // relative load, target is negative for counterclockwise
+  double x = torque / target;
+  if (x >= limit)
+    {
+      done = true;
+      if (! running)
+        return NO_CMD;
+      running = false;
+      return CMD_MOTOR_STOP;
+    }
+
+  bool run = true;
+  if (rise_time > 0 && x >= 0.8)
+    {
+      if (! ramp_started)
+        {
+          ramp_started = true;
+          ramp_index = index;
+        }
+      double ref = 0.8 + 0.2 * double (index - ramp_index) / (rise_time * TTT_SPS);
+      if (x > ref + MOTOR_RAMP_BAND)
+        run = false;
+      else if (x > ref)
+        run = running;
+    }
+  return set_running (run, index);
+}
+
+out_cmd motor_ramp::release ()
+{
+  if (! enabled || returned)
+    return NO_CMD;
+  running = false;
+  done = true;
+  returned = true;
+  return CMD_MOTOR_RETURN;
+}
+
 //************************ preload_step ********************************************
 
 preload_step::preload_step (double nominal, double stop_threshold_factor)
-  : step ()
+  : step (STEP_PRELOAD)
 {
   this->nominal    = nominal;
   this->stop_thres = nominal * stop_threshold_factor;
 }
 
-enum out_cmd preload_step::inout (double torque, bool confirmation)
+enum out_cmd preload_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  step::inout (torque, confirmation);
+  step::inout (torque, confirmation, index);
 
   if ((int_step == 0) &&
       (  (nominal > 0 && torque >= nominal)
@@ -112,7 +255,18 @@ enum out_cmd preload_step::inout (double torque, bool confirmation)
       int_step++;
       finished = true;
     }
-  return NO_CMD;
+  return drive_motor (torque, index, int_step <= 1);
+}
+
+step_block_result preload_step::process (const step_sample *s, size_t n)
+{
+  return process_as<preload_step> (s, n);
+}
+
+void preload_step::set_motor_driven ()
+{
+  // no timing requirement, full speed until nominal
+  motor.enable (nominal, 0);
 }
 
 //************************ preload_torque_tester_step ********************************************
@@ -164,9 +318,9 @@ preload_test_object_step::preload_test_object_step (double nominal, double stop_
 }
 
 // bei 80% Weiterschalten
-enum out_cmd preload_test_object_step::inout (double torque, bool confirmation)
+enum out_cmd preload_test_object_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  step::inout (torque, confirmation);
+  step::inout (torque, confirmation, index);
 
   if ((int_step == 0) &&
       (  (nominal > 0 && torque >= 0.8 * nominal)
@@ -181,7 +335,13 @@ enum out_cmd preload_test_object_step::inout (double torque, bool confirmation)
       int_step++;
       finished = true;
     }
-  return NO_CMD;
+  // the motor preloads until nominal, not only 80%
+  return drive_motor (torque, index, int_step <= 1);
+}
+
+step_block_result preload_test_object_step::process (const step_sample *s, size_t n)
+{
+  return process_as<preload_test_object_step> (s, n);
 }
 
 string preload_test_object_step::instruction ()
@@ -210,23 +370,36 @@ string preload_test_object_step::description ()
 
 //************************ tare_torque_tester_step ********************************************
 
-tare_torque_tester_step::tare_torque_tester_step ()
-  : step()
+tare_torque_tester_step::tare_torque_tester_step (double zb)
+  : step (STEP_TARE), zero_band (zb), zero_since (0)
 {
 #ifdef TEST_DEBUG_COUT
   cout << "c'tor tare_torque_tester_step" << endl;
 #endif
 }
 
-enum out_cmd tare_torque_tester_step::inout (double torque, bool confirmation)
+enum out_cmd tare_torque_tester_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  step::inout (torque, confirmation);
+  step::inout (torque, confirmation, index);
   enum out_cmd ret = NO_CMD;
 
+  // the zero is still valid, no tare needed
+  if (int_step == 0 && zero_band > 0)
+    {
+      if (num_samples == 1 || fabs (torque) > zero_band)
+        zero_since = index;
+      else if (double (index - zero_since) / TTT_SPS >= TTT_TARE_SKIP_TIME)
+        {
+          int_step = 3;
+          finished = true;
+          return ret;
+        }
+    }
+
   // wait 5s until starting tare on the device so that the user can
   // completely release the device
-//cout << "tare_torque_tester_step::inout v_time.back ()=" << v_time.back () << endl;
-  if (int_step == 0 && v_time.back () > 5)
+//cout << "tare_torque_tester_step::inout elapsed ()=" << elapsed () << endl;
+  if (int_step == 0 && elapsed () > 5)
     {
       int_step = 1;
     }
@@ -244,6 +417,11 @@ enum out_cmd tare_torque_tester_step::inout (double torque, bool confirmation)
   return ret;
 }
 
+step_block_result tare_torque_tester_step::process (const step_sample *s, size_t n)
+{
+  return process_as<tare_torque_tester_step> (s, n);
+}
+
 string tare_torque_tester_step::instruction ()
 {
   ostringstream oss;
@@ -271,18 +449,18 @@ string tare_torque_tester_step::description ()
 //************************ tare_test_object_step ********************************************
 
 tare_test_object_step::tare_test_object_step ()
-  : step()
+  : step (STEP_TARE)
 {
 #ifdef TEST_DEBUG_COUT
   cout << "c'tor tare_test_object_step" << endl;
 #endif
 }
 
-enum out_cmd tare_test_object_step::inout (double torque, bool confirmation)
+enum out_cmd tare_test_object_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  step::inout (torque, confirmation);
+  step::inout (torque, confirmation, index);
 
-  if (int_step == 0 && v_time.back () > 5)
+  if (int_step == 0 && elapsed () > 5)
     {
       int_step++;
     }
@@ -299,6 +477,11 @@ enum out_cmd tare_test_object_step::inout (double torque, bool confirmation)
   return NO_CMD;
 }
 
+step_block_result tare_test_object_step::process (const step_sample *s, size_t n)
+{
+  return process_as<tare_test_object_step> (s, n);
+}
+
 string tare_test_object_step::instruction ()
 {
   ostringstream oss;
@@ -325,22 +508,22 @@ string tare_test_object_step::description ()
 
 //************************ meas_step ********************************************
 
-meas_step::meas_step (double nominal, double start_peak_torque_factor)
-  : step ()
+meas_step::meas_step (step_kind k, double nominal, double start_peak_torque_factor)
+  : step (k)
 {
   this->nominal = nominal;
   this->start_peak_torque = nominal * start_peak_torque_factor;
 }
 
-out_cmd meas_step::inout (double torque, bool confirmation)
+out_cmd meas_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  return step::inout (torque, confirmation);
+  return step::inout (torque, confirmation, index);
 }
 
 //************************ peak_meas_step ********************************************
 
 peak_meas_step::peak_meas_step (double nominal, double start_peak_torque_factor, double stop_peak_torque_factor)
-  : meas_step (nominal, start_peak_torque_factor)
+  : meas_step (STEP_PEAK_MEAS, nominal, start_peak_torque_factor)
 {
   this->stop_peak_torque = nominal * stop_peak_torque_factor;
 
@@ -352,9 +535,9 @@ peak_meas_step::peak_meas_step (double nominal, double start_peak_torque_factor,
 #endif
 }
 
-enum out_cmd peak_meas_step::inout (double torque, bool confirmation)
+enum out_cmd peak_meas_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  meas_step::inout (torque, confirmation);
+  meas_step::inout (torque, confirmation, index);
   /*
   cout << "peak_meas_step::inout"
        << " torque=" << torque
@@ -372,15 +555,25 @@ enum out_cmd peak_meas_step::inout (double torque, bool confirmation)
              || (stop_peak_torque < 0 && torque > stop_peak_torque) ))
     {
       int_step++;
-      delay_start = v_time.back ();
+      delay_start = elapsed ();
     }
   else if ((int_step == 2) &&
-           (v_time.back () - delay_start) > 0.5)
+           (elapsed () - delay_start) > 0.5)
     {
       int_step++;
       finished = true;
     }
-  return NO_CMD;
+  return drive_motor (torque, index, int_step <= 1);
+}
+
+step_block_result peak_meas_step::process (const step_sample *s, size_t n)
+{
+  return process_as<peak_meas_step> (s, n);
+}
+
+void peak_meas_step::set_motor_driven ()
+{
+  motor.enable (nominal, MOTOR_DEFAULT_RISE_TIME);
 }
 
 string peak_meas_step::instruction ()
@@ -418,7 +611,8 @@ peak_click_step::peak_click_step (double nominal,
                                   bool repeat_on_timing_violation,
                                   double start_peak_torque_factor,
                                   double _peak_trigger2_factor)
-  : meas_step (nominal, start_peak_torque_factor),
+  : meas_step (STEP_PEAK_CLICK, nominal, start_peak_torque_factor),
+    rise_dropped (false),
     first_peak (0),
     peak_trigger2_factor (_peak_trigger2_factor),
     peak_trigger2_threshold (0),
@@ -430,6 +624,8 @@ peak_click_step::peak_click_step (double nominal,
     first_peak_time (0),
     rise_time (0)
 {
+  rise_records.allocate ((max_time > 0)? size_t (max_time * TTT_SPS) + 2 : STEP_RISE_RECORDS);
+
 #ifdef TEST_DEBUG_COUT
   cout << "c'tor peak_click_step";
   cout << " nominal=" << nominal;
@@ -441,9 +637,15 @@ peak_click_step::peak_click_step (double nominal,
 #endif
 }
 
-out_cmd peak_click_step::inout (double torque, bool confirmation)
+out_cmd peak_click_step::inout (double torque, bool confirmation, unsigned long index)
 {
-  meas_step::inout (torque, confirmation);
+  meas_step::inout (torque, confirmation, index);
+
+  double sign = (nominal > 0)? 1 : -1;
+
+  // the rise-time search needs the history until peak_trigger2_threshold is reached
+  if (int_step <= 1)
+    add_rise_record (sign * torque, index);
 
   /*
     cout << "torque=" << torque;
@@ -452,7 +654,6 @@ out_cmd peak_click_step::inout (double torque, bool confirmation)
     cout << " peak_trigger2_threshold=" << peak_trigger2_threshold;
     cout << endl;
   */
-  double sign = (nominal > 0)? 1 : -1;
 
   if ((int_step == 0) &&
       ( (start_peak_torque > 0 && torque >= start_peak_torque)
@@ -490,17 +691,10 @@ out_cmd peak_click_step::inout (double torque, bool confirmation)
         {
           // Anstiegszeit überprüfen
           // von 80% * first_peak bis first_peak
-          unsigned int k = 0;
-          while (k < v_torque.size () && (sign * v_torque[k]) < (sign * 0.8 * first_peak))
-            k++;
-
-          torque_80_time = v_time[k];
+          torque_80_time = double (find_rise_record (sign * 0.8 * first_peak) - first_index) / TTT_SPS;
 
           // first_peak_index suchen
-          while (k < v_torque.size () && (sign * v_torque[k]) < (sign * first_peak))
-            k++;
-
-          first_peak_time = v_time[k];
+          first_peak_time = double (find_rise_record (sign * first_peak) - first_index) / TTT_SPS;
 
           rise_time = first_peak_time - torque_80_time;
           //cout << "peak_click_step::inout rise_time=" << rise_time << endl;
@@ -519,7 +713,7 @@ out_cmd peak_click_step::inout (double torque, bool confirmation)
           if (   (nominal > 0 && torque < peak_trigger2_threshold)
                  || (nominal < 0 && torque > peak_trigger2_threshold))
             {
-              wait_t += v_time[v_time.size()-1] - v_time[v_time.size()-2];
+              wait_t += last_dt ();
             }
 
           if (wait_t > 2.0)
@@ -538,7 +732,7 @@ out_cmd peak_click_step::inout (double torque, bool confirmation)
           double stop_thres = 0.1 * first_peak;
           //cout << __LINE__ << " stop_thres = " << stop_thres << " nominal=" << nominal << " torque=" << torque << endl;
           if (   (nominal > 0 && torque < stop_thres) || (nominal < 0 && torque > stop_thres))
-            wait_t += v_time[v_time.size()-1] - v_time[v_time.size()-2];
+            wait_t += last_dt ();
           else
             wait_t = 0;
 
@@ -553,23 +747,84 @@ out_cmd peak_click_step::inout (double torque, bool confirmation)
     }
   else if (int_step == 4 || int_step == 5) // rise-time violation
     {
-      wait_t += v_time[v_time.size()-1] - v_time[v_time.size()-2];
+      wait_t += last_dt ();
 
       if (wait_t > 3.0)
-        {
-          wait_t = 0;
-          first_peak = 0;
-          peak_trigger2_threshold = 0;
-          torque_80_time = 0;
-          first_peak_time = 0;
-          rise_time = 0;
-          int_step = 0;
-          v_torque.clear ();
-          v_time.clear ();
-        }
+        reset ();
     }
 
-  return NO_CMD;
+  // int_step 2: triggered
+  return drive_motor (torque, index, int_step <= 1);
+}
+
+step_block_result peak_click_step::process (const step_sample *s, size_t n)
+{
+  return process_as<peak_click_step> (s, n);
+}
+
+void peak_click_step::set_motor_driven ()
+{
+  // geometric mean of the limits: the same relative margin to both
+  double t = MOTOR_DEFAULT_RISE_TIME;
+  if (min_time > 0 && max_time > min_time)
+    t = sqrt (min_time * max_time);
+  else if (min_time > t)
+    t = min_time;
+  motor.enable (nominal, t, MOTOR_OVERLOAD_FACTOR);
+}
+
+void peak_click_step::reset ()
+{
+  meas_step::reset ();
+  wait_t = 0;
+  first_peak = 0;
+  peak_trigger2_threshold = 0;
+  torque_80_time = 0;
+  first_peak_time = 0;
+  rise_time = 0;
+  rise_records.clear ();
+  rise_dropped = false;
+}
+
+void peak_click_step::add_rise_record (double value, unsigned long index)
+{
+  // only a new maximum can be the first sample above a threshold
+  if (! rise_records.empty () && value <= rise_records.back ().value)
+    return;
+
+  // the final peak is >= value, so older maxima below 80% of value
+  // can't be the 80% crossing
+  while (! rise_records.empty () && rise_records.front ().value < 0.8 * value)
+    rise_records.pop_front ();
+
+  // the full ring spans more than max_time (see STEP_RISE_RECORDS),
+  // a crossing at or before the dropped record is too slow anyway
+  if (rise_records.full ())
+    {
+      rise_dropped = true;
+      last_dropped = rise_records.front ();
+    }
+
+  rise_record r;
+  r.index = index;
+  r.value = value;
+  rise_records.push_back (r);
+}
+
+// sample index of the first sample >= value,
+// an upper bound if the crossing was dropped
+unsigned long peak_click_step::find_rise_record (double value)
+{
+  if (rise_dropped && value <= last_dropped.value)
+    return last_dropped.index;
+
+  if (rise_records.empty ())
+    return last_index;
+
+  unsigned int k = 0;
+  while (k < rise_records.size () - 1 && rise_records[k].value < value)
+    k++;
+  return rise_records[k].index;
 }
 
 string peak_click_step::instruction ()
@@ -35,6 +35,8 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <cmath>
 #include <sys/time.h>
 #include <libintl.h>
+#include "config.h"
+#include "fixed_ring.h"
 
 using namespace std;
 
@@ -42,36 +44,204 @@ enum out_cmd
 {
   NO_CMD = 0,
   CMD_TARA = 1,
-  RESET_CONFIRMATION = 2
+  RESET_CONFIRMATION = 2,
+  // motor driven test rig, see motor_ramp
+  CMD_MOTOR_START = 3,
+  CMD_MOTOR_STOP = 4,     // stop and hold the load
+  CMD_MOTOR_RETURN = 5    // back to the start position, releases the load
+};
+
+// rise time from 80% to 100% for steps without timing requirement (peak_meas_step)
+#define MOTOR_DEFAULT_RISE_TIME 1.0
+// a click tool which hasn't triggered at this factor * nominal isn't loaded further
+#define MOTOR_OVERLOAD_FACTOR 1.25
+// the motor is stopped if the torque is this much (relative to target) above the ramp
+#define MOTOR_RAMP_BAND 0.02
+// minimum time between two motor commands in s
+#define MOTOR_MIN_PULSE 0.02
+
+/*!
+ * \brief Closed-loop load ramp for motor driven test rigs
+ *
+ * The rig only knows start and stop, so the rate of the torque is controlled by
+ * pulsing the motor on the live torque: up to 80% of target it runs continuously,
+ * above it follows a ramp which reaches target after rise_time (0 = no ramp).
+ * The motor is stopped when limit * target is reached and returned with release ().
+ */
+class motor_ramp
+{
+private:
+  bool enabled;
+  double target;
+  double rise_time;
+  double limit;
+  bool running;
+  bool done;              // limit reached or released, no more control
+  bool returned;
+  bool ramp_started;
+  unsigned long ramp_index;     // sample index of the 80% crossing
+  bool switched;
+  unsigned long switch_index;   // sample index of the last command
+
+  out_cmd set_running (bool r, unsigned long index);
+
+public:
+  motor_ramp ();
+  void enable (double target, double rise_time, double limit_factor = 1.0);
+  bool is_enabled ()
+  {
+    return enabled;
+  }
+  bool is_done ()
+  {
+    return done;
+  }
+
+  // CMD_MOTOR_START or CMD_MOTOR_STOP if the motor has to be switched, else NO_CMD
+  out_cmd control (double torque, unsigned long index);
+  // CMD_MOTOR_RETURN once after loading
+  out_cmd release ();
+  void reset ();
+};
+
+// kind of a step, fixed in the c'tor (no dynamic_cast in the sequencer)
+enum step_kind
+{
+  STEP_PRELOAD,
+  STEP_TARE,
+  STEP_PEAK_MEAS,     // peak_meas_step
+  STEP_PEAK_CLICK     // peak_click_step
+};
+
+// input of step::process
+struct step_sample
+{
+  double torque;
+  unsigned long index;   // sample number (time = index / TTT_SPS)
+  bool confirmation;
+};
+
+// result of step::process
+struct step_block_result
+{
+  size_t consumed;       // number of used samples
+  out_cmd cmd;           // command of the last used sample
+  unsigned long index;   // sample index of the last used sample
 };
 
 class step
 {
+private:
+  step_kind kind;
+
 protected:
   int int_step;
-  vector <double> v_torque;
-  vector <double> v_time;
+
+  // the samples aren't stored, only what the steps need for their decisions
+  unsigned long num_samples;
+  unsigned long first_index;  // sample index of the first sample of this step
+  unsigned long last_index;   // sample index of the current sample
+  unsigned long prev_index;   // sample index of the previous sample
 
   bool finished;
 
-  struct timeval t1;
+  // cache of get_instruction and get_description
+  string cached_instruction;
+  int cached_instruction_step;   // int_step of cached_instruction, -1 = invalid
+  string cached_description;
+
+  // only used on motor driven test rigs, see set_motor_driven
+  motor_ramp motor;
+  // load with the motor while loading is true, return it afterwards
+  out_cmd drive_motor (double torque, unsigned long index, bool loading);
+
+  // running extrema of all samples, updated in step::inout
+  double run_max;
+  double run_min;
+
+  // forget all samples and the extrema
+  void clear_samples ();
+
+  // process () for a step of type T: T::inout is called directly (no virtual dispatch)
+  template <class T>
+  step_block_result process_as (const step_sample *s, size_t n)
+  {
+    T *self = static_cast<T*> (this);
+    step_block_result r = {0, NO_CMD, 0};
+    while (r.consumed < n && ! finished && r.cmd == NO_CMD)
+      {
+        const step_sample &x = s[r.consumed++];
+        r.cmd = self->T::inout (x.torque, x.confirmation, x.index);
+        r.index = x.index;
+      }
+    return r;
+  }
+
+  // time of the current sample since the first sample of this step in s
+  double elapsed ()
+  {
+    return double (last_index - first_index) / TTT_SPS;
+  }
+
+  // time between the previous and the current sample in s
+  double last_dt ()
+  {
+    return double (last_index - prev_index) / TTT_SPS;
+  }
 
   double max_abs_torque ();
   double max_torque ();
   double min_torque ();
 
 public:
-  step();
+  step (step_kind k);
   virtual ~step();
 
+  step_kind get_kind ()
+  {
+    return kind;
+  }
+  // peak_meas_step or peak_click_step, both are meas_steps
+  bool is_meas_step ()
+  {
+    return kind == STEP_PEAK_MEAS || kind == STEP_PEAK_CLICK;
+  }
+
   // Input vector for state machine
+  // index is the sample number (time = index / TTT_SPS)
   // return value are command which have to be executed
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+
+  // Feed a block of samples: stops after the sample which finishes the step
+  // or returns a command (the caller executes it and calls process with the rest).
+  // Steps which override inout should override process with process_as<T>.
+  virtual step_block_result process (const step_sample *s, size_t n);
 
   bool is_finished ();
 
+  // restart the step (repeat a measurement or after a TTT reconnect)
+  virtual void reset ()
+  {
+    int_step = 0;
+    finished = 0;
+    clear_samples ();
+    motor.reset ();
+  }
+
+  // command the motor of the test rig (CMD_MOTOR_*) instead of waiting for the user.
+  // Only steps which load the test object support this.
+  virtual void set_motor_driven () {}
+  bool is_motor_driven ()
+  {
+    return motor.is_enabled ();
+  }
+
   virtual string instruction () = 0;
   virtual string description () = 0;
+
+  // instruction () and description (), translated only once per int_step
+  const string &get_instruction ();
+  const string &get_description ();
 };
 
 class preload_step: public step
@@ -82,7 +252,9 @@ protected:
 
 public:
   preload_step (double nominal, double stop_threshold_factor);
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+  virtual step_block_result process (const step_sample *s, size_t n);
+  virtual void set_motor_driven ();
 
   double get_nominal_value ()
   {
@@ -108,21 +280,30 @@ private:
 
 public:
   preload_test_object_step (double nominal, double stop_threshold_factor);
-  enum out_cmd inout (double torque, bool confirmation);
+  enum out_cmd inout (double torque, bool confirmation, unsigned long index);
+  step_block_result process (const step_sample *s, size_t n);
   string instruction ();
   string description ();
 };
 
+// tare_torque_tester_step with zero_band: skip the tare if the torque stays within the band for this time in s
+#define TTT_TARE_SKIP_TIME 1.0
+
 /*!
  * \brief Tare torque measuring device (TTT)
+ * With zero_band > 0 the tare is skipped if the TTT still shows zero
+ * (+-zero_band in Nm for TTT_TARE_SKIP_TIME), else it's done after 5s as usual.
 */
 class tare_torque_tester_step: public step
 {
 private:
+  double zero_band;
+  unsigned long zero_since;   // sample index since the torque is within zero_band
 
 public:
-  tare_torque_tester_step ();
-  virtual out_cmd inout (double torque, bool confirmation);
+  tare_torque_tester_step (double zero_band = 0);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+  virtual step_block_result process (const step_sample *s, size_t n);
   string instruction ();
   string description ();
 };
@@ -136,7 +317,8 @@ private:
 
 public:
   tare_test_object_step ();
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+  virtual step_block_result process (const step_sample *s, size_t n);
   string instruction ();
   string description ();
 };
@@ -148,21 +330,14 @@ protected:
   double start_peak_torque;  // threshold which has to be exceeded to start the peak detection
   // typically 60% from nominal value
 public:
-  meas_step (double nominal, double start_peak_torque_factor);
+  meas_step (step_kind k, double nominal, double start_peak_torque_factor);
   double get_nominal_value ()
   {
     return nominal;
   }
 
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
   virtual double get_peak_torque () = 0;
-  virtual void reset ()
-  {
-    int_step = 0;
-    finished = 0;
-    v_torque.clear ();
-    v_time.clear ();
-  }
 };
 
 class peak_meas_step: public meas_step
@@ -174,15 +349,36 @@ private:
 public:
   peak_meas_step (double nominal, double start_peak_torque_factor,
                   double stop_peak_torque_factor);
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+  virtual step_block_result process (const step_sample *s, size_t n);
+  virtual void set_motor_driven ();
   string instruction ();
   string description ();
   double get_peak_torque ();
 };
 
+// entries for the rise-time search in peak_click_step if max_time isn't set.
+// Otherwise max_time * TTT_SPS + 2 entries are allocated in the c'tor: the
+// records are distinct samples, so a full ring spans more than max_time and
+// the oldest record may be dropped, the rise is too slow anyway.
+#define STEP_RISE_RECORDS 2048
+
 class peak_click_step: public meas_step
 {
 private:
+  // Every sample which reaches 80% of the final peak for the first time is a new
+  // running maximum. Only these maxima above 80% of the current maximum are kept.
+  struct rise_record
+  {
+    unsigned long index;
+    double value;         // torque * sign of nominal
+  };
+  fixed_ring<rise_record> rise_records;
+  bool rise_dropped;           // a record was dropped from the full ring
+  rise_record last_dropped;
+  void add_rise_record (double value, unsigned long index);
+  unsigned long find_rise_record (double value);
+
   double first_peak;
   double peak_trigger2_factor;
   double peak_trigger2_threshold;  // torque has to fall bellow this threshold to start detection of the second peak
@@ -198,11 +394,14 @@ private:
 public:
   peak_click_step (double nominal, double min_t, double max_t, bool repeat_on_timing_violation,
                    double start_peak_torque_factor, double _peak_trigger2_factor);
-  virtual out_cmd inout (double torque, bool confirmation);
+  virtual out_cmd inout (double torque, bool confirmation, unsigned long index);
+  virtual step_block_result process (const step_sample *s, size_t n);
+  virtual void set_motor_driven ();
   string instruction ();
   string description ();
   double get_peak_torque ();
   double get_rise_time ();
+  virtual void reset ();
 };
 
 #endif
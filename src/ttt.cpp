@@ -23,6 +23,7 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "ttt.h"
+#include <FL/Fl.H>
 
 #ifdef _WIN32
 #include <Shellapi.h>  //for ShellExecute
@@ -45,7 +46,13 @@ ttt::ttt (cb_display_double *cb_ind,
           double stop_peak,
           measurement_table *mt)
   :pttt(0),
+   owns_pttt(true),
    db(0),
+   measurement_input(0),
+   sample_index(0),
+   replay_mode(REPLAY_REALTIME),
+   replay_first_run(true),
+   headless(false),
    start_peak_torque_factor (start_peak),
    stop_peak_torque_factor (stop_peak),
    m_table(mt),
@@ -55,16 +62,24 @@ ttt::ttt (cb_display_double *cb_ind,
    cb_instruction(cb_i),
    cb_step(cb_s),
    cb_result(cb_r),
+   shown_nominal_torque(0),
+   shown_peak_torque(0),
+   shown_progress(0),
+   display_valid(false),
+   display_interval(1.0 / TTT_DISPLAY_RATE),
+   pending_indicated_torque(0),
+   indicated_torque_pending(false),
    confirmation(0),
    current_step(-1),
    sequencer_is_running(0),
+   sequencer_paused(false),
+   motor_driven(false),
+   batch_index(0),
+   database_fn(database_fn),
+   reports(0),
    report_style (QUICK_CHECK_REPORT)
 {
-  print_indicated_torque(0.0);
-  print_nominal_torque(0.0);
-  print_peak_torque(0.0);
-  print_instruction("");
-  print_step ("idle", 0);
+  reset_display ();
   print_result ("");
 
   int rc = sqlite3_open(database_fn.c_str (), &db);
@@ -75,6 +90,11 @@ ttt::ttt (cb_display_double *cb_ind,
       throw runtime_error ("Can't open sqlite database");
     }
   sqlite3_exec(db, "PRAGMA foreign_keys = ON;", 0, 0, 0);
+  // the measurement_items are saved one by one while the sequencer runs:
+  // with WAL a commit only appends to the log, synchronous FULL keeps it on a power cut
+  sqlite3_exec(db, "PRAGMA journal_mode = WAL;", 0, 0, 0);
+  sqlite3_exec(db, "PRAGMA synchronous = FULL;", 0, 0, 0);
+  migrate_database (db);
 }
 
 ttt::~ttt ()
@@ -84,6 +104,9 @@ ttt::~ttt ()
   if (sequencer_is_running)
     stop_sequencer ();
 
+  // finishes the queued reports
+  delete reports;
+
   clear_steps ();
 
   disconnect_measurement_input ();
@@ -101,7 +124,7 @@ ostream& operator<< (ostream& os, const ttt& d)
 void ttt::connect_TTT ()
 {
   if (! pttt)
-    pttt = new ttt_device ();
+    pttt = new ttt_device (&ttt::lookup_torque_tester, this);
   else
     throw runtime_error ("TTT already connected");
   load_torque_tester ();
@@ -110,47 +133,71 @@ void ttt::connect_TTT ()
 void ttt::connect_TTT (string serial)
 {
   if (! pttt)
-    pttt = new ttt_device (serial);
+    pttt = new ttt_device (serial, &ttt::lookup_torque_tester, this);
   else
     throw runtime_error ("TTT already connected");
 }
 
+void ttt::connect_TTT (ttt_device *dev)
+{
+  if (! pttt)
+    {
+      pttt = dev;
+      owns_pttt = false;
+    }
+  else
+    throw runtime_error ("TTT already connected");
+  load_torque_tester ();
+}
+
 void ttt::disconnect_TTT ()
 {
-  if (pttt)
+  if (pttt && owns_pttt)
     delete pttt;
+  pttt = 0;
+  owns_pttt = true;
 }
 
-void ttt::connect_measurement_input (string fn)
+void ttt::connect_measurement_input (string fn, enum replay_clock mode)
 {
-  if (measurement_input.is_open ())
+  if (measurement_input)
     cerr << "ERROR: measurement_input already connected" << endl;
   else
     {
-      measurement_input.open (fn.c_str ());
+      try
+        {
+          measurement_input = new raw_log_reader (fn);
+        }
+      catch (exception& e)
+        {
+          cerr << "ERROR: " << e.what () << endl;
+        }
+      sample_index = 0;
+      replay_mode = mode;
+      replay_first_run = true;
     }
   load_torque_tester ();
 }
 
 void ttt::disconnect_measurement_input ()
 {
-  if (measurement_input.is_open ())
-    measurement_input.close ();
+  delete measurement_input;
+  measurement_input = 0;
 }
 
 string ttt::get_time_for_filename ()
 {
   time_t rawtime;
-  struct tm *timeinfo;
+  struct tm timeinfo;
   char buffer[80];
 
   time (&rawtime);
-  timeinfo = localtime (&rawtime);
+  localtime_ts (&rawtime, &timeinfo);
 
   // FIXME: check if : is allowed in filenames on OSX and windoze
   // http://stackoverflow.com/questions/3038351/check-whether-a-string-is-a-valid-filename-with-qt
   // http://www.boost.org/doc/libs/1_43_0/libs/filesystem/doc/portability_guide.htm
-  strftime (buffer, 80, "%Y-%m-%d_%H_%M_%S", timeinfo);
+  strftime (buffer, 80, "%Y-%m-%d_%H_%M_%S", &timeinfo);
   return buffer;
 }
 
@@ -167,240 +214,381 @@ bool ttt::run ()
   if (current_step >= steps.size () && sequencer_is_running)
     {
       // we have reached the end
-      // stop_sequencer
-      stop_sequencer ();
-
-      // save measurement
+      // the measurement_items are already saved
       meas.end_time = get_localtime();
-      meas.save (db);
+      meas.finish (db);
 
-      // create report for DIN EN ISO 6789 TypI and Typ II
-      if (report_style == ISO6789_REPORT || report_style == ISO6789_LIKE_REPORT_WITH_REPEATS)
+      // batch mode: the report is created in the background while the next test object is measured
+      if (batch_index + 1 < batch_test_objects.size ())
         {
-          ostringstream os;
-
-          // FIXME: model kann z.B. 730N/2 sein
-          //
-          // http://stackoverflow.com/questions/3038351/check-whether-a-string-is-a-valid-filename-with-qt
-          // http://www.boost.org/doc/libs/1_43_0/libs/filesystem/doc/portability_guide.htm
-
-          os << get_time_for_filename ();
-          os << "_" << meas.to.serial_number;
-          os << "_" << meas.to.manufacturer;
-          os << "_" << meas.to.model;
-
-          report_filename = os.str ();
-          std::replace_if(report_filename.begin(), report_filename.end(), isnalnum, '_');
+          create_report (true);
+          next_batch_test_object ();
+        }
+      else
+        {
+          // stop_sequencer, TTT_EVENT_SEQUENCER_STOPPED after the report
+          bool batch = ! batch_test_objects.empty ();
+          halt_sequencer ();
 
-          if (report_style == ISO6789_REPORT)
-            report_filename += "_ISO6789.pdf";
-          else
-            report_filename += "_like_ISO6789.pdf";
+          // create report for DIN EN ISO 6789 TypI and Typ II
+          if (report_style == ISO6789_REPORT || report_style == ISO6789_LIKE_REPORT_WITH_REPEATS)
+            {
+              create_report (batch);
+              collect_reports (true);
+            }
+          else if (report_style == QUICK_CHECK_REPORT) //single peak
+            {
+              // Meeting from 14.01.2016: No Report for Quick Check
+              //report_filename = get_time_for_filename () + "_quick_check.pdf";
+              //bool res = create_quick_test_report (db, meas.id, report_filename.c_str ());
 
-          report_result res = create_ISO6789_report (db, meas.id, report_filename.c_str (), report_style == ISO6789_LIKE_REPORT_WITH_REPEATS);
+              bool res = meas.quick_check_okay ();
 
-          if (res.values_below_max_deviation && !res.timing_violation)
-            print_result (gettext ("Kalibrierung innerhalb Toleranz"));
-          else if (res.values_below_max_deviation && res.timing_violation)
-            print_result (gettext ("#Kalibrierung innerhalb Toleranz jedoch Mindestzeit nicht eingehalten"));
-          else
-            print_result (gettext ("*Kalibrierung außerhalb Toleranz"));
+              if (res)
+                print_result (gettext ("Schnellkalibrierung innerhalb Toleranz"));
+              else
+                print_result (gettext ("*Schnellkalibrierung außerhalb Toleranz"));
+            }
+          //else
+          // print_step ("finished", 1);
 
-          // open created pdf
+          publish (TTT_EVENT_SEQUENCER_STOPPED, 0, "");
+        }
+    }
 
-#ifdef _WIN32
-          ShellExecute (0, 0, report_filename.c_str (), 0, 0, SW_SHOW );
-#elif __APPLE__
-          char call[256];
-          snprintf (call, 256, "open %s", report_filename.c_str ());
-          system (call);
-#else
-          char call[256];
-          snprintf (call, 256, "xdg-open %s", report_filename.c_str ());
-          system (call);
-#endif
-          //print_step ( string (gettext ("Kalibrierschein:")) + " " + report_filename, 1);
+  if (sequencer_is_running && pttt)
+    {
+      // USB disconnect: keep the accepted measurement_items and wait for the same TTT
+      if (! pttt->check_connection ())
+        {
+          if (! sequencer_paused)
+            {
+              cerr << "ttt::run: TTT disconnected, sequencer paused in step " << current_step << endl;
+              sequencer_paused = true;
+              print_instruction (gettext ("Verbindung zum TTT unterbrochen.\nBitte USB-Leitung prüfen, die Messung wird danach fortgesetzt."));
+            }
+          return sequencer_is_running;
         }
-      else if (report_style == QUICK_CHECK_REPORT) //single peak
+      else if (sequencer_paused)
         {
-          // Meeting from 14.01.2016: No Report for Quick Check
-          //report_filename = get_time_for_filename () + "_quick_check.pdf";
-          //bool res = create_quick_test_report (db, meas.id, report_filename.c_str ());
-
-          bool res = meas.quick_check_okay ();
-
-          if (res)
-            print_result (gettext ("Schnellkalibrierung innerhalb Toleranz"));
-          else
-            print_result (gettext ("*Schnellkalibrierung außerhalb Toleranz"));
+          cout << "ttt::run: TTT reconnected, restart step " << current_step << endl;
+          sequencer_paused = false;
+          if (current_step < steps.size ())
+            steps[current_step]->reset ();
         }
-      //else
-      // print_step ("finished", 1);
-
     }
 
   if (sequencer_is_running)
     {
-      enum out_cmd cmd = NO_CMD;
+      // results of the reports of the previous test objects in batch mode
+      collect_reports (false);
+
       // read torque measurements
+      step_input.clear ();
       if (pttt)
         {
           //read from hardware
-          vector<double> tmp = pttt->poll_measurement ();
+          vector<ttt_sample> tmp = pttt->poll_samples ();
           unsigned int len = tmp.size ();
           if (len > 0)
             {
-              // append to torque measurements
+              double scale = pttt->get_scale ();
+              step_sample x;
+              x.confirmation = confirmation;
               for (unsigned int k=0; k < len; ++k)
                 {
-                  measurement_output << tmp[k]  << "\t" << confirmation << endl;
-                  cmd = sequencer_inout (tmp[k], confirmation);
+                  x.torque = tmp[k].raw * scale;
+                  x.index = tmp[k].index;
+                  step_input.push_back (x);
+                  if (measurement_output.is_open ())
+                    measurement_output.append (tmp[k].index, tmp[k].raw, confirmation);
                 }
-              print_indicated_torque(tmp[len - 1]);
+              sample_index = tmp[len - 1].index + 1;
+              print_indicated_torque(x.torque);
             }
         }
-      else if (measurement_input.is_open ())
+      else if (measurement_input)
         {
           // read from measurement_input
           // simulate a connected hardware with TTT_SPS sampling rate
-          static bool first_run = true;
-          static struct timeval t1;
-
-          if (first_run)
+          if (replay_first_run)
             {
-              first_run = false;
-              gettimeofday (&t1, NULL);
+              replay_first_run = false;
+              gettimeofday (&replay_t1, NULL);
             }
           else
             {
-              struct timeval t2;
-              gettimeofday (&t2, NULL);
-              double diff = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1.0e6;
-              t1 = t2;
+              int num_samples = TTT_REPLAY_SAMPLES_PER_RUN;
+              if (replay_mode == REPLAY_REALTIME)
+                {
+                  struct timeval t2;
+                  gettimeofday (&t2, NULL);
+                  double diff = (t2.tv_sec - replay_t1.tv_sec) + (t2.tv_usec - replay_t1.tv_usec)/1.0e6;
+                  replay_t1 = t2;
 
-              int num_samples = diff * TTT_SPS;
-              //cout << "diff = " << diff << " num_samples = " << num_samples << endl;
+                  num_samples = diff * TTT_SPS;
+                  //cout << "diff = " << diff << " num_samples = " << num_samples << endl;
+                }
 
-              double torque;
-              bool tmp_confirmation;
+              step_sample x;
+              x.torque = 0;
               for (int k=0; k<num_samples; ++k)
                 {
-                  measurement_input >> torque;
-                  measurement_input >> tmp_confirmation;
-
-                  if (! measurement_input.eof ())
+                  if (measurement_input->read_next (x.torque, x.confirmation))
                     {
-                      //cout << "torque = " << torque << " conf = " << tmp_confirmation << endl;
-                      cmd = sequencer_inout (torque, tmp_confirmation);
-                      measurement_output << torque << "\t" << tmp_confirmation << endl;
+                      //cout << "torque = " << x.torque << " conf = " << x.confirmation << endl;
+                      x.index = sample_index++;
+                      step_input.push_back (x);
+                      if (measurement_output.is_open ())
+                        measurement_output.append (x.index, lround (x.torque / TTT_REPLAY_SCALE), x.confirmation);
                     }
                   else
                     {
+                      // the sequence can't be completed: not resumable,
+                      // no step may accept the samples of this run
                       cerr << "ERROR: EOF measurement_input" << endl;
-                      stop_sequencer ();
-                      break;
+                      abort_sequencer ();
+                      return sequencer_is_running;
                     }
                 }
-              print_indicated_torque(torque);
+              print_indicated_torque(x.torque);
             }
         }
       else
         cerr << "ERROR: No source for torque measurements specified" << endl;
 
-      step* pstep = steps[current_step];
+      // the last torque of a run which was too early for the display rate
+      flush_indicated_torque ();
 
-      if (pttt && (cmd == CMD_TARA ))
-        {
-          //cout << "**************** TARA **************************" << endl;
-          pttt->tare ();
-          //cout << "**************** FINISHED TARA **************************" << endl;
-          cmd = pstep->inout (0, 1);
-        }
+      // a step which finished in this run stays visible until the next run
+      unsigned int shown_step = current_step;
+      if (! sequencer_process (shown_step))
+        return sequencer_is_running;  // paused in the next run, the step is repeated
 
-      meas_step *pmeas = dynamic_cast<meas_step*>(pstep);
-      if (pmeas)
+      if (shown_step < steps.size ())
         {
-          print_nominal_torque (pmeas->get_nominal_value ());
-          print_peak_torque (pmeas->get_peak_torque());
-
-          if (pmeas->is_finished ())
+          step* pstep = steps[shown_step];
+          // FIXME: should the old measurement be visible until next measurement or not?
+          // (if not: print_peak_torque (0.0) for the steps which aren't meas_steps)
+          if (pstep->is_meas_step ())
             {
-              //cout << "max_torque = " << pmeas->peak_torque() << endl;
-              double rise_time = -1;
-              // is it a peak_click_step?
-              peak_click_step *pclick = dynamic_cast<peak_click_step*>(pmeas);
-              if (pclick)
-                rise_time = pclick->get_rise_time ();
-
-              // create measurement_item
-              measurement_item *p = new measurement_item;
-              p->ts = get_localtime ();
-              p->nominal_value = pmeas->get_nominal_value ();
-              p->indicated_value = pmeas->get_peak_torque ();
-              p->rise_time = rise_time;
-
-              double accuracy = meas.to.accuracy;
-              if (accuracy == 0)
-                accuracy = meas.to.get_accuracy_from_DIN ();
-
-              cout << "ttt::run:" << __LINE__ << " accuracy=" << accuracy
-                   << " peak_torque=" << pmeas->get_peak_torque () << " is_in=" << p->is_in (accuracy) << endl;
-
-              // color of measurement_table cell background
-              Fl_Color cell_color = FL_WHITE;
-
-              // Typ IIC and IIF use mean as nominal value
-              // so it's impossible to have a live "good/bad" information
-              bool use_mean_as_nominal_value = meas.to.has_no_scale () && ! meas.to.has_fixed_trigger ();
-              if (! use_mean_as_nominal_value && ! p->is_in (accuracy))
-                cell_color = FL_RED;
-
-              bool overwrite_measurement =   (! p->is_in (accuracy))
-                                             && (report_style == ISO6789_LIKE_REPORT_WITH_REPEATS);
-              // add result to measurement table
-              if (m_table)
-                m_table->add_measurement (pmeas->get_peak_torque (), overwrite_measurement, cell_color);
-
-              if (overwrite_measurement)
-                {
-                  //aktueller Schritt zurücksetzen (interner Counter und Messwerte löschen usw.)
-                  pmeas->reset ();
-                }
-              else
-                {
-                  // add result to database
-                  meas.add_measurement_item (p);
-                }
+              meas_step *pmeas = static_cast<meas_step*>(pstep);
+              print_nominal_torque (pmeas->get_nominal_value ());
+              print_peak_torque (pmeas->get_peak_torque());
             }
-        }
-      // FIXME: should the old measurement be visible until next measurement or not?
-      //else
-      //  print_peak_torque (0.0);
+          else if (pstep->get_kind () == STEP_PRELOAD)
+            print_nominal_torque (static_cast<preload_step*>(pstep)->get_nominal_value ());
 
-      preload_step *ppreload = dynamic_cast<preload_step*>(pstep);
-      if (ppreload)
-        {
-          print_nominal_torque (ppreload->get_nominal_value ());
+          // instruction and step description, published only on changes
+          print_instruction (pstep->get_instruction ());
+
+          // show active step and progress (of the whole batch)
+          double progress = (batch_index + (1.0 * shown_step)/steps.size ()) / max (size_t (1), batch_test_objects.size ());
+          if (batch_label.empty ())
+            print_step (pstep->get_description (), progress);
+          else
+            print_step (batch_label + pstep->get_description (), progress);
         }
+    }
 
-      // refresh instruction and step description
-      print_instruction (pstep->instruction ());
+  return sequencer_is_running;
+}
 
-      // show active step and progress
-      print_step (steps[current_step]->description (), (1.0 * current_step)/steps.size ());
+void ttt::create_report (bool background)
+{
+  ostringstream os;
 
-      if (pstep->is_finished ())
-        current_step++;
+  // FIXME: model kann z.B. 730N/2 sein
+  //
+  // http://stackoverflow.com/questions/3038351/check-whether-a-string-is-a-valid-filename-with-qt
+  // http://www.boost.org/doc/libs/1_43_0/libs/filesystem/doc/portability_guide.htm
+
+  os << get_time_for_filename ();
+  os << "_" << meas.to.serial_number;
+  os << "_" << meas.to.manufacturer;
+  os << "_" << meas.to.model;
+
+  report_filename = os.str ();
+  std::replace_if(report_filename.begin(), report_filename.end(), isnalnum, '_');
+
+  if (report_style == ISO6789_REPORT)
+    report_filename += "_ISO6789.pdf";
+  else
+    report_filename += "_like_ISO6789.pdf";
+
+  bool with_repeats = report_style == ISO6789_LIKE_REPORT_WITH_REPEATS;
+
+  if (background && reports)
+    {
+      report_job j;
+      j.measurement_id = meas.id;
+      j.filename = report_filename;
+      j.repeat_on_tolerance_violation = with_repeats;
+      reports->push (j);
+      return;
     }
 
-  return sequencer_is_running;
+  report_result res = create_ISO6789_report (db, meas.id, report_filename.c_str (), with_repeats);
+  print_report_result (res);
+
+  // open created pdf
+  if (headless)
+    cout << "Report: " << report_filename << endl;
+  else
+    {
+#ifdef _WIN32
+      ShellExecute (0, 0, report_filename.c_str (), 0, 0, SW_SHOW );
+#elif __APPLE__
+      char call[256];
+      snprintf (call, 256, "open %s", report_filename.c_str ());
+      system (call);
+#else
+      char call[256];
+      snprintf (call, 256, "xdg-open %s", report_filename.c_str ());
+      system (call);
+#endif
+    }
+  //print_step ( string (gettext ("Kalibrierschein:")) + " " + report_filename, 1);
+}
+
+void ttt::collect_reports (bool wait)
+{
+  if (! reports)
+    return;
+
+  if (wait)
+    reports->wait ();
+
+  vector<report_job> jobs;
+  reports->pop_done (jobs);
+  for (unsigned int k = 0; k < jobs.size (); ++k)
+    {
+      // the pdfs of a batch aren't opened, the viewer would cover the instructions
+      cout << "Report: " << jobs[k].filename << endl;
+      if (jobs[k].error.empty ())
+        print_report_result (jobs[k].result);
+      else
+        {
+          cerr << "ERROR: " << jobs[k].error << endl;
+          print_result ("*" + jobs[k].error);
+        }
+    }
+}
+
+void ttt::print_report_result (const report_result &res)
+{
+  if (res.values_below_max_deviation && !res.timing_violation)
+    print_result (gettext ("Kalibrierung innerhalb Toleranz"));
+  else if (res.values_below_max_deviation && res.timing_violation)
+    print_result (gettext ("#Kalibrierung innerhalb Toleranz jedoch Mindestzeit nicht eingehalten"));
+  else
+    print_result (gettext ("*Kalibrierung außerhalb Toleranz"));
 }
 
 void ttt::set_confirmation ()
 {
+  unsigned char e[] = {TTT_CAPTURE_CONFIRMATION, 1};
+  liballuris_capture_host_event (e, sizeof (e));
   confirmation = true;
 }
 
+void ttt::reset_confirmation ()
+{
+  unsigned char e[] = {TTT_CAPTURE_CONFIRMATION, 0};
+  liballuris_capture_host_event (e, sizeof (e));
+  confirmation = false;
+}
+
+void ttt::replay_capture_event (const vector<unsigned char> &e)
+{
+  if (e.size () == 2 && e[0] == TTT_CAPTURE_CONFIRMATION)
+    {
+      if (e[1])
+        set_confirmation ();
+      else
+        reset_confirmation ();
+    }
+  else if (e.size () == 1 && e[0] == TTT_CAPTURE_ABORT)
+    abort_sequencer ();
+  else
+    cerr << "ttt::replay_capture_event: unknown event" << endl;
+}
+
+void ttt::add_event_listener (cb_ttt_event *cb, void *user_data)
+{
+  event_listeners.push_back (make_pair (cb, user_data));
+}
+
+void ttt::remove_event_listener (cb_ttt_event *cb, void *user_data)
+{
+  event_listeners.erase (remove (event_listeners.begin (), event_listeners.end (), make_pair (cb, user_data)),
+                         event_listeners.end ());
+}
+
+void ttt::set_display_rate (double hz)
+{
+  display_interval = (hz > 0) ? 1.0 / hz : 0;
+}
+
+void ttt::publish (ttt_event_type type, double value, const string &text)
+{
+  if (event_listeners.empty ())
+    return;
+
+  ttt_event e;
+  e.type = type;
+  e.value = value;
+  e.text = text;
+  e.rows = 0;
+  e.cols = 0;
+  e.color = FL_WHITE;
+  e.overwrite = false;
+  publish (e);
+}
+
+void ttt::publish (const ttt_event &e)
+{
+  ttt_event ev = e;
+  ev.step = current_step;
+  for (unsigned int k = 0; k < event_listeners.size (); ++k)
+    event_listeners[k].first (event_listeners[k].second, ev);
+}
+
+void ttt::print_indicated_torque (double v, bool force)
+{
+  pending_indicated_torque = v;
+  indicated_torque_pending = true;
+  flush_indicated_torque (force);
+}
+
+void ttt::flush_indicated_torque (bool force)
+{
+  if (! indicated_torque_pending)
+    return;
+
+  chrono::steady_clock::time_point now = chrono::steady_clock::now ();
+  if (! force && display_interval > 0
+      && chrono::duration<double> (now - last_indicated_torque).count () < display_interval)
+    return;
+
+  last_indicated_torque = now;
+  indicated_torque_pending = false;
+  if (cb_indicated_torque)
+    cb_indicated_torque (pending_indicated_torque);
+  publish (TTT_EVENT_INDICATED_TORQUE, pending_indicated_torque, "");
+}
+
+void ttt::reset_display ()
+{
+  display_valid = false;
+  print_indicated_torque (0.0, true);
+  print_nominal_torque (0.0);
+  print_peak_torque (0.0);
+  print_instruction ("");
+  print_step ("idle", 0);
+  display_valid = true;
+}
+
 void ttt::add_step (step *s)
 {
   //cout << "ttt::add_step" << endl;
@@ -420,7 +608,7 @@ void ttt::clear_steps()
 }
 
 // add complete DIN ISO 6789 sequences
-void ttt::add_ISO6789_steps (bool repeat_on_timing_violation)
+void ttt::add_ISO6789_steps (bool repeat_on_timing_violation, double tare_zero_band)
 {
   int runs;
   int sign;
@@ -471,7 +659,8 @@ void ttt::add_ISO6789_steps (bool repeat_on_timing_violation)
 #error No ISO 6789 variant defined
 #endif
 
-      add_step (new tare_torque_tester_step());
+      // only the first tare can be skipped, the second run follows a load in the other direction
+      add_step (new tare_torque_tester_step(k ? 0 : tare_zero_band));
 
       vector<double> torque_list;
 
@@ -585,6 +774,37 @@ void ttt::start_sequencer (double temperature, double humidity)
   if (! meas.to.id)
     throw runtime_error ("ttt::start_sequencer: No valid test object selected");
 
+  open_measurement_output ();
+
+  // init measurement
+  meas.clear_measurement_items ();
+  meas.temperature = temperature;
+  meas.humidity = humidity;
+  meas.start_time = get_localtime();
+
+  switch (report_style)
+    {
+    case QUICK_CHECK_REPORT:
+      meas.norm = "quick-check";
+      break;
+    case ISO6789_REPORT:
+      meas.norm = "ISO6789";
+      break;
+    case ISO6789_LIKE_REPORT_WITH_REPEATS:
+      meas.norm = "ISO6789 with repeats";
+      break;
+    default:
+      meas.norm = "undefined";
+    }
+
+  // the measurement is saved with state "running", the items follow in accept_measurement
+  meas.begin (db);
+
+  start_steps (0);
+}
+
+void ttt::open_measurement_output ()
+{
   if (! measurement_output.is_open ())
     {
       string tmp = meas.to.serial_number + "_" + meas.to.manufacturer + "_" + meas.to.model;
@@ -601,97 +821,138 @@ void ttt::start_sequencer (double temperature, double humidity)
           os << "_" << tmp;
         }
 
-      os << ".log";
+      os << ".raw";
       meas.raw_data_filename = os.str ();
 
       // FIXME: check if ./logfiles exists, create it if not?
       // open and write header
-      measurement_output.open (meas.raw_data_filename.c_str ());
+      ostringstream header;
+      double scale = TTT_REPLAY_SCALE;
       if (pttt)
         {
-          measurement_output << "# TTT serial           = " << pttt->get_serial () << endl;
-          measurement_output << "# TTT cal_date         = " << pttt->get_cal_date () << endl;
+          header << "# TTT serial           = " << pttt->get_serial () << endl;
+          header << "# TTT cal_date         = " << pttt->get_cal_date () << endl;
+          header << "# TTT model            = " << pttt->get_model () << endl;
+          scale = pttt->get_scale ();
+        }
+      try
+        {
+          measurement_output.open (meas.raw_data_filename, scale, TTT_SPS, header.str ());
+        }
+      catch (exception& e)
+        {
+          // like before with ofstream: continue without raw data file
+          cerr << "ERROR: " << e.what () << endl;
         }
     }
+}
 
-  // init measurement
-  meas.clear_measurement_items ();
-  meas.temperature = temperature;
-  meas.humidity = humidity;
-  meas.start_time = get_localtime();
-
-  switch (report_style)
-    {
-    case QUICK_CHECK_REPORT:
-      meas.norm = "quick-check";
-      break;
-    case ISO6789_REPORT:
-      meas.norm = "ISO6789";
-      break;
-    case ISO6789_LIKE_REPORT_WITH_REPEATS:
-      meas.norm = "ISO6789 with repeats";
-      break;
-    default:
-      meas.norm = "undefined";
-    }
-
+void ttt::configure_measurement_table ()
+{
   // configure measurement_table
+  // (m_table or, with a ttt_worker, the TTT_EVENT_TABLE_* events in the GUI thread)
   if (m_table)
-    {
-      m_table->clear ();
-      unsigned int k;
-      int cols = 0, col_cnt = 0, rows = 0;
-      double old_nom = 0;
+    m_table->clear ();
+  publish (TTT_EVENT_TABLE_CLEAR, 0, "");
+
+  unsigned int k;
+  int cols = 0, col_cnt = 0, rows = 0;
+  double old_nom = 0;
 
-      // loop over all steps and find measurement_steps
-      // (ignore tara, preload and so on)
+  // loop over all steps and find measurement_steps
+  // (ignore tara, preload and so on)
 
-      // new row for every new nominal_value
-      // new col if same nominal_value
+  // new row for every new nominal_value
+  // new col if same nominal_value
 
-      for (k=0; k < steps.size (); ++k)
+  for (k=0; k < steps.size (); ++k)
+    {
+      if (steps[k]->is_meas_step ())
         {
-          meas_step *pmeas = dynamic_cast<meas_step*>(steps[k]);
-          if (pmeas)
+          meas_step *pmeas = static_cast<meas_step*>(steps[k]);
+          double nom = pmeas->get_nominal_value ();
+          cout << "configure measurement_table nom=" << nom << " old_nom=" << old_nom << endl;
+          if (nom != old_nom)
             {
-              double nom = pmeas->get_nominal_value ();
-              cout << "configure measurement_table nom=" << nom << " old_nom=" << old_nom << endl;
-              if (nom != old_nom)
-                {
-                  m_table->add_nominal_value (nom);
-                  rows++;
-                  col_cnt = 1;
-                }
-              else
-                {
-                  col_cnt++;
-                }
+              if (m_table)
+                m_table->add_nominal_value (nom);
+              publish (TTT_EVENT_TABLE_NOMINAL_VALUE, nom, "");
+              rows++;
+              col_cnt = 1;
+            }
+          else
+            {
+              col_cnt++;
+            }
 
-              if (col_cnt > cols)
-                cols = col_cnt;
-              old_nom = nom;
-              // is it a peak_click_step?
-              //peak_click_step *pclick = dynamic_cast<peak_click_step*>(pmeas);
-              //if (pclick)
-              //rise_time = pclick->get_rise_time ();
+          if (col_cnt > cols)
+            cols = col_cnt;
+          old_nom = nom;
+          // is it a peak_click_step?
+          //if (pmeas->get_kind () == STEP_PEAK_CLICK)
+          //rise_time = static_cast<peak_click_step*>(pmeas)->get_rise_time ();
 
-            }
         }
+    }
 
-      cout << "cfg m_table rows=" << rows << " cols=" << cols << endl;
+  cout << "cfg m_table rows=" << rows << " cols=" << cols << endl;
+  if (m_table)
+    {
       m_table->rows (rows);
       m_table->cols (cols);
     }
+  ttt_event e;
+  e.type = TTT_EVENT_TABLE_SIZE;
+  e.value = 0;
+  e.rows = rows;
+  e.cols = cols;
+  e.color = FL_WHITE;
+  e.overwrite = false;
+  publish (e);
+
+  // items loaded by resume_sequencer
+  for (k=0; k < meas.get_measurement_item_count (); ++k)
+    {
+      measurement_item *p = meas.get_measurement_item (k);
+      add_table_measurement (p->indicated_value, false, cell_color (p));
+    }
+}
+
+void ttt::add_table_measurement (double v, bool overwrite, Fl_Color c)
+{
+  if (m_table)
+    m_table->add_measurement (v, overwrite, c);
+
+  ttt_event e;
+  e.type = TTT_EVENT_TABLE_MEASUREMENT;
+  e.value = v;
+  e.rows = 0;
+  e.cols = 0;
+  e.color = c;
+  e.overwrite = overwrite;
+  publish (e);
+}
 
+void ttt::start_steps (unsigned int first_step)
+{
+  configure_measurement_table ();
+
+  if (motor_driven)
+    for (unsigned int k = 0; k < steps.size (); ++k)
+      steps[k]->set_motor_driven ();
+
+  if (pttt && motor_driven != pttt->get_motor_control ())
+    pttt->set_motor_control (motor_driven);
 
   if (pttt)
     pttt->start ();
 
-  current_step = 0;
+  current_step = first_step;
   print_peak_torque (0.0);
-  print_indicated_torque (0.0);
+  print_indicated_torque (0.0, true);
   print_nominal_torque (0.0);
   sequencer_is_running = true;
+  publish (TTT_EVENT_SEQUENCER_STARTED, 0, "");
 }
 
 void ttt::start_sequencer_quick_check (double temperature, double humidity, double nominal_value)
@@ -722,6 +983,7 @@ void ttt::start_sequencer_quick_check (double temperature, double humidity, doub
     }
 
   report_style = QUICK_CHECK_REPORT;
+  meas.repeat_on_timing_violation = false;
   start_sequencer (temperature, humidity);
 }
 
@@ -735,36 +997,316 @@ void ttt::start_sequencer_ISO6789 (double temperature, double humidity, bool rep
   // resolution from DIN678
 
   add_ISO6789_steps (repeat_on_timing_violation);
+  meas.repeat_on_timing_violation = repeat_on_timing_violation;
+
+  if (! repeat_on_tolerance_violation)
+    report_style = ISO6789_REPORT;
+  else
+    report_style = ISO6789_LIKE_REPORT_WITH_REPEATS;
+
+  start_sequencer (temperature, humidity);
+}
+
+void ttt::start_sequencer_ISO6789_batch (const vector<int> &test_object_ids,
+                                         double temperature, double humidity,
+                                         bool repeat_on_timing_violation, bool repeat_on_tolerance_violation)
+{
+  if (sequencer_is_running)
+    throw runtime_error ("Sequencer is already running. Please stop it first");
+
+  if (test_object_ids.empty ())
+    throw runtime_error ("ttt::start_sequencer_ISO6789_batch: No test objects");
+
+  clear_steps ();
+  clear_batch ();
+
+  // the TTT still shows zero after the previous test object, its tare isn't needed
+  double zero_band = (meas.tt.resolution > 0) ? TTT_TARE_SKIP_DIGITS * meas.tt.resolution : 0;
+
+  // plan of all test objects, an invalid test object stops the batch before the first measurement
+  try
+    {
+      for (unsigned int k = 0; k < test_object_ids.size (); ++k)
+        {
+          meas.to.load_with_id (db, test_object_ids[k]);
+          add_ISO6789_steps (repeat_on_timing_violation, k ? zero_band : 0);
+          batch_steps.push_back (vector<step *> ());
+          batch_steps.back ().swap (steps);
+        }
+    }
+  catch (...)
+    {
+      clear_batch ();
+      throw;
+    }
+
+  batch_test_objects = test_object_ids;
+  batch_index = 0;
+  steps.swap (batch_steps[0]);
+  meas.to.load_with_id (db, batch_test_objects[0]);
+
+  ostringstream os;
+  os << meas.to.equipment_number << " (1/" << batch_test_objects.size () << "): ";
+  batch_label = os.str ();
+
+  cout << "ttt::start_sequencer_ISO6789_batch " << batch_test_objects.size () << " test objects" << endl;
+
+  // an in-memory database can't be opened by the report thread
+  if (! reports && database_fn != ":memory:")
+    reports = new report_queue (database_fn);
 
   if (! repeat_on_tolerance_violation)
     report_style = ISO6789_REPORT;
   else
     report_style = ISO6789_LIKE_REPORT_WITH_REPEATS;
+  meas.repeat_on_timing_violation = repeat_on_timing_violation;
 
   start_sequencer (temperature, humidity);
 }
 
+void ttt::clear_batch ()
+{
+  for (unsigned int k = 0; k < batch_steps.size (); ++k)
+    for (unsigned int j = 0; j < batch_steps[k].size (); ++j)
+      delete batch_steps[k][j];
+  batch_steps.clear ();
+  batch_test_objects.clear ();
+  batch_index = 0;
+  batch_label = "";
+}
+
+void ttt::next_batch_test_object ()
+{
+  batch_index++;
+
+  // the plan of the next test object replaces the finished steps
+  clear_steps ();
+  steps.swap (batch_steps[batch_index]);
+  meas.to.load_with_id (db, batch_test_objects[batch_index]);
+
+  ostringstream os;
+  os << meas.to.equipment_number << " (" << batch_index + 1 << "/" << batch_test_objects.size () << "): ";
+  batch_label = os.str ();
+
+  cout << "ttt::next_batch_test_object " << batch_label << "test_object.id=" << meas.to.id << endl;
+
+  // one raw data file per test object
+  if (measurement_output.is_open ())
+    measurement_output.close ();
+  open_measurement_output ();
+
+  // same test person, torque tester and climate
+  meas.clear_measurement_items ();
+  meas.start_time = get_localtime();
+  meas.begin (db);
+
+  configure_measurement_table ();
+
+  if (motor_driven)
+    for (unsigned int k = 0; k < steps.size (); ++k)
+      steps[k]->set_motor_driven ();
+
+  print_peak_torque (0.0);
+  print_nominal_torque (0.0);
+}
+
+void ttt::resume_sequencer (int measurement_id)
+{
+  if (sequencer_is_running)
+    throw runtime_error ("Sequencer is already running. Please stop it first");
+
+  int torque_tester_id = meas.tt.id;
+  meas.load_with_id (db, measurement_id);
+  if (meas.tt.id != torque_tester_id)
+    {
+      load_torque_tester ();
+      throw runtime_error ("ttt::resume_sequencer: The measurement was started with another torque tester");
+    }
+  if (meas.state != "running")
+    throw runtime_error ("ttt::resume_sequencer: The measurement isn't unfinished");
+
+  if (meas.norm == "ISO6789")
+    report_style = ISO6789_REPORT;
+  else if (meas.norm == "ISO6789 with repeats")
+    report_style = ISO6789_LIKE_REPORT_WITH_REPEATS;
+  else
+    throw runtime_error ("ttt::resume_sequencer: Only ISO 6789 measurements can be resumed");
+
+  clear_steps ();
+  add_ISO6789_steps (meas.repeat_on_timing_violation);
+
+  // every finished meas_step has one item (repeats aren't saved),
+  // continue after the meas_step of the last item
+  unsigned int items = meas.get_measurement_item_count ();
+  unsigned int first_step = 0;
+  for (unsigned int k = 0; k < steps.size () && items > 0; ++k)
+    if (steps[k]->is_meas_step () && --items == 0)
+      first_step = k + 1;
+  if (items > 0)
+    throw runtime_error ("ttt::resume_sequencer: More measurement items than steps");
+
+  // the TTT may have been switched off in the meantime
+  if (first_step > 0 && first_step < steps.size ())
+    steps.insert (steps.begin () + first_step, new tare_torque_tester_step ());
+
+  cout << "ttt::resume_sequencer id=" << meas.id << " items=" << meas.get_measurement_item_count ()
+       << " first_step=" << first_step << "/" << steps.size () << endl;
+
+  // the raw data of the rest goes to a new file, the measurement keeps the names of all parts
+  string previous_parts = meas.raw_data_filename;
+  open_measurement_output ();
+  if (! previous_parts.empty ())
+    meas.set_raw_data_filename (db, previous_parts + RAW_DATA_FILENAME_SEPARATOR + meas.raw_data_filename);
+  else
+    meas.set_raw_data_filename (db, meas.raw_data_filename);
+  start_steps (first_step);
+}
+
 void ttt::stop_sequencer ()
 {
-  cout << "ttt::stop_sequencer ()" << endl;
+  halt_sequencer ();
+  // the reports of the finished test objects of a batch
+  collect_reports (true);
+  publish (TTT_EVENT_SEQUENCER_STOPPED, 0, "");
+}
+
+void ttt::abort_sequencer ()
+{
+  unsigned char e[] = {TTT_CAPTURE_ABORT};
+  liballuris_capture_host_event (e, sizeof (e));
+  stop_sequencer ();
+  if (meas.state == "running")
+    {
+      set_measurement_state (db, meas.id, "aborted");
+      meas.state = "aborted";
+    }
+  publish (TTT_EVENT_SEQUENCER_ABORTED, 0, "");
+}
+
+void ttt::halt_sequencer ()
+{
+  cout << "ttt::halt_sequencer ()" << endl;
   if (measurement_output.is_open ())
     measurement_output.close ();
 
   sequencer_is_running = false;
+  sequencer_paused = false;
+  clear_batch ();
+
+  // release the test object if the sequencer was stopped while loading
+  if (pttt && pttt->is_connected () && motor_driven)
+    pttt->motor (TTT_MOTOR_RETURN);
 
   // stop measuring
   if (pttt)
     pttt->stop ();
 }
 
-out_cmd ttt::sequencer_inout (double torque, bool confirmation)
+bool ttt::sequencer_process (unsigned int &finished_step)
+{
+  size_t n = step_input.size ();
+  size_t k = 0;
+  while (k < n && current_step < steps.size ())
+    {
+      step *pstep = steps[current_step];
+      step_block_result r = pstep->process (&step_input[k], n - k);
+      k += r.consumed;
+
+      if (r.cmd == RESET_CONFIRMATION)
+        {
+          confirmation = false;
+          // the button applies to the rest of the block, a replay has its recorded confirmation
+          if (pttt)
+            for (size_t j = k; j < n; ++j)
+              step_input[j].confirmation = false;
+        }
+      else if (pttt && r.cmd == CMD_TARA)
+        {
+          //cout << "**************** TARA **************************" << endl;
+          pttt->tare ();
+          //cout << "**************** FINISHED TARA **************************" << endl;
+          if (! pttt->is_connected ())
+            return false;
+          pstep->inout (0, 1, sample_index);
+          // the rest of the block was measured before the tare
+          k = n;
+        }
+      else if (pttt && (r.cmd == CMD_MOTOR_START || r.cmd == CMD_MOTOR_STOP || r.cmd == CMD_MOTOR_RETURN))
+        {
+          if (r.cmd == CMD_MOTOR_START)
+            pttt->motor (TTT_MOTOR_START);
+          else if (r.cmd == CMD_MOTOR_STOP)
+            pttt->motor (TTT_MOTOR_STOP);
+          else
+            pttt->motor (TTT_MOTOR_RETURN);
+          if (! pttt->is_connected ())
+            return false;
+        }
+
+      if (pstep->is_finished () && pstep->is_meas_step ())
+        accept_measurement (static_cast<meas_step*>(pstep));
+
+      // accept_measurement resets the step for a repeat
+      if (pstep->is_finished ())
+        finished_step = current_step++;
+    }
+  return true;
+}
+
+void ttt::accept_measurement (meas_step *pmeas)
+{
+  //cout << "max_torque = " << pmeas->peak_torque() << endl;
+  double rise_time = -1;
+  if (pmeas->get_kind () == STEP_PEAK_CLICK)
+    rise_time = static_cast<peak_click_step*>(pmeas)->get_rise_time ();
+
+  // create measurement_item
+  measurement_item *p = new measurement_item;
+  p->ts = get_localtime ();
+  p->nominal_value = pmeas->get_nominal_value ();
+  p->indicated_value = pmeas->get_peak_torque ();
+  p->rise_time = rise_time;
+
+  double accuracy = get_accuracy ();
+
+  cout << "ttt::accept_measurement: accuracy=" << accuracy
+       << " peak_torque=" << pmeas->get_peak_torque () << " is_in=" << p->is_in (accuracy) << endl;
+
+  bool overwrite_measurement =   (! p->is_in (accuracy))
+                                 && (report_style == ISO6789_LIKE_REPORT_WITH_REPEATS);
+  // add result to measurement table
+  add_table_measurement (pmeas->get_peak_torque (), overwrite_measurement, cell_color (p));
+
+  if (overwrite_measurement)
+    {
+      //aktueller Schritt zurücksetzen (interner Counter und Messwerte löschen usw.)
+      pmeas->reset ();
+      delete p;
+    }
+  else
+    {
+      // add result to database, committed before the next step starts
+      meas.append_item (db, p);
+      publish (TTT_EVENT_ITEM_ACCEPTED, p->indicated_value, pmeas->get_description ());
+    }
+}
+
+double ttt::get_accuracy ()
 {
-  out_cmd ret;
-  step *pstep = steps[current_step];
-  ret = pstep->inout (torque, confirmation);
-  if (ret == RESET_CONFIRMATION)
-    this->confirmation = false;
-  return ret;
+  double accuracy = meas.to.accuracy;
+  if (accuracy == 0)
+    accuracy = meas.to.get_accuracy_from_DIN ();
+  return accuracy;
+}
+
+Fl_Color ttt::cell_color (measurement_item *p)
+{
+  // Typ IIC and IIF use mean as nominal value
+  // so it's impossible to have a live "good/bad" information
+  bool use_mean_as_nominal_value = meas.to.has_no_scale () && ! meas.to.has_fixed_trigger ();
+  if (! use_mean_as_nominal_value && ! p->is_in (get_accuracy ()))
+    return FL_RED;
+  return FL_WHITE;
 }
 
 //! Loop over steps and list detected peaks
@@ -777,21 +1319,59 @@ void ttt::print_result ()
       cout << "step " << k+1 << "/" << len << " "
            << steps[k]->description ();
 
-      meas_step *pmeas = dynamic_cast<meas_step*>(steps[k]);
-      if (pmeas)
+      if (steps[k]->is_meas_step ())
         {
+          meas_step *pmeas = static_cast<meas_step*>(steps[k]);
           cout << " nominal=" << pmeas->get_nominal_value ();
           cout << " peak=" << pmeas->get_peak_torque ();
 
           // is it a peak_click_step?
-          peak_click_step *pclick = dynamic_cast<peak_click_step*>(pmeas);
-          if (pclick)
-            cout << " rise_time=" << pclick->get_rise_time ();
+          if (pmeas->get_kind () == STEP_PEAK_CLICK)
+            cout << " rise_time=" << static_cast<peak_click_step*>(pmeas)->get_rise_time ();
         }
       cout << endl;
     }
 }
 
+void ttt::get_step_results (vector<step_result> &results)
+{
+  results.clear ();
+  for (unsigned int k=0; k<steps.size (); ++k)
+    {
+      if (steps[k]->is_meas_step ())
+        {
+          meas_step *pmeas = static_cast<meas_step*>(steps[k]);
+          step_result r;
+          r.description = steps[k]->description ();
+          r.nominal_value = pmeas->get_nominal_value ();
+          r.peak_torque = pmeas->get_peak_torque ();
+          r.rise_time = -1;
+
+          if (pmeas->get_kind () == STEP_PEAK_CLICK)
+            r.rise_time = static_cast<peak_click_step*>(pmeas)->get_rise_time ();
+          results.push_back (r);
+        }
+    }
+}
+
+bool ttt::lookup_torque_tester (void *user_data, ttt_device_metadata &md)
+{
+  ttt *p = static_cast<ttt*> (user_data);
+  int id = p->meas.tt.search_serial_and_next_cal_date (p->db, md.serial, md.next_cal_date);
+  if (id < 0)
+    return false;
+
+  torque_tester tt;
+  tt.load_with_id (p->db, id);
+  md.cal_date    = tt.calibration_date;
+  md.cal_number  = tt.calibration_number;
+  md.max_M       = tt.max_torque;
+  md.uncertainty = tt.uncertainty_of_measurement;
+  md.resolution  = tt.resolution;
+  md.digits      = tt.digits;
+  return true;
+}
+
 void ttt::load_torque_tester ()
 {
   if (pttt)
@@ -803,6 +1383,10 @@ void ttt::load_torque_tester ()
         {
           cout << "ttt::load_torque_tester found torque_tester with id = " << id << endl;
           meas.tt.load_with_id (db, id);
+
+          // entries created before the digits column existed can't be used as metadata cache
+          if (meas.tt.digits < 0)
+            meas.tt.update_digits (db, pttt->get_digits ());
         }
       else
         {
@@ -816,6 +1400,7 @@ void ttt::load_torque_tester ()
           meas.tt.max_torque            = pttt->get_max_torque ();
           meas.tt.uncertainty_of_measurement = pttt->get_uncertainty ();
           meas.tt.resolution            = pttt->get_resolution ();
+          meas.tt.digits                = pttt->get_digits ();
           meas.tt.save (db);
           cout << "ttt::load_torque_tester created new torque_tester with id = " << meas.tt.id << endl;
         }
@@ -31,13 +31,18 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <vector>
 #include <ctime>
+#include <sys/time.h>
 #include <algorithm>
+#include <chrono>
 #include <libintl.h>
 #include "ttt_device.h"
 #include "step.h"
 #include "sqlite_interface.h"
 #include "cairo_drawing_functions.h"
 #include "measurement_table.h"
+#include "raw_data_writer.h"
+#include "raw_log_reader.h"
+#include "report_queue.h"
 
 using namespace std;
 
@@ -45,7 +50,80 @@ typedef void(cb_display_double)(double value);
 typedef void(cb_display_string)(string s);
 typedef void(cb_display_string_double)(string s, double value);
 
-#define TTT_SPS 900
+// default rate of the indicated torque updates in Hz, see ttt::set_display_rate
+#define TTT_DISPLAY_RATE 25
+
+/*
+ * Events of the sequencer, published only on changes
+ * (the cb_display_* callbacks of the c'tor are called for the same changes)
+ */
+enum ttt_event_type
+{
+  TTT_EVENT_INDICATED_TORQUE,   // value, coalesced to the display rate
+  TTT_EVENT_NOMINAL_TORQUE,     // value
+  TTT_EVENT_PEAK_TORQUE,        // value
+  TTT_EVENT_INSTRUCTION,        // text
+  TTT_EVENT_STEP_ENTERED,       // text = description, value = progress 0..1
+  TTT_EVENT_ITEM_ACCEPTED,      // text = description, value = peak torque
+  TTT_EVENT_RESULT,             // text
+  TTT_EVENT_SEQUENCER_STARTED,
+  TTT_EVENT_SEQUENCER_STOPPED,  // at the end of a sequence after the report
+  TTT_EVENT_SEQUENCER_ABORTED,  // after TTT_EVENT_SEQUENCER_STOPPED, see abort_sequencer
+  TTT_EVENT_ERROR,              // text, exception in the sequencer thread (see ttt_worker)
+  TTT_EVENT_TABLE_CLEAR,        // the measurement table of a new sequence follows
+  TTT_EVENT_TABLE_NOMINAL_VALUE,// value = nominal value of the next row
+  TTT_EVENT_TABLE_SIZE,         // rows, cols
+  TTT_EVENT_TABLE_MEASUREMENT   // value = peak torque, color, overwrite
+};
+
+struct ttt_event
+{
+  ttt_event_type type;
+  unsigned int step;    // index of the current step
+  double value;
+  string text;
+  // measurement table, see measurement_table::add_measurement
+  int rows;
+  int cols;
+  Fl_Color color;
+  bool overwrite;       // the next measurement replaces this one
+};
+
+typedef void(cb_ttt_event)(void *user_data, const ttt_event &e);
+
+// samples fed from measurement_input per call of ttt::run in REPLAY_FAST
+// (same amount as in real time with the GUI timer of 10ms)
+#define TTT_REPLAY_SAMPLES_PER_RUN (TTT_SPS / 100)
+
+// scale for measurement_output while reading from measurement_input (the logs have 3 decimals)
+#define TTT_REPLAY_SCALE 0.001
+
+// batch mode: the tare of the next test object is skipped if the TTT shows
+// zero within this number of resolution steps (see tare_torque_tester_step)
+#define TTT_TARE_SKIP_DIGITS 2
+
+// inputs of the user in a USB capture (see liballuris_capture_host_event),
+// the payload is the id followed by the value
+enum ttt_capture_event
+{
+  TTT_CAPTURE_CONFIRMATION = 'C',   // 1 = set_confirmation, 0 = reset_confirmation
+  TTT_CAPTURE_ABORT = 'A'           // abort_sequencer, no value
+};
+
+enum replay_clock
+{
+  REPLAY_REALTIME,  // feed measurement_input with TTT_SPS wall clock rate
+  REPLAY_FAST       // feed TTT_REPLAY_SAMPLES_PER_RUN per ttt::run call, no waiting
+};
+
+// result of one meas_step, see ttt::get_step_results
+struct step_result
+{
+  string description;
+  double nominal_value;
+  double peak_torque;
+  double rise_time;     // -1 if it's not a peak_click_step
+};
 
 class ttt
 {
@@ -53,14 +131,28 @@ class ttt
 private:
 
   ttt_device *pttt;
+  bool owns_pttt;     // false if the device is owned by a ttt_device_manager
   sqlite3 *db;
 
-  ifstream measurement_input;
-  ofstream measurement_output;
+  raw_log_reader *measurement_input;
+  raw_data_writer measurement_output;
+
+  // index of the next sample, time base for the steps
+  unsigned long sample_index;
+
+  // clock for measurement_input
+  enum replay_clock replay_mode;
+  bool replay_first_run;
+  struct timeval replay_t1;
+
+  // don't open the created report with the pdf viewer
+  bool headless;
 
   double start_peak_torque_factor;
   double stop_peak_torque_factor;
 
+  // only without ttt_worker, the worker thread must not touch FLTK widgets:
+  // the TTT_EVENT_TABLE_* events carry the same updates
   measurement_table *m_table;
 
   //! display for measured torque
@@ -76,48 +168,129 @@ private:
   //! display for result
   cb_display_string *cb_result;
 
-  void print_indicated_torque (double v)
-  {
-    if (cb_indicated_torque)
-      cb_indicated_torque (v);
-  }
+  // listeners of add_event_listener
+  vector< pair<cb_ttt_event *, void *> > event_listeners;
+  void publish (ttt_event_type type, double value, const string &text);
+  void publish (const ttt_event &e);
+
+  // last published values, print_* only publishes changes
+  double shown_nominal_torque;
+  double shown_peak_torque;
+  string shown_instruction;
+  string shown_step;
+  double shown_progress;
+  bool display_valid;   // false: the next print_* publishes even without change
+
+  // the indicated torque is coalesced to display_interval
+  double display_interval;
+  double pending_indicated_torque;
+  bool indicated_torque_pending;
+  chrono::steady_clock::time_point last_indicated_torque;
+
+  // force: publish now regardless of the display rate (idle value)
+  void print_indicated_torque (double v, bool force = false);
+  // publish a pending indicated torque if the display interval has passed
+  void flush_indicated_torque (bool force = false);
+  // publish all values
+  void reset_display ();
 
   void print_nominal_torque (double v)
   {
+    if (display_valid && v == shown_nominal_torque)
+      return;
+    shown_nominal_torque = v;
     if (cb_nominal_torque)
       cb_nominal_torque (v);
+    publish (TTT_EVENT_NOMINAL_TORQUE, v, "");
   }
 
   void print_peak_torque (double v)
   {
+    if (display_valid && v == shown_peak_torque)
+      return;
+    shown_peak_torque = v;
     if (cb_peak_torque)
       cb_peak_torque (v);
+    publish (TTT_EVENT_PEAK_TORQUE, v, "");
   }
 
-  void print_instruction (string v)
+  void print_instruction (const string &v)
   {
+    if (display_valid && v == shown_instruction)
+      return;
+    shown_instruction = v;
     if (cb_instruction)
       cb_instruction (v);
+    publish (TTT_EVENT_INSTRUCTION, 0, v);
   }
 
-  void print_step (string s, double v)
+  void print_step (const string &s, double v)
   {
+    if (display_valid && s == shown_step && v == shown_progress)
+      return;
+    shown_step = s;
+    shown_progress = v;
     if (cb_step)
       cb_step (s, v);
+    publish (TTT_EVENT_STEP_ENTERED, v, s);
   }
 
-  void print_result (string s)
+  void print_result (const string &s)
   {
     if (cb_result)
       cb_result (s);
+    publish (TTT_EVENT_RESULT, 0, s);
   }
 
   // step sequencer
   vector<step *> steps;
   bool confirmation;
+  // samples of the current run, reused to avoid allocations
+  vector<step_sample> step_input;
 
   unsigned int current_step;
   bool sequencer_is_running;
+  // TTT disconnected while the sequencer is running, the current step is restarted after reconnect
+  bool sequencer_paused;
+  // the steps load the test object with the motor of the test rig
+  bool motor_driven;
+
+  // feed step_input to the steps and execute their commands,
+  // finished_step is set to the last step which finished in this block.
+  // Returns false if the TTT was disconnected by a command
+  bool sequencer_process (unsigned int &finished_step);
+  // measurement_item of a finished meas_step, saved immediately
+  void accept_measurement (meas_step *pmeas);
+  // background of a measurement_table cell
+  Fl_Color cell_color (measurement_item *p);
+  double get_accuracy ();
+  // stop_sequencer without TTT_EVENT_SEQUENCER_STOPPED
+  void halt_sequencer ();
+
+  // common part of start_sequencer and resume_sequencer
+  void open_measurement_output ();
+  void configure_measurement_table ();
+  // to m_table and as TTT_EVENT_TABLE_MEASUREMENT
+  void add_table_measurement (double v, bool overwrite, Fl_Color c);
+  void start_steps (unsigned int first_step);
+
+  // batch mode, see start_sequencer_ISO6789_batch
+  vector<int> batch_test_objects;
+  vector< vector<step *> > batch_steps;  // plan of every test object, moved to steps when it's started
+  unsigned int batch_index;
+  string batch_label;                    // prefix of the step description
+  // delete the plan of the remaining test objects
+  void clear_batch ();
+  // finish the current test object and start the next one
+  void next_batch_test_object ();
+
+  // ISO 6789 reports, in batch mode in the background
+  string database_fn;
+  report_queue *reports;
+  void create_report (bool background);
+  // publish the results of the reports done in the background
+  void collect_reports (bool wait);
+  void print_report_result (const report_result &res);
 
   string report_filename;
   string get_time_for_filename (); //returns localtime for usage in output filename
@@ -151,19 +324,24 @@ public:
   void connect_TTT ();
   //! connect with TTT with given serial number
   void connect_TTT (string serial);
+  //! use a TTT opened by ttt_device_manager (one ttt instance per station), it isn't deleted on disconnect
+  void connect_TTT (ttt_device *dev);
   void disconnect_TTT ();
 
   /*!
    * Debugging tool:
-   * Read torque measurement and confirmation from file instead of TTT device
+   * Read torque measurement and confirmation from file instead of TTT device.
+   * Text logs and raw files written by measurement_output are supported.
+   * With REPLAY_FAST the samples are read as fast as run () is called,
+   * the steps see the same sample indexes as in real time.
    */
-  void connect_measurement_input (string fn);
+  void connect_measurement_input (string fn, enum replay_clock mode = REPLAY_REALTIME);
   void disconnect_measurement_input ();
 
   //************* datasink *************
   /*!
    * opens a file to write torque measurmeent data with 900Hz
-   * Lines starting with # are comments/header
+   * binary format, see raw_data_writer. Use raw2log to convert it to text.
   */
   void connect_measurement_output (string fn);
   void disconnect_measurement_output ();
@@ -175,25 +353,87 @@ public:
   void clear_steps ();
 
   // komplette Sequenzen hinzufügen
-  void add_ISO6789_steps (bool repeat_on_timing_violation);
+  // tare_zero_band: see tare_torque_tester_step, only used for the first tare
+  void add_ISO6789_steps (bool repeat_on_timing_violation, double tare_zero_band = 0);
 
   bool run ();
 
+  //! don't open created reports (batch runs without display)
+  void set_headless (bool h)
+  {
+    headless = h;
+  }
+
   //! set confirmation/acknowledge for steps which needs user feedback
   void set_confirmation();
+  //! release a confirmation which wasn't used by a step (replay of a recorded confirmation)
+  void reset_confirmation ();
+  //! apply an input of the user recorded in a USB capture, see usb_capture_replay::poll_host_event
+  void replay_capture_event (const vector<unsigned char> &e);
+
+  //! additional receiver of the sequencer events (see ttt_event_type)
+  void add_event_listener (cb_ttt_event *cb, void *user_data);
+  void remove_event_listener (cb_ttt_event *cb, void *user_data);
+
+  //! max. rate of indicated torque updates in Hz (default TTT_DISPLAY_RATE), 0 = every run
+  void set_display_rate (double hz);
+
+  /*!
+   * Motor driven test rig: preload and measurement steps start and stop the motor
+   * of the rig with a closed-loop ramp on the live torque (see motor_ramp) instead
+   * of instructing the user. Used from the next start_sequencer* on.
+   */
+  void set_motor_driven (bool m)
+  {
+    motor_driven = m;
+  }
 
   void start_sequencer (double temperature, double humidity);
   void start_sequencer_quick_check (double temperature, double humidity, double nominal_value);
   void start_sequencer_ISO6789 (double temperature, double humidity, bool repeat_on_timing_violation, bool repeat_on_tolerance_violation);
 
+  /*!
+   * Calibrate the test objects one after another without stopping the sequencer.
+   * The steps of all test objects are generated before the first one is started.
+   * Every test object gets its own measurement, the report of a finished test object
+   * is created in the background while the next one is measured (TTT_EVENT_RESULT
+   * is published when it's done). The tare of the TTT at the start of the next
+   * test object is skipped if the TTT still shows zero.
+   * The test person and torque tester are the same for all test objects.
+   */
+  void start_sequencer_ISO6789_batch (const vector<int> &test_object_ids,
+                                      double temperature, double humidity,
+                                      bool repeat_on_timing_violation, bool repeat_on_tolerance_violation);
+
+  /*!
+   * Continue a measurement which was interrupted by a crash or power cut
+   * (see find_unfinished_measurement) at the first unfinished step.
+   * Test person, test object and the accepted items are loaded from the database,
+   * the steps are regenerated. The TTT is tared before the next measurement.
+   */
+  void resume_sequencer (int measurement_id);
+
   void stop_sequencer ();
-  enum out_cmd sequencer_inout (double torque, bool confirmation);
+  //! stop_sequencer by the user, the measurement can't be resumed
+  void abort_sequencer ();
+  bool is_sequencer_paused ()
+  {
+    return sequencer_paused;
+  }
 
   void print_result ();
+  //! peaks and rise times of all meas_steps
+  void get_step_results (vector<step_result> &results);
   report_result ISO6789_report (string fn, int id, bool repeat_on_tolerance_violation);
 
   friend ostream& operator<<(ostream& os, const ttt& d);
 
+  //! execute SQL file on the database, for example to create an in-memory database
+  void exec_sql_file (string fn)
+  {
+    ::exec_sql_file (db, fn);
+  }
+
   //********* DATABASE INSERT ****************/
   int new_test_person (string name, string supervisor, double uncertainty)
   {
@@ -292,7 +532,21 @@ public:
     return adj_id;
   }
 
+  //! unfinished ISO 6789 measurement with the connected torque tester, 0 if there is none
+  int find_unfinished_measurement (int &test_person_id, int &test_object_id)
+  {
+    return ::find_unfinished_measurement (db, meas.tt.id, test_person_id, test_object_id);
+  }
+
+  //! don't offer the measurement for resume_sequencer again
+  void discard_measurement (int id)
+  {
+    set_measurement_state (db, id, "aborted");
+  }
+
   void load_torque_tester ();
+  // ttt_metadata_lookup for ttt_device, user_data is the ttt instance
+  static bool lookup_torque_tester (void *user_data, ttt_device_metadata &md);
 
   //******* test person **************/
 
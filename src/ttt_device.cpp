@@ -24,32 +24,84 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include "ttt_device.h"
 
-ttt_device::ttt_device ()
-  : scale(-1), uncertainty(-1), peak_level(-1), measuring(false), streaming(false),
-    old_autostop(-1)
+ttt_device::ttt_device (ttt_metadata_lookup lookup, void *lookup_data)
+  : metadata_lookup(lookup), metadata_lookup_data(lookup_data),
+    scale(-1), digits(-1), uncertainty(-1), peak_level(-1), measuring(false), streaming(false),
+    old_autostop(-1), ring(TTT_RING_SIZE), ring_overruns(0), next_index(0), data_ratio(1), motor_control(false), was_stopped(false),
+    external_events(false), acquisition_running(false), acquisition_failed(false),
+    acquisition_error_code(0), connected(true), device_left(false), device_arrived(false),
+    usb_device(0), hotplug(false), resume_measuring(false)
 {
   cout << "ttt_device c'tor" << endl;
   init ();
+  init_hotplug ();
 }
 
-ttt_device::ttt_device (string serial)
-  : al(serial), scale(-1), resolution(-1), uncertainty(-1), measuring(false), streaming(false)
+ttt_device::ttt_device (string serial, ttt_metadata_lookup lookup, void *lookup_data)
+  : al(serial), metadata_lookup(lookup), metadata_lookup_data(lookup_data),
+    scale(-1), digits(-1), resolution(-1), uncertainty(-1), measuring(false), streaming(false),
+    ring(TTT_RING_SIZE), ring_overruns(0), next_index(0), data_ratio(1), motor_control(false), was_stopped(false),
+    external_events(false), acquisition_running(false), acquisition_failed(false),
+    acquisition_error_code(0), connected(true), device_left(false), device_arrived(false),
+    usb_device(0), hotplug(false), resume_measuring(false)
 {
   cout << "ttt_device c'tor serial = " << serial << endl;
   init ();
+  init_hotplug ();
+}
+
+ttt_device::ttt_device (libusb_context* ctx, string serial, ttt_metadata_lookup lookup, void *lookup_data)
+  : al(ctx, serial), metadata_lookup(lookup), metadata_lookup_data(lookup_data),
+    scale(-1), digits(-1), resolution(-1), uncertainty(-1), peak_level(-1), measuring(false), streaming(false),
+    old_autostop(-1), ring(TTT_RING_SIZE), ring_overruns(0), next_index(0), data_ratio(1), motor_control(false), was_stopped(false),
+    external_events(true), acquisition_running(false), acquisition_failed(false),
+    acquisition_error_code(0), connected(true), device_left(false), device_arrived(false),
+    usb_device(0), hotplug(false), resume_measuring(false)
+{
+  cout << "ttt_device c'tor shared context, serial = " << serial << endl;
+
+  // the event thread of the shared context doesn't see virtual devices (ttt_emulator)
+  if (al.is_virtual_device ())
+    external_events = false;
+  init ();
+  init_hotplug ();
 }
 
 void ttt_device::init ()
 {
-  cout << "ttt_device::init clear_RX" << endl;
-  al.clear_RX (500);
-  cout << "ttt_device::init stop streaming and measurement" << endl;
+  // only wait until stale replies are drained, not a fixed 500ms
+  cout << "ttt_device::init drain_RX" << endl;
+  al.drain_RX (LIBALLURIS_DRAIN_IDLE_TIMEOUT, 500);
+  cout << "ttt_device::init stop streaming" << endl;
   al.set_cyclic_measurement (0, TTT_PACKET_SIZE);
-  //al.clear_RX (200);
-  al.stop_measurement ();
-  //al.clear_RX (200);
 
-  cout << "ttt_device::init set defaults (900Hz, no upper and no lower limit)" << endl;
+  init_settings ();
+  read_metadata ();
+
+  cout << "ttt_device::init" << endl;
+  cout << "  serial            = " << serial << endl;
+  cout << "  next_cal_date     = " << next_cal_date << endl;
+  cout << "  cal_date          = " << cal_date << endl;
+  cout << "  cal_number        = " << cal_number << endl;
+  cout << "  scale             = " << scale << endl;
+  cout << "  resolution        = " << resolution << endl;
+  cout << "  max_M             = " << max_M << endl;
+  cout << "  uncertainty (k=2) = " << uncertainty << endl;
+  cout << "  peak_level        = " << peak_level << endl;
+  cout << "  old_autostop      = " << old_autostop << endl;
+}
+
+// set defaults (900Hz, no upper and no lower limit)
+// Only measuring, memory mode and peak mode (one read_state) and autostop (read
+// anyway to restore it) are skipped if they already match. Key lock and data
+// ratio can't be read back, unit and limits only with one round trip each,
+// the same as the write, so these are always written.
+void ttt_device::init_settings ()
+{
+  liballuris_state state = al.read_state ();
+
+  if (state.measuring)
+    al.stop_measurement ();
 
   // lock keypad
   al.set_key_lock (1);
@@ -58,43 +110,81 @@ void ttt_device::init ()
   old_autostop = al.get_autostop ();
 
   // disable autostop
-  al.set_autostop (0);
+  if (old_autostop != 0)
+    al.set_autostop (0);
+
+  if (state.mem_active)
+    al.set_memory_mode (LIBALLURIS_MEM_MODE_DISABLED);
+
+  if (! state.some_peak_mode_active || state.peak_plus_active || state.peak_minus_active)
+    al.set_mode (LIBALLURIS_MODE_PEAK);
 
-  al.set_memory_mode (LIBALLURIS_MEM_MODE_DISABLED);
-  al.set_mode (LIBALLURIS_MODE_PEAK);
   al.set_unit (LIBALLURIS_UNIT_N);
   al.set_upper_limit (0);
   al.set_lower_limit (0);
 
-  serial = al.get_serial_number ();
-  scale = 1.0 / pow(10, al.get_digits ());
+  // a monitoring session which died may have left a decimation
+  al.set_data_ratio (data_ratio);
+
+  if (motor_control)
+    al.set_motor_start (1);
+}
 
+// serial and next_cal_date are always read, the remaining calibration data
+// only if metadata_lookup doesn't know this calibration
+void ttt_device::read_metadata ()
+{
+  serial = al.get_serial_number ();
   next_cal_date = al.get_next_calibration_date ();
-  cal_date = al.get_calibration_date ();
-  cal_number = al.get_calibration_number ();
 
-  max_M = al.get_F_max ();
-  uncertainty = al.get_uncertainty ();
-  peak_level = al.get_peak_level ();
-  resolution = pow(10, -al.get_digits ()) * al.get_resolution ();
+  ttt_device_metadata md;
+  md.serial = serial;
+  md.next_cal_date = next_cal_date;
+  md.digits = -1;
 
-  cout << "ttt_device::init" << endl;
-  cout << "  serial            = " << serial << endl;
-  cout << "  next_cal_date     = " << next_cal_date << endl;
-  cout << "  cal_date          = " << cal_date << endl;
-  cout << "  cal_number        = " << cal_number << endl;
-  cout << "  scale             = " << scale << endl;
-  cout << "  resolution        = " << resolution << endl;
-  cout << "  max_M             = " << max_M << endl;
-  cout << "  uncertainty (k=2) = " << uncertainty << endl;
-  cout << "  peak_level        = " << peak_level << endl;
-  cout << "  old_autostop      = " << old_autostop << endl;
+  if (metadata_lookup && metadata_lookup (metadata_lookup_data, md) && md.digits >= 0)
+    {
+      cout << "ttt_device::read_metadata using cached calibration data" << endl;
+      cal_date = md.cal_date;
+      cal_number = md.cal_number;
+      max_M = md.max_M;
+      uncertainty = md.uncertainty;
+      digits = md.digits;
+      resolution = md.resolution;
+    }
+  else
+    {
+      cal_date = al.get_calibration_date ();
+      cal_number = al.get_calibration_number ();
+      max_M = al.get_F_max ();
+      uncertainty = al.get_uncertainty ();
+      digits = al.get_digits ();
+      resolution = pow(10, -digits) * al.get_resolution ();
+    }
+  scale = 1.0 / pow(10, digits);
+
+  // peak_level is a setting and may be changed on the device
+  peak_level = al.get_peak_level ();
 }
 
 ttt_device::~ttt_device ()
 {
+  al.deregister_hotplug ();
+  if (! connected)
+    {
+      cout << "ttt_device d'tor: TTT is disconnected, settings can't be restored" << endl;
+      return;
+    }
+
   stop ();
   al.set_key_lock (0);
+  if (data_ratio != 1)
+    al.set_data_ratio (1);
+  if (motor_control)
+    {
+      al.set_motor_stopp (1);
+      al.set_motor_start (0);
+    }
 
   // if the value for autostop was lost, use a default of 3s
   if (old_autostop == 0)
@@ -118,18 +208,14 @@ void ttt_device::start ()
     {
       // enable streaming
       cout << "ttt_device::start: start streaming" << endl;
-      al.set_cyclic_measurement (1, TTT_PACKET_SIZE);
-      streaming = true;
+      start_acquisition ();
     }
 }
 
 void ttt_device::stop ()
 {
   if (streaming)
-    {
-      al.set_cyclic_measurement (0, TTT_PACKET_SIZE);
-      streaming = false;
-    }
+    stop_acquisition ();
 
   if (measuring)
     {
@@ -138,38 +224,286 @@ void ttt_device::stop ()
     }
 }
 
+void ttt_device::set_data_ratio (int ratio)
+{
+  if (ratio < 1 || ratio > 255)
+    throw runtime_error ("ttt_device::set_data_ratio: ratio out of range 1..255");
+  if (streaming)
+    throw runtime_error ("ttt_device::set_data_ratio: not possible while streaming");
+
+  cout << "ttt_device::set_data_ratio (" << ratio << ")" << endl;
+  al.set_data_ratio (ratio);
+  data_ratio = ratio;
+}
+
 void ttt_device::tare ()
 {
   cout << "ttt_device::tare ()" << endl;
 
-  bool was_streaming = streaming;
-  if (streaming)
+  try
     {
-      cout << "ttt_device::tare stop streaming ()" << endl;
-      al.set_cyclic_measurement (0, TTT_PACKET_SIZE);
-      streaming = false;
+      bool was_streaming = streaming;
+      if (streaming)
+        {
+          cout << "ttt_device::tare stop streaming ()" << endl;
+          stop_acquisition ();
+        }
+
+      al.tare ();
+
+      if (was_streaming)
+        {
+          // re-enable streaming
+          cout << "ttt_device::tare start streaming ()" << endl;
+          start_acquisition ();
+        }
+    }
+  catch (liballuris_exception &e)
+    {
+      if (! liballuris::is_disconnect_error (e.code))
+        throw;
+      set_disconnected ();
     }
+}
 
-  al.tare ();
+void ttt_device::set_motor_control (bool enable)
+{
+  cout << "ttt_device::set_motor_control (" << enable << ")" << endl;
+  al.set_motor_start (enable ? 1 : 0);
+  motor_control = enable;
+}
 
-  if (was_streaming)
+void ttt_device::motor (ttt_motor_command c)
+{
+  try
     {
-      // re-enable streaming
-      cout << "ttt_device::tare start streaming ()" << endl;
-      al.set_cyclic_measurement (1, TTT_PACKET_SIZE);
-      streaming = true;
+      switch (c)
+        {
+        case TTT_MOTOR_START:
+          al.set_motor_start (2);
+          break;
+        case TTT_MOTOR_STOP:
+          al.set_motor_stopp (1);
+          break;
+        case TTT_MOTOR_RETURN:
+          al.set_motor_stopp (1);
+          al.start_motor_reference_run (1);
+          break;
+        }
+    }
+  catch (liballuris_exception &e)
+    {
+      if (! liballuris::is_disconnect_error (e.code))
+        throw;
+      set_disconnected ();
     }
 }
 
-vector<double> ttt_device::poll_measurement ()
+void ttt_device::start_acquisition ()
+{
+  // keep the sample index monotonic and close to real time over a
+  // stop/start (for example while tare) using the elapsed time
+  if (was_stopped)
+    {
+      chrono::duration<double> gap = chrono::steady_clock::now () - stop_time;
+      next_index += lround (gap.count () * TTT_SPS);
+    }
+
+  al.set_expected_sample_rate (double (TTT_SPS) / data_ratio);
+  al.start_streaming (TTT_PACKET_SIZE, stream_sink, this);
+  streaming = true;
+
+  acquisition_failed = false;
+  if (! external_events)
+    {
+      acquisition_running = true;
+      acquisition = thread (&ttt_device::acquisition_loop, this);
+    }
+}
+
+void ttt_device::stop_acquisition ()
+{
+  acquisition_running = false;
+  if (acquisition.joinable ())
+    acquisition.join ();
+
+  streaming = false;
+  was_stopped = true;
+  stop_time = chrono::steady_clock::now ();
+  if (ring_overruns)
+    cerr << "ttt_device: " << ring_overruns << " samples lost because poll_measurement wasn't called in time" << endl;
+  al.stop_streaming ();
+}
+
+void ttt_device::acquisition_loop ()
+{
+  try
+    {
+      while (acquisition_running)
+        al.handle_stream_events (100);
+    }
+  catch (liballuris_exception &e)
+    {
+      // rethrown from poll_measurement in the consumer thread
+      // or handled as disconnect
+      acquisition_error = e.what ();
+      acquisition_error_code = e.code;
+      acquisition_failed = true;
+    }
+}
+
+void ttt_device::stream_sink (void *user_data, const int *values, size_t num_values)
+{
+  ttt_device *p = static_cast<ttt_device *> (user_data);
+  for (size_t k=0; k<num_values; ++k)
+    {
+      // lost samples still advance the index
+      ttt_sample s;
+      s.index = p->next_index + k * p->data_ratio;
+      s.raw = values[k];
+      if (! p->ring.push (s))
+        p->ring_overruns++;
+    }
+  p->next_index += num_values * p->data_ratio;
+}
+
+vector<ttt_sample> ttt_device::poll_samples ()
 {
   // don't check if measurement is running.
   // returns an empty vector if not.
-  vector<int> tmp = al.poll_measurement_no_wait ();
-  //cout << "ttt_device::poll_measurement got " << tmp.size () << " samples" << endl;
+  if (acquisition_failed && connected)
+    {
+      if (! liballuris::is_disconnect_error (acquisition_error_code))
+        throw runtime_error (acquisition_error);
+      set_disconnected ();
+    }
+  if (external_events && connected)
+    {
+      if (liballuris::is_disconnect_error (al.stream_error ()))
+        set_disconnected ();
+      else
+        al.check_stream ();
+    }
+
+  vector<ttt_sample> tmp;
+  ring.pop_all (tmp);
+  //cout << "ttt_device::poll_samples got " << tmp.size () << " samples" << endl;
+  return tmp;
+}
+
+vector<double> ttt_device::poll_measurement ()
+{
+  vector<ttt_sample> tmp = poll_samples ();
 
   std::vector<double> samples;
   for (unsigned int k=0; k<tmp.size (); ++k)
-    samples.push_back (tmp[k] * scale);
+    samples.push_back (tmp[k].raw * scale);
   return samples;
 }
+
+void ttt_device::init_hotplug ()
+{
+  usb_device = al.get_device ();
+  hotplug = al.register_hotplug (hotplug_cb, this);
+  if (! hotplug)
+    cout << "ttt_device: no hotplug support, a disconnected TTT is searched every "
+         << TTT_RECONNECT_INTERVAL << "s" << endl;
+}
+
+int LIBUSB_CALL ttt_device::hotplug_cb (libusb_context *, libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+  // called from libusb event handling, no synchronous transfers allowed here
+  ttt_device *p = static_cast<ttt_device *> (user_data);
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT && dev == p->usb_device)
+    p->device_left = true;
+  else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+    p->device_arrived = true;
+  return 0;
+}
+
+void ttt_device::set_disconnected ()
+{
+  if (! connected)
+    return;
+
+  cerr << "ttt_device: TTT " << serial << " disconnected" << endl;
+  connected = false;
+  usb_device = 0;
+  resume_measuring = measuring;
+
+  // the stream is released in liballuris::reopen
+  acquisition_running = false;
+  if (acquisition.joinable ())
+    acquisition.join ();
+  if (streaming)
+    {
+      streaming = false;
+      was_stopped = true;
+      stop_time = chrono::steady_clock::now ();
+    }
+  measuring = false;
+  last_reconnect = chrono::steady_clock::now ();
+}
+
+bool ttt_device::check_connection ()
+{
+  if (connected)
+    {
+      if (device_left)
+        set_disconnected ();
+      return connected;
+    }
+
+  // without acquisition thread nobody else dispatches the hotplug events of our context
+  if (hotplug && ! external_events)
+    {
+      try
+        {
+          al.handle_events (0);
+        }
+      catch (std::runtime_error &e)
+        {
+          cerr << "ttt_device::check_connection: " << e.what () << endl;
+        }
+    }
+
+  chrono::duration<double> dt = chrono::steady_clock::now () - last_reconnect;
+  if (device_arrived || dt.count () > TTT_RECONNECT_INTERVAL)
+    return reconnect ();
+  return false;
+}
+
+bool ttt_device::reconnect ()
+{
+  device_arrived = false;
+  device_left = false;
+  last_reconnect = chrono::steady_clock::now ();
+
+  // autostop was disabled by the first init, keep the value which has to be restored
+  int saved_autostop = old_autostop;
+  bool resume = resume_measuring;
+  try
+    {
+      al.reopen (serial);
+      init ();
+      old_autostop = saved_autostop;
+      usb_device = al.get_device ();
+      if (resume)
+        start ();
+      connected = true;
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << "ttt_device::reconnect failed: " << e.what () << endl;
+      old_autostop = saved_autostop;
+
+      // cleanup a partially started measurement
+      connected = true;
+      set_disconnected ();
+      resume_measuring = resume;
+      return false;
+    }
+
+  cout << "ttt_device: TTT " << serial << " reconnected" << endl;
+  return true;
+}
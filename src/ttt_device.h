@@ -32,22 +32,74 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <stdexcept>
 #include <libintl.h>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "config.h"
 #include "liballuris++.h"
+#include "spsc_ring.h"
 
 using namespace std;
 
 #define TTT_SERIAL_LEN 30
 #define TTT_PACKET_SIZE 19
 
+//! raw sample with its position in the stream
+struct ttt_sample
+{
+  unsigned long index;  //!< sample number, derived from the packet sequence. time = index / TTT_SPS
+  int raw;              //!< raw count, multiply with get_scale () to get Nm
+};
+
+//! calibration data which doesn't change until the next calibration
+struct ttt_device_metadata
+{
+  string serial;
+  string next_cal_date;
+  string cal_date;
+  string cal_number;
+  double max_M;
+  double uncertainty;
+  double resolution;
+  int digits;
+};
+
+/*!
+ * Lookup cached metadata, for example from the torque_tester table.
+ * serial and next_cal_date are already filled. Return true if the other fields could be filled.
+ */
+typedef bool (*ttt_metadata_lookup) (void *user_data, ttt_device_metadata &md);
+
+// capacity of the sample ring between acquisition thread and poll_measurement (approx. 72s at 900Hz)
+#define TTT_RING_SIZE (1 << 16)
+
+// while disconnected, try to reopen the device every TTT_RECONNECT_INTERVAL s
+// (immediately if a hotplug event reports an attached device)
+#define TTT_RECONNECT_INTERVAL 1.0
+
+//! commands for the motor of a test rig (FMT-W20/W40 or FMI with FMT-200M), see ttt_device::motor
+enum ttt_motor_command
+{
+  TTT_MOTOR_START,    //!< load, liballuris_set_motor_start (2)
+  TTT_MOTOR_STOP,     //!< stop and hold the position
+  TTT_MOTOR_RETURN    //!< stop and return to the reference position, this releases the load
+};
+
 class ttt_device
 {
 private:
   liballuris al;
 
+  ttt_metadata_lookup metadata_lookup;
+  void *metadata_lookup_data;
+
   void init ();
+  void init_settings ();
+  void read_metadata ();
 
   // settings
   double scale;
+  int digits;
   double resolution;
   double max_M;
   string serial;
@@ -60,9 +112,48 @@ private:
   bool streaming;
   int old_autostop; // in s
 
+  // raw samples, filled from stream_sink in the acquisition thread
+  spsc_ring<ttt_sample> ring;
+  unsigned long ring_overruns;
+  unsigned long next_index;
+  int data_ratio;     // device side decimation, every sample advances the index by data_ratio
+  bool motor_control; // the host starts the motor of the test rig, see set_motor_control
+  bool was_stopped;
+  chrono::steady_clock::time_point stop_time;
+  static void stream_sink (void *user_data, const int *values, size_t num_values);
+
+  // the acquisition thread handles the stream events
+  // if external_events is set, another thread handles the events of the shared libusb context
+  // (see ttt_device_manager) and there is no acquisition thread
+  bool external_events;
+  thread acquisition;
+  atomic<bool> acquisition_running;
+  atomic<bool> acquisition_failed;
+  string acquisition_error;
+  int acquisition_error_code;
+  void start_acquisition ();
+  void stop_acquisition ();
+  void acquisition_loop ();
+
+  // USB disconnect and reattach (see check_connection)
+  atomic<bool> connected;
+  atomic<bool> device_left;
+  atomic<bool> device_arrived;
+  atomic<libusb_device*> usb_device;
+  bool hotplug;
+  bool resume_measuring;
+  chrono::steady_clock::time_point last_reconnect;
+  static int LIBUSB_CALL hotplug_cb (libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data);
+  void init_hotplug ();
+  void set_disconnected ();
+  bool reconnect ();
+
 public:
-  ttt_device ();
-  ttt_device (string serial);
+  // lookup (optional) is used to skip reading the calibration data if it's cached
+  ttt_device (ttt_metadata_lookup lookup = 0, void *lookup_data = 0);
+  ttt_device (string serial, ttt_metadata_lookup lookup = 0, void *lookup_data = 0);
+  // open device with serial on a shared libusb context, the events are handled by the caller
+  ttt_device (libusb_context* ctx, string serial, ttt_metadata_lookup lookup = 0, void *lookup_data = 0);
   ~ttt_device ();
 
   void check_error (int err);
@@ -122,10 +213,69 @@ public:
     return resolution;
   }
 
+  double get_scale ()
+  {
+    return scale;
+  }
+
+  int get_digits ()
+  {
+    return digits;
+  }
+
+  /*!
+   * Device side decimation for long monitoring (see ttt_monitor), only while not streaming.
+   * The TTT sends every ratio-th sample (no filtering), the sample index keeps counting
+   * in 1/TTT_SPS, so index / TTT_SPS is still the time. 1 = no decimation.
+   */
+  void set_data_ratio (int ratio);
+  int get_data_ratio ()
+  {
+    return data_ratio;
+  }
+
   void start ();
   void stop ();
+  // a disconnect while tare doesn't throw, check is_connected () afterwards
   void tare ();
+
+  /*!
+   * Motor driven test rig: with enable the motor doesn't start with the measurement
+   * but is controlled with motor (). Kept over a reconnect, disabled in the d'tor.
+   */
+  void set_motor_control (bool enable);
+  bool get_motor_control ()
+  {
+    return motor_control;
+  }
+  // also while streaming, the reply is taken from the stream. A disconnect doesn't throw
+  void motor (ttt_motor_command c);
+
+  bool is_connected ()
+  {
+    return connected;
+  }
+
+  /*!
+   * Call cyclic (for example from ttt::run). Returns true if the TTT is connected.
+   * After a disconnect the same serial is reopened with the normal bring-up (init)
+   * and a running measurement is restarted. The sample index continues with the
+   * elapsed time so the gap is visible.
+   */
+  bool check_connection ();
+  vector<ttt_sample> poll_samples ();
   vector<double> poll_measurement ();
+
+  // USB transport metrics (latencies, errors, estimated lost samples while streaming)
+  liballuris_metrics get_usb_metrics ()
+  {
+    return al.get_metrics ();
+  }
+
+  void print_usb_metrics ()
+  {
+    al.print_metrics (stderr);
+  }
 };
 
 #endif
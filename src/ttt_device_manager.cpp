@@ -0,0 +1,119 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_device_manager: several TTTs on one shared libusb context
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ttt_device_manager.h"
+#include <algorithm>
+
+ttt_device_manager::ttt_device_manager ()
+  : usb_ctx (0), events_running (false)
+{
+  int r = libusb_init (&usb_ctx);
+  if (r)
+    throw runtime_error (string ("ttt_device_manager: libusb_init failed: ") + liballuris_error_name (r));
+
+  // libusb allows event handling in one thread while others do synchronous transfers
+  events_running = true;
+  event_thread = thread (&ttt_device_manager::event_loop, this);
+}
+
+ttt_device_manager::~ttt_device_manager ()
+{
+  // stop streams while the event thread still runs
+  for (unsigned int k=0; k<devices.size (); ++k)
+    delete devices[k];
+  devices.clear ();
+
+  events_running = false;
+  if (event_thread.joinable ())
+    event_thread.join ();
+  libusb_exit (usb_ctx);
+}
+
+void ttt_device_manager::event_loop ()
+{
+  while (events_running)
+    {
+      struct timeval tv = {0, 100000};
+      int r = libusb_handle_events_timeout_completed (usb_ctx, &tv, NULL);
+      if (r && r != LIBUSB_ERROR_INTERRUPTED)
+        cerr << "ttt_device_manager::event_loop: " << liballuris_error_name (r) << endl;
+    }
+}
+
+vector<string> ttt_device_manager::list_serials ()
+{
+  struct alluris_device_description devs[MAX_NUM_DEVICES];
+  vector<string> ret;
+
+  int r = liballuris_get_device_list (usb_ctx, devs, MAX_NUM_DEVICES, 1);
+  if (r)
+    throw runtime_error (string ("ttt_device_manager: liballuris_get_device_list failed: ") + liballuris_error_name (r));
+
+  for (int k=0; k<MAX_NUM_DEVICES && devs[k].dev; ++k)
+    ret.push_back (devs[k].serial_number);
+  liballuris_free_device_list (devs, MAX_NUM_DEVICES);
+
+  return ret;
+}
+
+ttt_device* ttt_device_manager::open (string serial)
+{
+  ttt_device *d = new ttt_device (usb_ctx, serial);
+
+  lock_guard<mutex> lock (devices_mutex);
+  devices.push_back (d);
+  return d;
+}
+
+vector<ttt_device *> ttt_device_manager::open_all ()
+{
+  vector<string> serials = list_serials ();
+  vector<ttt_device *> ret;
+
+  for (unsigned int k=0; k<serials.size (); ++k)
+    {
+      bool is_open = false;
+      {
+        lock_guard<mutex> lock (devices_mutex);
+        for (unsigned int i=0; i<devices.size () && ! is_open; ++i)
+          is_open = (devices[i]->get_serial () == serials[k]);
+      }
+
+      if (! is_open)
+        ret.push_back (open (serials[k]));
+    }
+  return ret;
+}
+
+void ttt_device_manager::close (ttt_device *dev)
+{
+  {
+    lock_guard<mutex> lock (devices_mutex);
+    vector<ttt_device *>::iterator it = find (devices.begin (), devices.end (), dev);
+    if (it == devices.end ())
+      throw runtime_error ("ttt_device_manager::close: device wasn't opened with this manager");
+    devices.erase (it);
+  }
+  delete dev;
+}
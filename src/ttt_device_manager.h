@@ -0,0 +1,80 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_device_manager: several TTTs on one shared libusb context
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TTT_DEVICE_MANAGER_H
+#define TTT_DEVICE_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include "ttt_device.h"
+
+using namespace std;
+
+/*
+ * One libusb context and one event thread for all devices.
+ * Every ttt_device streams into its own ring, the event thread is the only producer,
+ * so each device can be polled from its own sequencer (ttt instance).
+ *
+ * The manager owns the devices, they are deleted in the d'tor.
+ */
+class ttt_device_manager
+{
+private:
+  libusb_context* usb_ctx;
+  vector<ttt_device *> devices;
+  mutex devices_mutex;
+
+  thread event_thread;
+  atomic<bool> events_running;
+  void event_loop ();
+
+public:
+  ttt_device_manager ();
+  ~ttt_device_manager ();
+
+  /*!
+   * serials of all connected Alluris devices
+   * This talks to every device, so call it before the measurements are started.
+   */
+  vector<string> list_serials ();
+
+  //! open device with serial, empty serial opens the first device
+  ttt_device* open (string serial);
+
+  //! open all connected devices which aren't opened yet (see list_serials)
+  vector<ttt_device *> open_all ();
+
+  //! stop and delete a device opened with open ()
+  void close (ttt_device *dev);
+
+  size_t size ()
+  {
+    return devices.size ();
+  }
+};
+
+#endif
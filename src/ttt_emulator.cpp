@@ -0,0 +1,641 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_emulator: software TTT behind the liballuris transport for tests without hardware
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ttt_emulator.h"
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+
+// a real TTT can't buffer more, older packets are lost if the host doesn't read them
+#define TTT_EMULATOR_MAX_BACKLOG 32
+
+// torque history of the motor test rig in samples (more than the backlog)
+#define TTT_EMULATOR_RIG_HISTORY (10 * TTT_EMULATOR_SPS)
+
+ttt_emulator_config::ttt_emulator_config ()
+  : serial ("L.23451"), firmware ("V5.05.003"), next_cal_date (1701), cal_date (123),
+    cal_number ("calnumber fillme"), uncertainty (0.005), digits (2), resolution (1), F_max (10),
+    jitter (0), packet_loss (0), motor_rate (0), click_torque (0), log_start (0)
+{
+}
+
+ttt_emulator::ttt_emulator (string log_fn, const ttt_emulator_config &c)
+  : cfg (c), log (0), handle (0),
+    measuring (false), mode (LIBALLURIS_MODE_PEAK), mem_mode (LIBALLURIS_MEM_MODE_DISABLED), unit (LIBALLURIS_UNIT_N),
+    peak_level (3), autostop (3), key_lock (0), data_ratio (0), digout (0), buzzer (0),
+    upper_limit (0), lower_limit (0), tare_offset (0), pos_peak (0), neg_peak (0),
+    cyclic (false), packet_length (19), clock_started (false), next_sample (0), next_jitter (0),
+    packets_sent (0), packets_lost (0), uniform (0.0, 1.0),
+    motor_start_mode (0), motor_disabled (false), motor_running (false), motor_returning (false),
+    clicked (false), rig_torque (0), rig_sample (0), rig_first (0)
+{
+  if (cfg.serial.size () < 3 || cfg.serial[0] < 'A' || cfg.serial[0] > 'Z' || cfg.serial[1] != '.')
+    throw runtime_error ("ttt_emulator: serial has to look like 'L.23451'");
+
+  if (cfg.cal_number.size () > 40)
+    throw runtime_error ("ttt_emulator: cal_number is longer than 40 chars");
+
+  // PIC flash organisation, see liballuris_get_calibration_number
+  memset (flash, 0, sizeof (flash));
+  flash[0] = cfg.cal_date;
+  memcpy (flash + 1, &cfg.uncertainty, sizeof (double));
+  memcpy (flash + 5, cfg.cal_number.c_str (), cfg.cal_number.size ());
+
+  if (! log_fn.empty ())
+    log = new raw_log_reader (log_fn);
+
+  int r = liballuris_add_virtual_device (cfg.serial.c_str (), transfer_cb, this, &handle);
+  if (r)
+    {
+      delete log;
+      throw runtime_error (string ("ttt_emulator: liballuris_add_virtual_device failed: ") + liballuris_error_name (r));
+    }
+
+  cout << "ttt_emulator c'tor serial = " << cfg.serial << ", log = '" << log_fn
+       << "', log_start = " << cfg.log_start << "s, jitter = " << cfg.jitter << "s, packet_loss = " << cfg.packet_loss << endl;
+}
+
+ttt_emulator::~ttt_emulator ()
+{
+  cout << "ttt_emulator d'tor: " << packets_sent << " packets sent, " << packets_lost << " lost" << endl;
+  liballuris_remove_virtual_device (handle);
+  delete log;
+}
+
+void ttt_emulator::set_memory (const vector<int> &values)
+{
+  lock_guard<mutex> lock (mtx);
+  memory = values;
+}
+
+void ttt_emulator::set_click_torque (double t)
+{
+  lock_guard<mutex> lock (mtx);
+  cfg.click_torque = t;
+}
+
+bool ttt_emulator::confirmation ()
+{
+  lock_guard<mutex> lock (mtx);
+  if (! log || log->size () == 0 || cfg.motor_rate > 0 || ! clock_started)
+    return false;
+
+  vector<double> torque;
+  vector<bool> c;
+  log->read (log_sample (current_sample ()), 1, torque, &c);
+  return c.size () && c[0];
+}
+
+bool ttt_emulator::end_of_log ()
+{
+  lock_guard<mutex> lock (mtx);
+  if (! log || log->size () == 0 || cfg.motor_rate > 0)
+    return false;
+  return current_sample () + size_t (cfg.log_start * TTT_EMULATOR_SPS) >= log->size ();
+}
+
+void ttt_emulator::advance_rig (size_t sample)
+{
+  double dt = 1.0 / TTT_EMULATOR_SPS;
+  while (rig_sample <= sample)
+    {
+      if (motor_running && ! clicked)
+        {
+          rig_torque += cfg.motor_rate * dt;
+          if (cfg.click_torque > 0 && rig_torque >= cfg.click_torque)
+            {
+              clicked = true;
+              rig_torque = 0.3 * cfg.click_torque;
+            }
+        }
+      else if (motor_returning)
+        {
+          // the return run is faster than loading
+          rig_torque -= 4 * cfg.motor_rate * dt;
+          if (rig_torque <= 0)
+            {
+              rig_torque = 0;
+              motor_returning = false;
+              clicked = false;
+            }
+        }
+      rig_history.push_back (rig_torque);
+      rig_sample++;
+      if (rig_history.size () > TTT_EMULATOR_RIG_HISTORY)
+        {
+          rig_history.pop_front ();
+          rig_first++;
+        }
+    }
+}
+
+double ttt_emulator::rig_torque_at (size_t sample)
+{
+  advance_rig (sample);
+  if (sample < rig_first)
+    return rig_history.front ();
+  return rig_history[sample - rig_first];
+}
+
+int ttt_emulator::transfer_cb (void* user_data, unsigned char endpoint,
+                               unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  ttt_emulator *e = static_cast<ttt_emulator *> (user_data);
+  if (endpoint & LIBUSB_ENDPOINT_IN)
+    return e->receive (data, length, transferred, timeout);
+
+  lock_guard<mutex> lock (e->mtx);
+  e->handle_command (data, length);
+  *transferred = length;
+  return LIBUSB_SUCCESS;
+}
+
+// same semantics as libusb_interrupt_transfer on the IN endpoint: replies first,
+// then streaming packets which are due, timeout 0 waits forever
+int ttt_emulator::receive (unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  using namespace chrono;
+  steady_clock::time_point deadline = steady_clock::now () + milliseconds (timeout);
+  *transferred = 0;
+
+  unique_lock<mutex> lock (mtx);
+  while (1)
+    {
+      vector<unsigned char> packet;
+      if (! replies.empty ())
+        {
+          packet = replies.front ();
+          replies.pop_front ();
+        }
+
+      steady_clock::time_point now = steady_clock::now ();
+      steady_clock::time_point wake = now + milliseconds (100);
+      if (packet.empty () && cyclic)
+        {
+          steady_clock::time_point due = packet_due ();
+          if (now >= due)
+            {
+              if (! make_packet (packet))
+                continue;
+            }
+          else if (due < wake)
+            wake = due;
+        }
+
+      if (! packet.empty ())
+        {
+          if ((int) packet.size () > length)
+            return LIBUSB_ERROR_OVERFLOW;
+          memcpy (data, packet.data (), packet.size ());
+          *transferred = packet.size ();
+          return LIBUSB_SUCCESS;
+        }
+
+      if (timeout)
+        {
+          if (now >= deadline)
+            return LIBUSB_ERROR_TIMEOUT;
+          if (deadline < wake)
+            wake = deadline;
+        }
+
+      lock.unlock ();
+      this_thread::sleep_until (wake);
+      lock.lock ();
+    }
+}
+
+size_t ttt_emulator::current_sample ()
+{
+  if (! clock_started)
+    return 0;
+  chrono::duration<double> t = chrono::steady_clock::now () - t0;
+  return t.count () * TTT_EMULATOR_SPS;
+}
+
+size_t ttt_emulator::log_sample (size_t sample)
+{
+  return (sample + size_t (cfg.log_start * TTT_EMULATOR_SPS)) % log->size ();
+}
+
+// raw value of one sample without tare
+int ttt_emulator::raw_value (size_t sample)
+{
+  if (cfg.motor_rate > 0)
+    return lround (rig_torque_at (sample) * pow (10, cfg.digits));
+  if (! log || log->size () == 0)
+    return 0;
+
+  vector<double> torque;
+  log->read (log_sample (sample), 1, torque);
+  return lround (torque[0] * pow (10, cfg.digits));
+}
+
+chrono::steady_clock::time_point ttt_emulator::packet_due ()
+{
+  // the packet is sent after its last sample was measured
+  double t = double (next_sample + packet_length * ratio ()) / TTT_EMULATOR_SPS + next_jitter;
+  return t0 + chrono::duration_cast<chrono::steady_clock::duration> (chrono::duration<double> (t));
+}
+
+// returns false if the packet was lost
+bool ttt_emulator::make_packet (vector<unsigned char> &packet)
+{
+  size_t span = packet_length * ratio ();
+  size_t backlog = TTT_EMULATOR_MAX_BACKLOG * span;
+  size_t now = current_sample ();
+  if (now > next_sample + backlog)
+    {
+      size_t skip = (now - next_sample - backlog) / span;
+      next_sample += skip * span;
+      packets_lost += skip;
+    }
+
+  bool lost = uniform (rng) < cfg.packet_loss;
+  if (! lost)
+    {
+      vector<double> torque;
+      if (cfg.motor_rate > 0)
+        for (size_t k = 0; k < span; ++k)
+          torque.push_back (rig_torque_at (next_sample + k));
+      else if (log && log->size ())
+        {
+          size_t first = log_sample (next_sample);
+          log->read (first, span, torque);
+          if (torque.size () < span)
+            {
+              // wrap around at the end of the log
+              vector<double> rest;
+              log->read (0, span - torque.size (), rest);
+              torque.insert (torque.end (), rest.begin (), rest.end ());
+            }
+        }
+      torque.resize (span, 0);
+
+      double f = pow (10, cfg.digits);
+      packet.assign (5, 0);
+      packet[0] = 0x02;
+      packet[1] = 5 + packet_length * 3;
+      for (size_t k = 0; k < packet_length; ++k)
+        {
+          // data_ratio: every ratio-th sample without filtering
+          int v = lround (torque[k * ratio ()] * f) - tare_offset;
+          if (v > pos_peak)
+            pos_peak = v;
+          if (v < neg_peak)
+            neg_peak = v;
+          packet.push_back (v & 0xFF);
+          packet.push_back ((v >> 8) & 0xFF);
+          packet.push_back ((v >> 16) & 0xFF);
+        }
+      packets_sent++;
+    }
+  else
+    packets_lost++;
+
+  next_sample += span;
+  next_jitter = cfg.jitter * uniform (rng);
+  return ! lost;
+}
+
+// see struct liballuris_state
+int ttt_emulator::state_bits ()
+{
+  int s = 0;
+  if (mode != LIBALLURIS_MODE_STANDARD)
+    s |= 1 << 3;
+  if (mode == LIBALLURIS_MODE_PEAK_MAX)
+    s |= 1 << 4;
+  if (mode == LIBALLURIS_MODE_PEAK_MIN)
+    s |= 1 << 5;
+  if (mem_mode != LIBALLURIS_MEM_MODE_DISABLED)
+    s |= 1 << 13;
+  if (mem_mode == LIBALLURIS_MEM_MODE_CONTINUOUS)
+    s |= 1 << 14;
+  if (measuring)
+    s |= 1 << 23;
+  return s;
+}
+
+void ttt_emulator::reply (unsigned char cmd, const vector<unsigned char> &payload)
+{
+  vector<unsigned char> r;
+  r.push_back (cmd);
+  r.push_back (2 + payload.size ());
+  r.insert (r.end (), payload.begin (), payload.end ());
+  replies.push_back (r);
+}
+
+void ttt_emulator::reply_int24 (unsigned char cmd, unsigned char sub, int v)
+{
+  vector<unsigned char> p;
+  p.push_back (sub);
+  p.push_back (v & 0xFF);
+  p.push_back ((v >> 8) & 0xFF);
+  p.push_back ((v >> 16) & 0xFF);
+  reply (cmd, p);
+}
+
+static int int24 (const unsigned char *p)
+{
+  int v = p[0] | (p[1] << 8) | (p[2] << 16);
+  if (v > 8388607)
+    v -= 16777216;
+  return v;
+}
+
+// the command set is described in liballuris.c
+void ttt_emulator::handle_command (const unsigned char *out, int len)
+{
+  if (len < 2 || out[1] != len)
+    {
+      cerr << "ttt_emulator: malformed command, len = " << len << endl;
+      return;
+    }
+
+  unsigned char cmd = out[0];
+  unsigned char arg = (len > 2) ? out[2] : 0;
+  int *setting = 0;
+
+  switch (cmd)
+    {
+    case 0x08:    // device information
+    {
+      int v = -1;
+      switch (arg)
+        {
+        case 0:
+        case 1:
+        {
+          int major = 0, minor = 0, build = 0;
+          sscanf (cfg.firmware.c_str (), "V%d.%d.%d", &major, &minor, &build);
+          if (arg == 1 && measuring)
+            major = minor = build = 255;
+          v = build | (minor << 8) | (major << 16);
+          break;
+        }
+        case 2:
+          v = cfg.F_max;
+          break;
+        case 3:
+          v = cfg.digits;
+          break;
+        case 4:
+          v = LIBALLURIS_VARIANT_TTT_300;
+          break;
+        case 5:
+          v = memory.size ();
+          break;
+        case 6:
+          v = atoi (cfg.serial.c_str () + 2) | ((cfg.serial[0] - 'A') << 16);
+          break;
+        case 7:
+          v = cfg.next_cal_date;
+          break;
+        case 15:
+          v = ! motor_disabled;
+          break;
+        case 16:
+          v = cfg.resolution;
+          break;
+        }
+      // measurement processor is busy
+      if (measuring && (arg == 2 || arg == 3 || arg == 4 || arg == 7))
+        v = -1;
+      if (measuring && arg == 6)
+        v = 0xFFFF;
+      reply_int24 (cmd, arg, v);
+      break;
+    }
+    case 0x72:    // read flash
+    {
+      int adr = out[2] | (out[3] << 8);
+      unsigned short w = (adr < 25) ? flash[adr] : 0xFFFF;
+      vector<unsigned char> p (out + 2, out + 4);
+      p.push_back (w & 0xFF);
+      p.push_back (w >> 8);
+      reply (cmd, p);
+      break;
+    }
+    case 0x46:    // state and values
+    {
+      int v = 0;
+      if (arg == 2)
+        v = state_bits ();
+      else if (arg == 3)
+        v = raw_value (current_sample ()) - tare_offset;
+      else if (arg == 4)
+        v = pos_peak;
+      else if (arg == 5)
+        v = neg_peak;
+      reply_int24 (cmd, arg, v);
+      break;
+    }
+    case 0x01:    // cyclic measurement
+      cyclic = (arg == 2);
+      if (cyclic)
+        {
+          packet_length = out[3];
+          if (! clock_started)
+            {
+              t0 = chrono::steady_clock::now ();
+              clock_started = true;
+            }
+          next_sample = current_sample ();
+          next_jitter = cfg.jitter * uniform (rng);
+          reply (cmd, vector<unsigned char> (out + 2, out + 4));
+        }
+      break;
+    case 0x15:    // tare, clear peaks
+      if (arg == 0)
+        tare_offset = raw_value (current_sample ());
+      else if (arg == 1)
+        pos_peak = 0;
+      else if (arg == 2)
+        neg_peak = 0;
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x1C:    // start/stop measurement
+      measuring = (arg == 1);
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x18:    // set limit
+      if (arg == 0)
+        upper_limit = int24 (out + 3);
+      else
+        lower_limit = int24 (out + 3);
+      reply (cmd, vector<unsigned char> (out + 2, out + 6));
+      break;
+    case 0x19:    // get limit
+      reply_int24 (cmd, arg, (arg == 0) ? upper_limit : lower_limit);
+      break;
+    case 0x06:    // read memory
+    {
+      unsigned int adr = out[2] | (out[3] << 8);
+      int v = (adr < memory.size ()) ? memory[adr] : 0;
+      vector<unsigned char> p;
+      p.push_back (v & 0xFF);
+      p.push_back ((v >> 8) & 0xFF);
+      p.push_back ((v >> 16) & 0xFF);
+      reply (cmd, p);
+      break;
+    }
+    case 0x07:    // delete memory
+      memory.clear ();
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x09:    // memory statistics
+    {
+      int max_plus = 0, min_plus = 0, max_minus = 0, min_minus = 0;
+      double sum = 0, sum2 = 0;
+      for (unsigned int k = 0; k < memory.size (); ++k)
+        {
+          int v = memory[k];
+          if (v >= 0)
+            {
+              max_plus = (max_plus == 0 || v > max_plus) ? v : max_plus;
+              min_plus = (min_plus == 0 || v < min_plus) ? v : min_plus;
+            }
+          else
+            {
+              max_minus = (max_minus == 0 || v < max_minus) ? v : max_minus;
+              min_minus = (min_minus == 0 || v > min_minus) ? v : min_minus;
+            }
+          sum += v;
+          sum2 += double (v) * v;
+        }
+      int mean = 0, variance = 0;
+      if (memory.size ())
+        {
+          double n = memory.size ();
+          mean = lround (sum / n);
+          // in digits^2 * 10^-digits, see liballuris::get_memory_statistics
+          variance = lround ((sum2 / n - (sum / n) * (sum / n)) * pow (10, -cfg.digits));
+        }
+      int stats[6] = {max_plus, min_plus, max_minus, min_minus, mean, variance};
+      vector<unsigned char> p;
+      for (int k = 0; k < 6; ++k)
+        {
+          p.push_back (stats[k] & 0xFF);
+          p.push_back ((stats[k] >> 8) & 0xFF);
+          p.push_back ((stats[k] >> 16) & 0xFF);
+        }
+      reply (cmd, p);
+      break;
+    }
+    case 0x13:    // power off
+      cyclic = false;
+      measuring = false;
+      break;
+
+    // settings: set command, get command = set command + 1
+    case 0x04:
+    case 0x05:
+      setting = &mode;
+      break;
+    case 0x1D:
+    case 0x1E:
+      setting = &mem_mode;
+      break;
+    case 0x1A:
+    case 0x1B:
+      setting = &unit;
+      break;
+    case 0x31:
+    case 0x32:
+      setting = &peak_level;
+      break;
+    case 0x33:
+    case 0x34:
+      setting = &autostop;
+      break;
+    case 0x21:
+    case 0x22:
+      setting = &digout;
+      break;
+    case 0x25:
+    case 0x26:
+      setting = &buzzer;
+      break;
+    case 0x68:
+      setting = &key_lock;
+      break;
+    case 0x30:
+      setting = &data_ratio;
+      break;
+    case 0x66:    // motor start
+      advance_rig (current_sample ());
+      if (arg == 2)
+        {
+          if (motor_start_mode == 1 && ! motor_disabled)
+            {
+              motor_running = true;
+              motor_returning = false;
+            }
+        }
+      else
+        motor_start_mode = arg;
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x67:    // motor stop
+      advance_rig (current_sample ());
+      if (arg == 1)
+        motor_running = false;
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x62:    // motor reference run
+      advance_rig (current_sample ());
+      if (arg)
+        {
+          motor_running = false;
+          motor_returning = true;
+        }
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x63:    // motor disable
+      advance_rig (current_sample ());
+      motor_disabled = arg;
+      if (motor_disabled)
+        motor_running = false;
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    case 0x27:    // digital input
+    case 0x14:    // keypress
+    case 0x16:    // factory defaults
+      reply (cmd, vector<unsigned char> (1, arg));
+      break;
+    default:
+      cerr << "ttt_emulator: unknown command 0x" << hex << int (cmd) << dec << endl;
+      break;
+    }
+
+  if (setting)
+    {
+      // a get command has no argument
+      if (len > 2)
+        *setting = arg;
+      reply (cmd, vector<unsigned char> (1, *setting));
+    }
+}
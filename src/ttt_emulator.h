@@ -0,0 +1,187 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_emulator: software TTT behind the liballuris transport for tests without hardware
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TTT_EMULATOR_H
+#define TTT_EMULATOR_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include "liballuris.h"
+#include "raw_log_reader.h"
+
+using namespace std;
+
+// sampling rate of the emulated device (same as TTT_SPS)
+#define TTT_EMULATOR_SPS 900
+
+//! defaults match the torque tester in fill_database_debug.sql
+struct ttt_emulator_config
+{
+  string serial;            //!< "L.23451", letter and number < 65535
+  string firmware;          //!< "V5.05.003"
+  int next_cal_date;        //!< YYMM
+  unsigned short cal_date;  //!< days since 1.1.2000
+  string cal_number;        //!< max. 40 chars
+  double uncertainty;
+  int digits;
+  int resolution;           //!< in digits
+  int F_max;                //!< nominal torque in Nm
+
+  double jitter;            //!< max. additional delay of a packet in s (uniform distributed)
+  double packet_loss;       //!< probability that a streaming packet is lost, 0..1
+
+  double motor_rate;        //!< motor test rig: torque rate in Nm/s while the motor runs, 0 = torque from the log
+  double click_torque;      //!< the emulated click tool triggers at this torque in Nm, 0 = indicating tool
+  double log_start;         //!< the log is streamed from this time in s (skip a part which doesn't match the steps)
+
+  ttt_emulator_config ();
+};
+
+/*
+ * The emulator registers itself as virtual device (see liballuris_add_virtual_device),
+ * afterwards liballuris_open_device, liballuris++ and ttt_device use it like a TTT on USB.
+ *
+ * It answers the command set used by TTT_certify and TTT_Quick-Check (identification,
+ * calibration data, settings, tare, peaks, limits, memory) and streams the torque of
+ * a recorded log (text or raw_data_writer file, see raw_log_reader) with TTT_EMULATOR_SPS.
+ * The log runs with wall clock time from the first start of cyclic measurement
+ * (at log_start) and restarts at the end. Without a log the torque is 0.
+ * The TTT has no confirmation button, the recorded confirmation of the log
+ * is returned by confirmation () and has to be passed to ttt.
+ *
+ * Streaming packets are due when all of their samples are "measured",
+ * each packet is delayed by a random jitter and dropped with probability packet_loss
+ * (the samples are lost, like a missed interrupt transfer on the bus).
+ * A data ratio (liballuris_set_data_ratio) sends every ratio-th sample, like the firmware.
+ *
+ * With motor_rate the torque comes from an emulated motor test rig instead of the log
+ * (clockwise only): the torque rises while the motor runs (liballuris_set_motor_start (2)),
+ * is held after liballuris_set_motor_stopp and falls to 0 with a reference run.
+ * A click tool drops to 30% of click_torque when it triggers.
+ */
+class ttt_emulator
+{
+private:
+  ttt_emulator_config cfg;
+  raw_log_reader *log;
+  libusb_device_handle *handle;
+
+  mutex mtx;
+  deque< vector<unsigned char> > replies;
+
+  // device state
+  bool measuring;
+  int mode, mem_mode, unit, peak_level, autostop, key_lock, data_ratio;
+  int digout, buzzer;
+  int upper_limit, lower_limit;
+  int tare_offset;
+  int pos_peak, neg_peak;
+  vector<int> memory;
+  unsigned short flash[25];
+
+  // streaming
+  bool cyclic;
+  size_t packet_length;
+  bool clock_started;
+  chrono::steady_clock::time_point t0;   // time of sample 0
+  size_t next_sample;                    // first sample of the next packet
+  double next_jitter;                    // jitter of the next packet in s
+  unsigned long packets_sent, packets_lost;
+
+  mt19937 rng;
+  uniform_real_distribution<double> uniform;
+
+  // motor test rig, the torque of every sample is computed up to rig_sample
+  int motor_start_mode;           // liballuris_set_motor_start 0 or 1
+  bool motor_disabled, motor_running, motor_returning, clicked;
+  double rig_torque;
+  size_t rig_sample;
+  deque<double> rig_history;      // torque of the samples rig_first..rig_sample-1
+  size_t rig_first;
+  void advance_rig (size_t sample);
+  double rig_torque_at (size_t sample);
+
+  static int transfer_cb (void* user_data, unsigned char endpoint,
+                          unsigned char *data, int length, int *transferred, unsigned int timeout);
+  int receive (unsigned char *data, int length, int *transferred, unsigned int timeout);
+  void handle_command (const unsigned char *out, int len);
+
+  size_t current_sample ();
+  size_t log_sample (size_t sample);      // position of sample in the log
+  int raw_value (size_t sample);
+  bool make_packet (vector<unsigned char> &packet);
+  chrono::steady_clock::time_point packet_due ();
+  size_t ratio ()
+  {
+    return (data_ratio > 1) ? data_ratio : 1;
+  }
+  int state_bits ();
+
+  void reply (unsigned char cmd, const vector<unsigned char> &payload);
+  void reply_int24 (unsigned char cmd, unsigned char sub, int v);
+
+public:
+  //! log_fn: recorded torque in Nm, may be empty
+  ttt_emulator (string log_fn, const ttt_emulator_config &c = ttt_emulator_config ());
+  ~ttt_emulator ();
+
+  //! handle of the virtual device, can also be opened with liballuris_open_device
+  libusb_device_handle* get_handle ()
+  {
+    return handle;
+  }
+
+  string get_serial ()
+  {
+    return cfg.serial;
+  }
+
+  //! values returned by liballuris_read_memory, in digits
+  void set_memory (const vector<int> &values);
+
+  //! adjust the emulated click tool (see ttt_emulator_config::click_torque)
+  void set_click_torque (double t);
+
+  //! confirmation of the log at the current sample, poll at least every 0.1s
+  bool confirmation ();
+
+  //! the log was streamed once (it restarts at the end)
+  bool end_of_log ();
+
+  unsigned long get_packets_sent ()
+  {
+    return packets_sent;
+  }
+
+  unsigned long get_packets_lost ()
+  {
+    return packets_lost;
+  }
+};
+
+#endif
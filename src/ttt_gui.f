@@ -20,6 +20,9 @@ decl {\#include <FL/Fl_Tooltip.H>} {public global
 decl {\#include "ttt.h"} {public global
 }
 
+decl {\#include "ttt_worker.h"} {public global
+}
+
 decl {\#include "cairo_box.h"} {public global
 }
 
@@ -38,12 +41,15 @@ decl {\#include "test_person_table.h"} {public global
 decl {\#include "measurement_table.h"} {public global
 }
 
-decl {void run_cb(void *)} {public global
+decl {void worker_events_cb(void *)} {public global
 }
 
 decl {ttt *myTTT;} {public local
 }
 
+decl {ttt_worker *worker;} {public local
+}
+
 decl {Fl_Text_Buffer *instruction_buff;} {public local
 }
 
@@ -536,7 +542,13 @@ if (rb_like_6789_repeat->value () && use_mean_as_nominal_value)
 if (rb_quick_peak->value ())
   {
     if ( vi_single_peak->value () != 0 || use_mean_as_nominal_value)
-      myTTT->start_sequencer_quick_check (temp, humidity, vi_single_peak->value ());
+      {
+        ttt_command c (TTT_CMD_START_QUICK_CHECK);
+        c.temperature = temp;
+        c.humidity = humidity;
+        c.nominal_value = vi_single_peak->value ();
+        post_start_command (c);
+      }
     else
       fl_alert ( gettext ("Nominalwert muss <> 0 Nm sein"));
   }
@@ -561,29 +573,25 @@ else if (rb_din_6789->value () || rb_like_6789_repeat->value ())
         if (humidity > 90)
           fl_alert ( gettext ("relative Luftfeuchte außerhalb des erlaubten Bereichs, siehe DIN EN ISO 6789:2003-10 Kapitel 6.2"));
         else
-          myTTT->start_sequencer_ISO6789 (temp, humidity, rb_repeat_until_okay->value (), rb_like_6789_repeat->value ());
+        {
+          ttt_command c (TTT_CMD_START_ISO6789);
+          c.temperature = temp;
+          c.humidity = humidity;
+          c.repeat_on_timing_violation = rb_repeat_until_okay->value ();
+          c.repeat_on_tolerance_violation = rb_like_6789_repeat->value ();
+          post_start_command (c);
+        }
       }
   }
 
-update_run_activation ();
-Fl::add_timeout(0.01, run_cb);}
+// the worker publishes TTT_EVENT_SEQUENCER_STARTED, see worker_events_cb}
         xywh {785 195 110 30} box GLEAM_THIN_UP_BOX
       }
       Fl_Button btn_stop {
         label Stopp
-        callback {try
-  {
-    myTTT->stop_sequencer();
-    btn_result->show ();
-    mtable->show ();
-    btn_result->color (FL_RED);
-    btn_result->copy_label (gettext ("Kalibrierung durch Benutzer abgebrochen"));
-  }
-catch (std::runtime_error &e)
-  {
-    fl_alert (e.what ());
-	exit (-1);
-  }}
+        callback {// the result shows the abort after TTT_EVENT_SEQUENCER_ABORTED, see worker_events_cb
+if (! worker->post (ttt_command (TTT_CMD_STOP)))
+  fl_alert (gettext ("Der Befehl konnte nicht an den Sequenzer gesendet werden, bitte erneut versuchen."));}
         xywh {962 195 110 30} box GLEAM_THIN_UP_BOX deactivate
       }
       Fl_Button btn_direction_cw {
@@ -596,7 +604,7 @@ catch (std::runtime_error &e)
       }
       Fl_Button btn_confirm {
         label {Bestätigung}
-        callback {myTTT->set_confirmation ();}
+        callback {worker->post (ttt_command (TTT_CMD_CONFIRMATION));}
         xywh {1140 195 110 30} box GLEAM_THIN_UP_BOX deactivate
       }
       Fl_Value_Output vo_nominal_value {
@@ -923,17 +931,33 @@ Function {update_test_object_accuracy()} {open
   }} {}
 }
 
-Function {update_run_activation()} {open
+Function {set_setup_active(bool active)} {open return_type void
 } {
-  code {if (myTTT->run ())
+  code {// test object, test person and type of test, read by the worker while a sequence runs
+if (active)
+  {
+    vi_test_object_id->activate ();
+    btn_test_object_new->activate ();
+    btn_test_object_search->activate ();
+    btn_test_object_copy->activate ();
+    btn_test_object_edit->activate ();
+    btn_test_object_delete->activate ();
+
+    vi_test_person_id->activate ();
+    btn_test_person_new->activate ();
+    btn_test_person_search->activate ();
+
+    rb_quick_peak->activate ();
+    rb_like_6789_repeat->activate ();
+    rb_din_6789->activate ();
+    vi_single_peak->activate ();
+    grp_rise_time->activate ();
+
+    vi_temperature->activate ();
+    vi_humidity->activate ();
+  }
+else
   {
-    btn_result->hide ();
-    mtable->show ();
-    btn_start->deactivate ();
-    btn_stop->activate ();
-    btn_confirm->activate ();
-    //btn_direction_cw->show ();
-    //btn_direction_ccw->show ();
     vi_test_object_id->deactivate ();
     btn_test_object_new->deactivate ();
     btn_test_object_search->deactivate ();
@@ -953,6 +977,21 @@ Function {update_run_activation()} {open
 
     vi_temperature->deactivate ();
     vi_humidity->deactivate ();
+  }} {}
+}
+
+Function {update_run_activation()} {open
+} {
+  code {if (worker->is_running ())
+  {
+    btn_result->hide ();
+    mtable->show ();
+    btn_start->deactivate ();
+    btn_stop->activate ();
+    btn_confirm->activate ();
+    //btn_direction_cw->show ();
+    //btn_direction_ccw->show ();
+    set_setup_active (false);
     to_step->show ();
     step_progress->show ();
     vo_step_progress->show ();
@@ -964,31 +1003,26 @@ else
     btn_confirm->deactivate ();
     btn_direction_cw->hide ();
     btn_direction_ccw->hide ();
-    vi_test_object_id->activate ();
-    btn_test_object_new->activate ();
-    btn_test_object_search->activate ();
-    btn_test_object_copy->activate ();
-    btn_test_object_edit->activate ();
-    btn_test_object_delete->activate ();
-
-    vi_test_person_id->activate ();
-    btn_test_person_new->activate ();
-    btn_test_person_search->activate ();
-    grp_rise_time->activate ();
-
-    rb_quick_peak->activate ();
-    rb_like_6789_repeat->activate ();
-    rb_din_6789->activate ();
-    vi_single_peak->activate ();
-
-    vi_temperature->activate ();
-    vi_humidity->activate ();
+    set_setup_active (true);
     to_step->hide ();
     step_progress->hide ();
     vo_step_progress->hide ();
   }} {}
 }
 
+Function {post_start_command(const ttt_command &c)} {open return_type void
+} {
+  code {// Start and the setup stay deactivated until TTT_EVENT_SEQUENCER_STARTED or TTT_EVENT_ERROR,
+// a double click must not post a second start and the worker reads the setup
+if (worker->post (c))
+  {
+    btn_start->deactivate ();
+    set_setup_active (false);
+  }
+else
+  fl_alert (gettext ("Der Befehl konnte nicht an den Sequenzer gesendet werden, bitte erneut versuchen."));} {}
+}
+
 Function {set_test_object_fields_editable(bool editable)} {open return_type void
 } {
   code {if (editable)
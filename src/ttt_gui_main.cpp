@@ -157,22 +157,76 @@ void update_result(string s)
   btn_result->copy_label (s.c_str ());
 }
 
-void run_cb(void*)
+// Fl::awake handler in the GUI thread, the events of the sequencer in the worker thread
+void worker_events_cb(void*)
 {
-  try
-    {
-      if (myTTT->run ())
-        Fl::repeat_timeout(0.01, run_cb);
-      else
-        update_run_activation ();
-    }
-  catch (std::runtime_error &e)
+  static vector<ttt_event> events;
+  events.clear ();
+  worker->poll_events (events);
+  for (unsigned int k = 0; k < events.size (); ++k)
     {
-      fl_alert (e.what ());
-      exit (-1);
+      const ttt_event &e = events[k];
+      switch (e.type)
+        {
+        case TTT_EVENT_INDICATED_TORQUE:
+          update_indicated_torque (e.value);
+          break;
+        case TTT_EVENT_NOMINAL_TORQUE:
+          update_nominal_torque (e.value);
+          break;
+        case TTT_EVENT_PEAK_TORQUE:
+          update_peak_torque (e.value);
+          break;
+        case TTT_EVENT_INSTRUCTION:
+          update_instruction (e.text);
+          break;
+        case TTT_EVENT_STEP_ENTERED:
+          update_step (e.text, e.value);
+          break;
+        case TTT_EVENT_RESULT:
+          update_result (e.text);
+          break;
+        case TTT_EVENT_SEQUENCER_STARTED:
+        case TTT_EVENT_SEQUENCER_STOPPED:
+          update_run_activation ();
+          break;
+        case TTT_EVENT_SEQUENCER_ABORTED:
+          btn_result->show ();
+          mtable->show ();
+          btn_result->color (FL_RED);
+          btn_result->copy_label (gettext ("Kalibrierung durch Benutzer abgebrochen"));
+          break;
+        case TTT_EVENT_TABLE_CLEAR:
+          mtable->clear ();
+          break;
+        case TTT_EVENT_TABLE_NOMINAL_VALUE:
+          mtable->add_nominal_value (e.value);
+          break;
+        case TTT_EVENT_TABLE_SIZE:
+          mtable->rows (e.rows);
+          mtable->cols (e.cols);
+          break;
+        case TTT_EVENT_TABLE_MEASUREMENT:
+          mtable->add_measurement (e.value, e.overwrite, e.color);
+          break;
+        case TTT_EVENT_ERROR:
+          // the worker stopped the sequencer if it failed, a rejected
+          // command (e.g. a second start) leaves it running
+          fl_alert ("%s", e.text.c_str ());
+          update_run_activation ();
+          break;
+        default:
+          break;
+        }
     }
 }
 
+// called in the worker thread
+void worker_notify(void*)
+{
+  Fl::awake (worker_events_cb, 0);
+}
+
 void test_object_table_selected (int id)
 {
   printf ("test_object_table_selected id=%i\n", id);
@@ -226,6 +280,8 @@ int main(int argc, char **argv)
   static double stop_peak_torque_factor = 0.1;
   static long int initial_test_person_id = 1;
   static long int initial_test_object_id = 1;
+  static cfg_bool_t motor_driven = cfg_false;
+  static double display_rate = TTT_DISPLAY_RATE;
 
   cfg_opt_t opts[] =
   {
@@ -234,6 +290,8 @@ int main(int argc, char **argv)
     CFG_SIMPLE_FLOAT("stop_peak_torque_factor", &stop_peak_torque_factor),
     CFG_SIMPLE_INT("selected_test_person", &initial_test_person_id),
     CFG_SIMPLE_INT("selected_test_object", &initial_test_object_id),
+    CFG_SIMPLE_BOOL("motor_driven", &motor_driven),
+    CFG_SIMPLE_FLOAT("display_rate", &display_rate),
     CFG_END()
   };
   cfg_t *cfg;
@@ -249,6 +307,8 @@ int main(int argc, char **argv)
   printf("stop_peak_torque_factor: %f\n", stop_peak_torque_factor);
   printf("initial_test_person_id: %li\n", initial_test_person_id);
   printf("initial_test_object_id: %li\n", initial_test_object_id);
+  printf("motor_driven: %i\n", motor_driven);
+  printf("display_rate: %f\n", display_rate);
 
   int ret;
   setlocale (LC_ALL, "");
@@ -278,17 +338,18 @@ int main(int argc, char **argv)
 
   mainwin->show ();
 
+  // enables Fl::awake from the worker thread, the worker never takes the lock
+  Fl::lock ();
+
   try
     {
-      myTTT = new ttt (update_indicated_torque,
-                       update_nominal_torque,
-                       update_peak_torque,
-                       update_instruction,
-                       update_step, update_result,
+      // the display and mtable are updated by worker_events_cb
+      myTTT = new ttt (NULL, NULL, NULL, NULL, NULL, NULL,
                        database,
                        start_peak_torque_factor,
-                       stop_peak_torque_factor,
-                       mtable);
+                       stop_peak_torque_factor);
+      myTTT->set_motor_driven (motor_driven);
+      myTTT->set_display_rate (display_rate);
 
       // test_person_table
       tp->connect_DB (database);
@@ -332,6 +393,44 @@ int main(int argc, char **argv)
 
       load_torque_tester ();
 
+      // the initial values of the display
+      update_indicated_torque (0.0);
+      update_nominal_torque (0.0);
+      update_peak_torque (0.0);
+      update_instruction ("");
+      update_step ("idle", 0);
+
+      // offer to continue a calibration which was interrupted by a crash or power cut
+      int resume_test_person_id = 0, resume_test_object_id = 0;
+      int resume_id = myTTT->find_unfinished_measurement (resume_test_person_id, resume_test_object_id);
+      if (resume_id)
+        {
+          int r = fl_choice (gettext ("Eine Kalibrierung wurde nicht beendet.\n"
+                                      "Soll sie beim ersten offenen Schritt fortgesetzt werden?"),
+                             gettext ("Verwerfen"), gettext ("Fortsetzen"), 0);
+          if (r == 1)
+            {
+              vi_test_person_id->value (resume_test_person_id);
+              vi_test_person_id->do_callback ();
+              vi_test_object_id->value (resume_test_object_id);
+              vi_test_object_id->do_callback ();
+            }
+          else
+            {
+              myTTT->discard_measurement (resume_id);
+              resume_id = 0;
+            }
+        }
+
+      // USB poll, steps, saving and reports run in the worker thread
+      worker = new ttt_worker (myTTT, worker_notify, 0);
+      if (resume_id)
+        {
+          ttt_command c (TTT_CMD_RESUME);
+          c.measurement_id = resume_id;
+          post_start_command (c);
+        }
+
       ret = Fl::run();
     }
   catch (std::runtime_error &e)
@@ -354,6 +453,8 @@ int main(int argc, char **argv)
   cfg_free (cfg);
   free (database);
 
+  Fl::unlock ();
+  delete worker;
   delete myTTT;
 
 #ifdef _WIN32
@@ -0,0 +1,174 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_monitor: decimated long-duration recording of a TTT
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ttt_monitor.h"
+#include "config.h"
+#include <sstream>
+
+ttt_decimator::ttt_decimator (kind kd, int r)
+  : k (kd), ratio (r), count (0), sum (0)
+{
+  if (ratio < 1)
+    throw runtime_error ("ttt_decimator: ratio < 1");
+  block_len = (k == DECIMATE_MINMAX) ? 2 * ratio : ratio;
+}
+
+void ttt_decimator::push (const ttt_sample &s, vector<ttt_sample> &out)
+{
+  if (count == 0)
+    {
+      first = min = max = s;
+      sum = 0;
+    }
+  else
+    {
+      if (s.raw < min.raw)
+        min = s;
+      if (s.raw > max.raw)
+        max = s;
+    }
+  sum += s.raw;
+
+  if (++count == block_len)
+    flush (out);
+}
+
+void ttt_decimator::flush (vector<ttt_sample> &out)
+{
+  if (count == 0)
+    return;
+
+  if (k == DECIMATE_MEAN)
+    {
+      ttt_sample m = first;
+      m.raw = (sum >= 0) ? (sum + count / 2) / count : (sum - count / 2) / count;
+      out.push_back (m);
+    }
+  else
+    {
+      // two samples per block also if min and max are the same sample
+      ttt_sample m = min;
+      m.index = first.index;
+      out.push_back (m);
+      m = max;
+      m.index = first.index + ratio;
+      out.push_back (m);
+    }
+  count = 0;
+}
+
+unsigned int ttt_decimator::output_sps ()
+{
+  int per_block = (k == DECIMATE_MINMAX) ? 2 : 1;
+  return per_block * TTT_SPS / block_len;
+}
+
+ttt_monitor::ttt_monitor (ttt_device *d, string fn, ttt_monitor_mode m, int r)
+  : dev (d), mode (m), ratio (r), decimator (0), samples_in (0), samples_out (0)
+{
+  if (! dev)
+    throw runtime_error ("ttt_monitor: no device");
+  if (ratio < 1 || ratio > 255)
+    throw runtime_error ("ttt_monitor: ratio out of range 1..255");
+  // the file header has an integer sampling rate
+  if (TTT_SPS % ratio)
+    throw runtime_error ("ttt_monitor: ratio isn't a divisor of TTT_SPS");
+
+  const char *mode_names[] = {"device", "mean", "minmax"};
+  cout << "ttt_monitor c'tor " << fn << ", mode = " << mode_names[mode] << ", ratio = " << ratio << endl;
+
+  dev->stop ();
+  if (mode == TTT_MONITOR_DEVICE)
+    dev->set_data_ratio (ratio);
+  else
+    {
+      dev->set_data_ratio (1);
+      if (ratio > 1)
+        decimator = new ttt_decimator ((mode == TTT_MONITOR_MEAN) ? ttt_decimator::DECIMATE_MEAN
+                                       : ttt_decimator::DECIMATE_MINMAX, ratio);
+    }
+
+  ostringstream header;
+  header << "# TTT serial           = " << dev->get_serial () << endl;
+  header << "# TTT cal_date         = " << dev->get_cal_date () << endl;
+  header << "# TTT model            = " << dev->get_model () << endl;
+  header << "# monitor mode         = " << mode_names[mode] << endl;
+  header << "# decimation ratio     = " << ratio << endl;
+  header << "# time [s]             = sample index / " << TTT_SPS << endl;
+  writer.open (fn, dev->get_scale (), decimator ? decimator->output_sps () : TTT_SPS / ratio, header.str ());
+
+  dev->start ();
+}
+
+ttt_monitor::~ttt_monitor ()
+{
+  try
+    {
+      if (dev->is_connected ())
+        {
+          dev->stop ();
+          // don't leave the decimation for the next user of the TTT
+          dev->set_data_ratio (1);
+        }
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << "ttt_monitor d'tor: " << e.what () << endl;
+    }
+
+  if (decimator)
+    {
+      decimator->flush (out);
+      delete decimator;
+    }
+  for (unsigned int k = 0; k < out.size (); ++k)
+    writer.append (out[k].index, out[k].raw, false);
+  samples_out += out.size ();
+  writer.close ();
+
+  cout << "ttt_monitor d'tor: " << samples_in << " samples in, " << samples_out << " samples written" << endl;
+}
+
+bool ttt_monitor::poll ()
+{
+  if (! dev->check_connection ())
+    return false;
+
+  vector<ttt_sample> in = dev->poll_samples ();
+  samples_in += in.size ();
+
+  out.clear ();
+  if (decimator)
+    for (unsigned int k = 0; k < in.size (); ++k)
+      decimator->push (in[k], out);
+  else
+    out.swap (in);
+
+  for (unsigned int k = 0; k < out.size (); ++k)
+    writer.append (out[k].index, out[k].raw, false);
+  samples_out += out.size ();
+  out.clear ();
+
+  return dev->is_connected ();
+}
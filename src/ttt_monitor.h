@@ -0,0 +1,115 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_monitor: decimated long-duration recording of a TTT
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TTT_MONITOR_H
+#define TTT_MONITOR_H
+
+#include <string>
+#include <vector>
+#include "ttt_device.h"
+#include "raw_data_writer.h"
+
+using namespace std;
+
+enum ttt_monitor_mode
+{
+  TTT_MONITOR_DEVICE,   // set_data_ratio on the TTT: lowest USB and CPU load, aliasing, peaks between the samples are lost
+  TTT_MONITOR_MEAN,     // 900Hz on USB, mean of ratio samples (boxcar anti-alias filter), peaks are flattened
+  TTT_MONITOR_MINMAX    // 900Hz on USB, minimum and maximum of 2*ratio samples: no peak is lost
+};
+
+/*
+ * Streaming decimation of ttt_samples by ratio. The output keeps the sample index
+ * of the input (time = index / TTT_SPS), so gaps after a reconnect stay visible.
+ *
+ * DECIMATE_MEAN: one sample per ratio input samples, index of the first sample
+ * DECIMATE_MINMAX: per block of 2*ratio input samples always the minimum and then the
+ *                  maximum, at the indices of the first and the middle sample of the block.
+ *                  The output stays on a grid of ratio samples, the readers take the
+ *                  time from the sampling rate of the file.
+ */
+class ttt_decimator
+{
+public:
+  enum kind {DECIMATE_MEAN, DECIMATE_MINMAX};
+
+private:
+  kind k;
+  int ratio;
+  int block_len;
+  int count;
+  long sum;
+  ttt_sample first, min, max;
+
+public:
+  ttt_decimator (kind k, int ratio);
+
+  // append the decimated samples to out
+  void push (const ttt_sample &s, vector<ttt_sample> &out);
+  // output of the incomplete block
+  void flush (vector<ttt_sample> &out);
+
+  // output samples per second for TTT_SPS input samples per second
+  unsigned int output_sps ();
+};
+
+/*
+ * Record a TTT for a long time (for example a shift at a fastening station)
+ * into a raw_data_writer file with TTT_SPS / ratio samples per second,
+ * ratio has to be a divisor of TTT_SPS (1, 2, 3, 4, 5, 6, 9, 10, ..., 225).
+ * The sample index in the file is the original 900Hz index.
+ *
+ * The device is started in the c'tor and stopped in the d'tor,
+ * call poll () cyclic (more often than every TTT_RING_SIZE / TTT_SPS s).
+ */
+class ttt_monitor
+{
+private:
+  ttt_device *dev;
+  ttt_monitor_mode mode;
+  int ratio;
+  ttt_decimator *decimator;
+  raw_data_writer writer;
+  vector<ttt_sample> out;
+  unsigned long samples_in, samples_out;
+
+public:
+  ttt_monitor (ttt_device *dev, string fn, ttt_monitor_mode mode, int ratio);
+  ~ttt_monitor ();
+
+  // returns false while the TTT is disconnected
+  bool poll ();
+
+  unsigned long get_samples_in ()
+  {
+    return samples_in;
+  }
+
+  unsigned long get_samples_out ()
+  {
+    return samples_out;
+  }
+};
+
+#endif
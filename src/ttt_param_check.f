@@ -17,6 +17,9 @@ decl {\#include "ttt_device.h"} {public local
 decl {\#include "ttt_peak_detector.h"} {public local
 }
 
+decl {\#include "raw_log_reader.h"} {public local
+}
+
 decl {ttt_device *dev = 0;} {private local
 }
 
@@ -381,30 +384,17 @@ for (unsigned int k=0; k < values.size (); ++k)
 
 Function {load_example(string fn)} {open
 } {
-  code {double value;
-int cnt = 0;
-ifstream in (fn.c_str ());
-if (in.is_open())
+  code {try
   {
+    raw_log_reader in (fn);
     values.clear ();
-    while (! in.fail ())
-      {
-        in >> value;
-        values.push_back (value);
-        cnt++;
-      }
-
-    if (in.fail () && ! in.eof ())
-      cerr << "Couldn't read double in line " << cnt << endl;
-    //cout << "read " << cnt << " values..." << endl;
-
-    in.close();
+    in.read (0, in.size (), values);
     update_cplot();
   }
-else
+catch (std::runtime_error &e)
   {
     fl_alert (gettext ("Die Datei '%s' konnte nicht gefunden werden"), fn.c_str());
-    cerr << "Unable to open file '" << fn << "'" << endl;
+    cerr << e.what () << endl;
   }} {}
 }
 
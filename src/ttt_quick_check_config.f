@@ -14,6 +14,34 @@ decl {\#include "liballuris++.h"} {public global
 decl {\#include "quick_check_table.h"} {public global
 }
 
+decl {liballuris *quick_dev = 0;} {private local
+}
+
+Function {quick_device()} {
+  comment {the TTT stays open while the program runs, so digits and firmware are only read once} return_type {liballuris &}
+} {
+  code {if (! quick_dev)
+  quick_dev = new liballuris ();
+return *quick_dev;} {}
+}
+
+Function {close_quick_device()} {
+  comment {after an error the next action opens the TTT again (it may have been replugged)} return_type void
+} {
+  code {delete quick_dev;
+quick_dev = 0;} {}
+}
+
+Function {read_memory_progress(void *, int done, int total)} {
+  comment {progress of liballuris::read_memory_records in the window title} return_type int
+} {
+  code {char buf[80];
+snprintf (buf, sizeof (buf), "%s (%i/%i)", gettext ("Speicher auslesen"), done, total);
+mainwin->copy_label (buf);
+Fl::flush ();
+return 0;} {}
+}
+
 Function {} {open
 } {
   code {\#ifdef _WIN32
@@ -100,9 +128,9 @@ o->redraw ();}
         label {Konfiguration ins Messgerät schreiben}
         callback {try
   {
-    liballuris al;
     mainwin->cursor (FL_CURSOR_WAIT);
     Fl::wait (0);
+    liballuris &al = quick_device ();
 
     cout << "ttt_device::init clear_RX" << endl;
     al.clear_RX (500);
@@ -131,6 +159,7 @@ o->redraw ();}
   }
 catch (std::runtime_error &e)
   {
+    close_quick_device ();
     fl_alert (e.what ());
   }
 mainwin->cursor (FL_CURSOR_DEFAULT);}
@@ -163,18 +192,61 @@ vi_test_object_accuracy->do_callback ();}
     } {
       Fl_Button {} {
         label {Speicher auslesen}
-        callback {try
+        callback {// statistics computed by the device, the single values are only read with "Werte prüfen"
+try
   {
-    liballuris al;
     mainwin->cursor (FL_CURSOR_WAIT);
     Fl::wait (0);
+    liballuris &al = quick_device ();
+
+    quick_tbl->clear ();
+
+    // one round trip, the values stored meanwhile are included
+    memory_statistics st = al.get_memory_statistics ();
+    cout << "mem empty=" << st.empty << " mean=" << st.mean << " variance=" << st.variance << endl;
 
+    if (st.empty)
+      {
+        vo_mean->value (0);
+        vo_std->value (0);
+        fl_message (gettext ("Keine Werte im Gerätespeicher"));
+      }
+    else
+      {
+        vo_mean->value (st.mean);
+        vo_std->value (st.std_dev ());
+      }
+  }
+catch (std::runtime_error &e)
+  {
+    close_quick_device ();
+    fl_alert (e.what ());
+  }
+mainwin->cursor (FL_CURSOR_DEFAULT);}
+        xywh {186 336 172 44} box GLEAM_THIN_UP_BOX align 128
+      }
+      Fl_Button {} {
+        label {Werte prüfen}
+        callback {// read all values and check the statistics of the device
+const char *title = mainwin->label ();
+try
+  {
+    mainwin->cursor (FL_CURSOR_WAIT);
+    Fl::wait (0);
+    liballuris &al = quick_device ();
+
+    // the statistics and the single values have to be of the same memory content
     al.stop_measurement ();
     double scale = 1.0 / pow(10, al.get_digits ());
     quick_tbl->clear ();
 
-    vector<int> mem;
-    mem = al.read_memory ();
+    memory_statistics st = al.get_memory_statistics ();
+
+    // quick check mode stores two words per measurement
+    // read_memory_progress shows the progress in the title
+    vector<memory_record> mem;
+    mem = al.read_memory_records (2, read_memory_progress, 0);
+    mainwin->label (title);
 
     cout << "mem.size ()=" << mem.size () << endl;
 
@@ -184,41 +256,52 @@ vi_test_object_accuracy->do_callback ();}
       {
         double sum = 0;
         int cnt = 0;
-        for (unsigned int k=0; k<mem.size (); k+=2)
+        for (unsigned int k=0; k<mem.size (); ++k)
           {
-            cout << "mem k=" << k << " =" << mem[k] << endl;
-            quick_tbl->add_measurement (mem[k] * scale);
-            sum += mem[k] * scale;
+            cout << "mem adr=" << mem[k].adr << " =" << mem[k].value << endl;
+            quick_tbl->add_measurement (mem[k].value * scale);
+            sum += mem[k].value * scale;
             cnt++;
           }
         double mean = sum / cnt;
-        vo_mean->value (mean);
 
         // nochmal iterieren für Standardabweichung
         double var = 0;
-        for (unsigned int k=0; k<mem.size (); k+=2)
+        for (unsigned int k=0; k<mem.size (); ++k)
           {
-            var += pow (mem[k] * scale - mean, 2);
+            var += pow (mem[k].value * scale - mean, 2);
           }
-        var /= (cnt - 1);
+        if (cnt > 1)
+          var /= (cnt - 1);
+        vo_mean->value (mean);
         vo_std->value (sqrt (var));
         quick_tbl->show ();
+
+        cout << "device mean=" << st.mean << " std=" << st.std_dev ()
+             << " host mean=" << mean << " std=" << sqrt (var) << endl;
+
+        // one digit tolerance for rounding in the device
+        if (fabs (st.mean - mean) > scale || fabs (st.std_dev () - sqrt (var)) > scale)
+          fl_alert (gettext ("Die Statistik des Geräts weicht von den ausgelesenen Werten ab.\n"
+                             "Angezeigt werden die aus den Einzelwerten berechneten Werte."));
       }
   }
 catch (std::runtime_error &e)
   {
+    close_quick_device ();
+    mainwin->label (title);
     fl_alert (e.what ());
   }
 mainwin->cursor (FL_CURSOR_DEFAULT);}
-        xywh {186 336 172 44} box GLEAM_THIN_UP_BOX align 128
+        xywh {186 446 172 44} box GLEAM_THIN_UP_BOX align 128
       }
       Fl_Button {} {
         label {Speicher löschen}
         callback {try
   {
-    liballuris al;
     mainwin->cursor (FL_CURSOR_WAIT);
     Fl::wait (0);
+    liballuris &al = quick_device ();
 
     al.clear_memory ();
     quick_tbl->clear ();
@@ -228,6 +311,7 @@ mainwin->cursor (FL_CURSOR_DEFAULT);}
   }
 catch (std::runtime_error &e)
   {
+    close_quick_device ();
     fl_alert (e.what ());
   }
 mainwin->cursor (FL_CURSOR_DEFAULT);}
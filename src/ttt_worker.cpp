@@ -0,0 +1,213 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_worker: runs the sequencer of a ttt in its own thread
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ttt_worker.h"
+#include <chrono>
+
+ttt_worker::ttt_worker (ttt *_t, cb_worker_notify *n, void *nd, double p)
+  : t (_t), period (p), notify (n), notify_data (nd),
+    commands (TTT_WORKER_QUEUE_SIZE), events (TTT_WORKER_QUEUE_SIZE),
+    pushed_events (0), quit (false), running (false)
+{
+  if (! t)
+    throw runtime_error ("ttt_worker: no ttt");
+
+  t->add_event_listener (event_cb, this);
+  th = thread (&ttt_worker::loop, this);
+}
+
+ttt_worker::~ttt_worker ()
+{
+  quit = true;
+  if (th.joinable ())
+    th.join ();
+
+  // the ttt lives longer than the worker
+  if (running.load ())
+    {
+      try
+        {
+          t->stop_sequencer ();
+        }
+      catch (std::runtime_error &e)
+        {
+          cerr << "ttt_worker d'tor: " << e.what () << endl;
+        }
+    }
+  t->remove_event_listener (event_cb, this);
+}
+
+bool ttt_worker::post (const ttt_command &c)
+{
+  return commands.push (c);
+}
+
+size_t ttt_worker::poll_events (vector<ttt_event> &out)
+{
+  return events.pop_all (out);
+}
+
+// called by ttt::publish in the worker thread
+void ttt_worker::event_cb (void *user_data, const ttt_event &e)
+{
+  ttt_worker *w = static_cast<ttt_worker*> (user_data);
+  if (e.type == TTT_EVENT_SEQUENCER_STARTED)
+    w->running = true;
+  else if (e.type == TTT_EVENT_SEQUENCER_STOPPED)
+    w->running = false;
+  w->queue_event (e);
+}
+
+void ttt_worker::queue_event (const ttt_event &e)
+{
+  // keep the order if the receiver is too slow
+  if (pending_events.empty () && events.push (e))
+    pushed_events++;
+  else
+    pending_events.push_back (e);
+}
+
+void ttt_worker::queue_error (const string &what)
+{
+  cerr << "ttt_worker: " << what << endl;
+  ttt_event ev;
+  ev.type = TTT_EVENT_ERROR;
+  ev.step = 0;
+  ev.value = 0;
+  ev.text = what;
+  ev.rows = 0;
+  ev.cols = 0;
+  ev.color = FL_WHITE;
+  ev.overwrite = false;
+  queue_event (ev);
+}
+
+void ttt_worker::stop_on_error ()
+{
+  if (running.load ())
+    {
+      try
+        {
+          t->stop_sequencer ();
+        }
+      catch (std::runtime_error &e)
+        {
+          cerr << "ttt_worker: " << e.what () << endl;
+        }
+    }
+}
+
+void ttt_worker::execute (const ttt_command &c)
+{
+  switch (c.type)
+    {
+    case TTT_CMD_START_QUICK_CHECK:
+      t->start_sequencer_quick_check (c.temperature, c.humidity, c.nominal_value);
+      break;
+    case TTT_CMD_START_ISO6789:
+      t->start_sequencer_ISO6789 (c.temperature, c.humidity,
+                                  c.repeat_on_timing_violation, c.repeat_on_tolerance_violation);
+      break;
+    case TTT_CMD_START_ISO6789_BATCH:
+      t->start_sequencer_ISO6789_batch (c.test_object_ids, c.temperature, c.humidity,
+                                        c.repeat_on_timing_violation, c.repeat_on_tolerance_violation);
+      break;
+    case TTT_CMD_RESUME:
+      t->resume_sequencer (c.measurement_id);
+      break;
+    case TTT_CMD_STOP:
+      if (running.load ())
+        t->abort_sequencer ();
+      break;
+    case TTT_CMD_CONFIRMATION:
+      t->set_confirmation ();
+      break;
+    }
+}
+
+void ttt_worker::loop ()
+{
+  vector<ttt_command> cmds;
+  chrono::steady_clock::time_point t_next = chrono::steady_clock::now ();
+  while (! quit.load ())
+    {
+      pushed_events = 0;
+
+      cmds.clear ();
+      commands.pop_all (cmds);
+      for (unsigned int k = 0; k < cmds.size (); ++k)
+        {
+          bool was_running = running.load ();
+          try
+            {
+              execute (cmds[k]);
+            }
+          catch (std::runtime_error &e)
+            {
+              // a rejected command (e.g. a second start) leaves a running sequence alone,
+              // a start which failed after TTT_EVENT_SEQUENCER_STARTED is stopped
+              queue_error (e.what ());
+              if (! was_running)
+                stop_on_error ();
+            }
+        }
+
+      if (running.load ())
+        {
+          try
+            {
+              t->run ();
+            }
+          catch (std::runtime_error &e)
+            {
+              queue_error (e.what ());
+              stop_on_error ();
+            }
+        }
+
+      while (! pending_events.empty () && events.push (pending_events.front ()))
+        {
+          pending_events.pop_front ();
+          pushed_events++;
+        }
+
+      if (notify && pushed_events)
+        notify (notify_data);
+
+      // no busy waiting while the sequencer is stopped
+      double p = period;
+      if (! running.load ())
+        p = max (p, TTT_WORKER_PERIOD);
+      if (p > 0)
+        {
+          t_next += chrono::microseconds (long (p * 1e6));
+          chrono::steady_clock::time_point now = chrono::steady_clock::now ();
+          if (t_next < now)
+            t_next = now;
+          this_thread::sleep_until (t_next);
+        }
+      else
+        t_next = chrono::steady_clock::now ();
+    }
+}
@@ -0,0 +1,129 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class ttt_worker: runs the sequencer of a ttt in its own thread
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TTT_WORKER_H
+#define TTT_WORKER_H
+
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <vector>
+#include "ttt.h"
+#include "spsc_ring.h"
+
+using namespace std;
+
+// period of ttt::run in the worker thread in s (same as the former GUI timer)
+#define TTT_WORKER_PERIOD 0.01
+// capacity of the command and event queues
+#define TTT_WORKER_QUEUE_SIZE 1024
+
+enum ttt_command_type
+{
+  TTT_CMD_START_QUICK_CHECK,    // temperature, humidity, nominal_value
+  TTT_CMD_START_ISO6789,        // temperature, humidity, repeat_on_*
+  TTT_CMD_START_ISO6789_BATCH,  // test_object_ids, temperature, humidity, repeat_on_*
+  TTT_CMD_RESUME,               // measurement_id, see ttt::resume_sequencer
+  TTT_CMD_STOP,                 // by the user, the measurement can't be resumed
+  TTT_CMD_CONFIRMATION
+};
+
+struct ttt_command
+{
+  ttt_command_type type;
+  double temperature;
+  double humidity;
+  double nominal_value;
+  bool repeat_on_timing_violation;
+  bool repeat_on_tolerance_violation;
+  int measurement_id;
+  vector<int> test_object_ids;
+
+  ttt_command (ttt_command_type t = TTT_CMD_STOP)
+    : type (t), temperature (0), humidity (0), nominal_value (0),
+      repeat_on_timing_violation (false), repeat_on_tolerance_violation (false),
+      measurement_id (0)
+  {}
+};
+
+typedef void(cb_worker_notify)(void *user_data);
+
+/*
+ * USB poll, step state machine, saving the measurement and the report run
+ * in the worker thread, so a slow stage neither blocks the GUI nor the GUI the poll.
+ *
+ * One thread (the GUI) posts commands and polls the events, both queues are
+ * spsc_rings. After events were queued in a period, notify is called from the
+ * worker thread (the GUI uses Fl::awake), the receiver then calls poll_events.
+ *
+ * While the worker exists the sequencer of the ttt must only be used through post ().
+ * The other methods of the ttt (test object, test person, database) may be used
+ * while the sequencer is stopped. Construct the ttt without display callbacks
+ * and without measurement_table, they would be called in the worker thread
+ * (the TTT_EVENT_TABLE_* events carry the table updates).
+ */
+class ttt_worker
+{
+private:
+  ttt *t;
+  double period;
+  cb_worker_notify *notify;
+  void *notify_data;
+
+  spsc_ring<ttt_command> commands;
+  spsc_ring<ttt_event> events;
+  deque<ttt_event> pending_events;   // ring was full, only used by the worker thread
+  size_t pushed_events;              // in the current period, only used by the worker thread
+
+  atomic<bool> quit;
+  atomic<bool> running;
+  thread th;
+
+  static void event_cb (void *user_data, const ttt_event &e);
+  void queue_event (const ttt_event &e);
+  void queue_error (const string &what);
+  void stop_on_error ();
+  void execute (const ttt_command &c);
+  void loop ();
+
+public:
+  // period: of ttt::run in s, 0 = as fast as possible while the sequencer is running
+  ttt_worker (ttt *t, cb_worker_notify *notify = 0, void *notify_data = 0,
+              double period = TTT_WORKER_PERIOD);
+  ~ttt_worker ();
+
+  // returns false if the queue is full
+  bool post (const ttt_command &c);
+
+  // append the events since the last call to out, returns the number of events
+  size_t poll_events (vector<ttt_event> &out);
+
+  // state of the sequencer as seen by the worker (after TTT_EVENT_SEQUENCER_STARTED/STOPPED)
+  bool is_running ()
+  {
+    return running.load ();
+  }
+};
+
+#endif
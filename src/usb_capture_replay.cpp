@@ -0,0 +1,252 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class usb_capture_replay: feed a liballuris USB capture back as virtual device
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "usb_capture_replay.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// print only the first differences
+#define MAX_PRINTED_MISMATCHES 10
+
+static uint64_t get_le (const unsigned char *p, int n)
+{
+  uint64_t v = 0;
+  for (int k = n - 1; k >= 0; --k)
+    v = (v << 8) | p[k];
+  return v;
+}
+
+vector<usb_capture_record> read_usb_capture (string fn, uint64_t *start)
+{
+  FILE *fp = fopen (fn.c_str (), "rb");
+  if (! fp)
+    throw runtime_error (string ("read_usb_capture: Can't open ") + fn);
+
+  unsigned char h[16];
+  if (fread (h, 1, sizeof (h), fp) != sizeof (h) || memcmp (h, LIBALLURIS_CAPTURE_MAGIC, 8))
+    {
+      fclose (fp);
+      throw runtime_error (fn + " is no liballuris capture file");
+    }
+  if (start)
+    *start = get_le (h + 8, 8);
+
+  vector<usb_capture_record> ret;
+  unsigned char r[LIBALLURIS_CAPTURE_RECORD_SIZE];
+  while (fread (r, 1, sizeof (r), fp) == sizeof (r))
+    {
+      usb_capture_record rec;
+      rec.us = get_le (r, 8);
+      rec.direction = r[8];
+      rec.device = r[9];
+      rec.result = (signed char) r[11];
+      rec.timeout = get_le (r + 12, 2);
+      rec.payload.resize (get_le (r + 14, 2));
+      if (rec.payload.size () && fread (rec.payload.data (), 1, rec.payload.size (), fp) != rec.payload.size ())
+        {
+          cerr << "read_usb_capture: " << fn << " is truncated" << endl;
+          break;
+        }
+      ret.push_back (rec);
+    }
+  fclose (fp);
+  return ret;
+}
+
+void usb_capture_to_text (string fn, ostream &out)
+{
+  static const char *dir_names[] = {"OUT", "IN ", "STR", "HST"};
+
+  uint64_t start;
+  vector<usb_capture_record> v = read_usb_capture (fn, &start);
+  out << "# liballuris capture " << fn << ", start = " << start / 1000000 << "s since epoch" << endl;
+  out << "# time[s] dir device result timeout[ms] payload" << endl;
+
+  char buf[32];
+  for (unsigned int k = 0; k < v.size (); ++k)
+    {
+      const usb_capture_record &r = v[k];
+      snprintf (buf, sizeof (buf), "%.6f", r.us * 1e-6);
+      out << buf << " " << ((r.direction >= 0 && r.direction <= 3)? dir_names[r.direction] : "???")
+          << " " << r.device << " " << (r.result ? liballuris_error_name (r.result) : "OK") << " " << r.timeout << " ";
+      for (unsigned int i = 0; i < r.payload.size (); ++i)
+        {
+          snprintf (buf, sizeof (buf), "%02X", r.payload[i]);
+          out << buf;
+        }
+      out << endl;
+    }
+}
+
+usb_capture_replay::usb_capture_replay (string fn, int device, bool rt)
+  : pos (0), realtime (rt), virtual_us (0), mismatches (0), skipped (0), handle (0)
+{
+  vector<usb_capture_record> all = read_usb_capture (fn);
+  for (unsigned int k = 0; k < all.size (); ++k)
+    if (all[k].device == device || all[k].direction == LIBALLURIS_CAPTURE_HOST)
+      records.push_back (all[k]);
+
+  find_serial ();
+
+  int r = liballuris_add_virtual_device (serial.c_str (), transfer_cb, this, &handle);
+  if (r)
+    throw runtime_error (string ("usb_capture_replay: liballuris_add_virtual_device failed: ") + liballuris_error_name (r));
+
+  t_start = chrono::steady_clock::now ();
+  cout << "usb_capture_replay c'tor " << fn << ", device " << device << ": " << records.size ()
+       << " records, serial = '" << serial << "'" << (realtime ? ", realtime" : "") << endl;
+}
+
+usb_capture_replay::~usb_capture_replay ()
+{
+  cout << "usb_capture_replay d'tor: " << pos << " of " << records.size () << " records replayed, "
+       << mismatches << " commands differ, " << skipped << " reads skipped" << endl;
+  liballuris_remove_virtual_device (handle);
+}
+
+void usb_capture_replay::find_serial ()
+{
+  for (unsigned int k = 0; k + 1 < records.size (); ++k)
+    {
+      const vector<unsigned char> &out = records[k].payload;
+      const vector<unsigned char> &in = records[k + 1].payload;
+      if (   records[k].direction == LIBALLURIS_CAPTURE_OUT
+          && out.size () == 3 && out[0] == 0x08 && out[2] == 6
+          && records[k + 1].direction == LIBALLURIS_CAPTURE_IN
+          && in.size () == 6 && in[0] == 0x08 && in[2] == 6)
+        {
+          int number = in[3] | (in[4] << 8);
+          if (number == 65535)
+            continue;
+          char buf[30];
+          snprintf (buf, sizeof (buf), "%c.%i", in[5] + 'A', number);
+          serial = buf;
+          return;
+        }
+    }
+}
+
+int usb_capture_replay::transfer_cb (void* user_data, unsigned char endpoint,
+                                     unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  usb_capture_replay *r = static_cast<usb_capture_replay *> (user_data);
+  lock_guard<mutex> lock (r->mtx);
+  *transferred = 0;
+  if (endpoint & LIBUSB_ENDPOINT_IN)
+    return r->receive (data, length, transferred, timeout);
+  return r->send (data, length, transferred);
+}
+
+// move the virtual clock forward, in realtime mode also the wall clock
+void usb_capture_replay::advance (uint64_t us)
+{
+  if (us > virtual_us)
+    virtual_us = us;
+  if (realtime)
+    this_thread::sleep_until (t_start + chrono::microseconds (virtual_us));
+}
+
+int usb_capture_replay::send (unsigned char *data, int length, int *transferred)
+{
+  while (pos < records.size () && records[pos].direction != LIBALLURIS_CAPTURE_OUT)
+    {
+      if (records[pos].direction == LIBALLURIS_CAPTURE_HOST)
+        host_events.push_back (records[pos].payload);
+      else
+        skipped++;
+      pos++;
+    }
+  if (pos >= records.size ())
+    return LIBUSB_ERROR_NO_DEVICE;
+
+  const usb_capture_record &r = records[pos++];
+  if (r.payload.size () != (size_t) length || memcmp (r.payload.data (), data, length))
+    {
+      if (mismatches++ < MAX_PRINTED_MISMATCHES)
+        {
+          fprintf (stderr, "usb_capture_replay: command at %.6fs differs, recorded", r.us * 1e-6);
+          for (unsigned int k = 0; k < r.payload.size (); ++k)
+            fprintf (stderr, " %02X", r.payload[k]);
+          fprintf (stderr, ", sent");
+          for (int k = 0; k < length; ++k)
+            fprintf (stderr, " %02X", data[k]);
+          fprintf (stderr, "\n");
+        }
+    }
+
+  advance (r.us);
+  if (r.result == LIBUSB_SUCCESS)
+    *transferred = length;
+  return r.result;
+}
+
+int usb_capture_replay::receive (unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  if (pos >= records.size ())
+    return LIBUSB_ERROR_NO_DEVICE;
+
+  const usb_capture_record &r = records[pos];
+  uint64_t wait_us = timeout * 1000ULL;
+
+  // the host reads more often than recorded, a streaming packet isn't due yet
+  // or the application has to take a host event first
+  if (   r.direction == LIBALLURIS_CAPTURE_OUT
+      || r.direction == LIBALLURIS_CAPTURE_HOST
+      || (r.direction == LIBALLURIS_CAPTURE_STREAM && timeout && r.us > virtual_us + wait_us))
+    {
+      advance (virtual_us + wait_us);
+      return LIBUSB_ERROR_TIMEOUT;
+    }
+
+  pos++;
+  advance (r.us);
+  if (r.result != LIBUSB_SUCCESS)
+    return r.result;
+  if ((int) r.payload.size () > length)
+    return LIBUSB_ERROR_OVERFLOW;
+
+  memcpy (data, r.payload.data (), r.payload.size ());
+  *transferred = r.payload.size ();
+  return LIBUSB_SUCCESS;
+}
+
+bool usb_capture_replay::poll_host_event (vector<unsigned char> &payload)
+{
+  lock_guard<mutex> lock (mtx);
+  if (! host_events.empty ())
+    {
+      payload = host_events.front ();
+      host_events.pop_front ();
+      return true;
+    }
+  if (pos < records.size () && records[pos].direction == LIBALLURIS_CAPTURE_HOST)
+    {
+      payload = records[pos].payload;
+      advance (records[pos].us);
+      pos++;
+      return true;
+    }
+  return false;
+}
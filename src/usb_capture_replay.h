@@ -0,0 +1,138 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+class usb_capture_replay: feed a liballuris USB capture back as virtual device
+
+This file is part of TTT_certify.
+
+TTT_certify is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+TTT_certify is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef USB_CAPTURE_REPLAY_H
+#define USB_CAPTURE_REPLAY_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include "liballuris.h"
+
+using namespace std;
+
+//! one frame of a capture written by liballuris_set_capture_file
+struct usb_capture_record
+{
+  uint64_t us;                    //!< microseconds since start of capture
+  int direction;                  //!< enum liballuris_capture_direction
+  int device;
+  int result;                     //!< 0 or libusb error code
+  unsigned int timeout;           //!< in ms
+  vector<unsigned char> payload;
+};
+
+/*!
+ * read all records of a capture file
+ * start: microseconds since 1.1.1970, may be NULL
+ */
+vector<usb_capture_record> read_usb_capture (string fn, uint64_t *start = 0);
+
+//! one line per record: time, direction, device, result, timeout, payload in hex
+void usb_capture_to_text (string fn, ostream &out);
+
+/*
+ * The frames of one device in the capture are replayed as virtual device
+ * (see liballuris_add_virtual_device) in the recorded order:
+ *
+ * - a command (OUT) is compared with the next recorded command, differences
+ *   are counted and printed. Recorded reads before it, which the host skips, are dropped.
+ * - a read (IN) returns the next recorded reply, sample packet or error.
+ *   If the next record is a command, the read times out.
+ *
+ * Without realtime the replay runs at full speed. Streaming packets still keep
+ * their order relative to the timeouts of the host: a virtual clock follows the
+ * recorded time and is advanced by every timeout, a packet is only delivered
+ * if it was recorded before the virtual clock + timeout.
+ * With realtime the replay also waits until the recorded time.
+ *
+ * Host events (inputs of the application, see liballuris_capture_host_event) of all
+ * devices are returned by poll_host_event. Reads time out until the next host event
+ * was taken, the application gets it after the same frames as in the capture.
+ *
+ * At the end of the capture all transfers return LIBUSB_ERROR_NO_DEVICE.
+ */
+class usb_capture_replay
+{
+private:
+  vector<usb_capture_record> records;
+  size_t pos;
+  bool realtime;
+  uint64_t virtual_us;
+  chrono::steady_clock::time_point t_start;
+  unsigned long mismatches, skipped;
+  deque< vector<unsigned char> > host_events;   // passed by a command
+  string serial;
+  libusb_device_handle *handle;
+  mutex mtx;
+
+  static int transfer_cb (void* user_data, unsigned char endpoint,
+                          unsigned char *data, int length, int *transferred, unsigned int timeout);
+  int send (unsigned char *data, int length, int *transferred);
+  int receive (unsigned char *data, int length, int *transferred, unsigned int timeout);
+  void advance (uint64_t us);
+  void find_serial ();
+
+public:
+  usb_capture_replay (string fn, int device = 0, bool realtime = false);
+  ~usb_capture_replay ();
+
+  libusb_device_handle* get_handle ()
+  {
+    return handle;
+  }
+
+  //! from the first reply to liballuris_get_serial_number in the capture, may be empty
+  string get_serial ()
+  {
+    return serial;
+  }
+
+  bool finished ()
+  {
+    return pos >= records.size ();
+  }
+
+  //! next host event, false if there is none before the next frame
+  bool poll_host_event (vector<unsigned char> &payload);
+
+  //! commands which differ from the capture
+  unsigned long get_mismatches ()
+  {
+    return mismatches;
+  }
+
+  //! recorded reads which weren't requested by the host
+  unsigned long get_skipped ()
+  {
+    return skipped;
+  }
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+Checks for report_queue (the report itself is checked by check_batch)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <assert.h>
+#include <iostream>
+#include <sstream>
+#include "report_queue.h"
+
+#define NUM_JOBS 3
+
+int main ()
+{
+  // a database which can't be opened: every job is done with an error
+  report_queue q ("./check_report_queue_missing.db");
+
+  vector<report_job> done;
+  assert (q.pop_done (done) == 0);
+
+  for (int k = 0; k < NUM_JOBS; ++k)
+    {
+      report_job j;
+      j.measurement_id = k + 1;
+      ostringstream fn;
+      fn << "check_report_queue_" << k + 1 << ".pdf";
+      j.filename = fn.str ();
+      j.repeat_on_tolerance_violation = false;
+      q.push (j);
+    }
+  q.wait ();
+
+  // all jobs in the order of push, returned only once
+  assert (q.pop_done (done) == NUM_JOBS);
+  assert (done.size () == NUM_JOBS);
+  for (int k = 0; k < NUM_JOBS; ++k)
+    {
+      assert (done[k].measurement_id == k + 1);
+      assert (! done[k].error.empty ());
+      assert (! done[k].result.values_below_max_deviation);
+    }
+  assert (q.pop_done (done) == 0);
+  assert (done.size () == NUM_JOBS);
+
+  // wait without jobs returns
+  q.wait ();
+
+  cout << "check_report_queue: OK" << endl;
+  return 0;
+}
@@ -0,0 +1,277 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+Runs the simulation corpus in parallel and compares against expected results
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Every simulation file is replayed with REPLAY_FAST in its own ttt instance
+ * with its own in-memory database, so the runs can't interfere.
+ *
+ * The test object id is taken from the filename (test_object_id<ID>[_suffix].log).
+ * Expected results are read from EXPECTED_DIR/<basename>.txt,
+ * one line per meas_step: nominal_value<TAB>peak_torque<TAB>rise_time
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <libintl.h>
+#include <locale.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include "ttt.h"
+
+#define SQL_DIR "../src/"
+#define EXPECTED_DIR "./sim_expected/"
+
+// max. allowed difference to the expected values
+#define PEAK_TOLERANCE 1e-6
+#define RISE_TIME_TOLERANCE 1e-6
+
+struct sim_job
+{
+  string fn;
+  string name;           // basename without .log
+  int to_id;
+
+  vector<step_result> results;
+  double duration;       // wall clock time in s
+  string error;          // exception or difference to expected
+  bool has_expected;
+  bool passed;
+};
+
+static string basename_without_ext (string fn)
+{
+  size_t p = fn.find_last_of ("/\\");
+  if (p != string::npos)
+    fn = fn.substr (p + 1);
+  p = fn.rfind (".log");
+  if (p != string::npos)
+    fn = fn.substr (0, p);
+  return fn;
+}
+
+static int test_object_id_from_name (string name)
+{
+  size_t p = name.find ("test_object_id");
+  if (p == string::npos)
+    return -1;
+  return atoi (name.c_str () + p + strlen ("test_object_id"));
+}
+
+static bool load_expected (string fn, vector<step_result> &expected)
+{
+  ifstream in (fn.c_str ());
+  if (! in)
+    return false;
+
+  string line;
+  while (getline (in, line))
+    {
+      if (line.empty () || line[0] == '#')
+        continue;
+
+      istringstream is (line);
+      step_result r;
+      is >> r.nominal_value >> r.peak_torque >> r.rise_time;
+      expected.push_back (r);
+    }
+  return true;
+}
+
+static void save_expected (string fn, const vector<step_result> &results)
+{
+  ofstream out (fn.c_str ());
+  if (! out)
+    throw runtime_error (string ("Can't write ") + fn);
+
+  out << "# nominal_value\tpeak_torque\trise_time\tdescription" << endl;
+  out << setprecision (10);
+  for (unsigned int k=0; k<results.size (); ++k)
+    out << results[k].nominal_value << "\t" << results[k].peak_torque << "\t"
+        << results[k].rise_time << "\t# " << results[k].description << endl;
+}
+
+static void compare (sim_job &job, const vector<step_result> &expected)
+{
+  ostringstream os;
+  if (expected.size () != job.results.size ())
+    os << "expected " << expected.size () << " steps, got " << job.results.size ();
+  else
+    for (unsigned int k=0; k<expected.size (); ++k)
+      {
+        const step_result &e = expected[k];
+        const step_result &r = job.results[k];
+        if (fabs (e.nominal_value - r.nominal_value) > PEAK_TOLERANCE
+            || fabs (e.peak_torque - r.peak_torque) > PEAK_TOLERANCE
+            || fabs (e.rise_time - r.rise_time) > RISE_TIME_TOLERANCE)
+          {
+            os << "step " << k + 1 << ": expected peak=" << e.peak_torque << " rise_time=" << e.rise_time
+               << ", got peak=" << r.peak_torque << " rise_time=" << r.rise_time;
+            break;
+          }
+      }
+  job.error = os.str ();
+  job.passed = job.error.empty ();
+}
+
+static void run_job (sim_job &job)
+{
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now ();
+  try
+    {
+      class ttt my (NULL, NULL, NULL, NULL, NULL, NULL, ":memory:", 0.6, 0.1);
+      my.exec_sql_file (SQL_DIR "create_database.sql");
+      my.exec_sql_file (SQL_DIR "fill_database_debug.sql");
+      my.set_headless (true);
+
+      my.load_test_person (1);
+      my.load_test_object (job.to_id);
+      my.connect_measurement_input (job.fn, REPLAY_FAST);
+      my.start_sequencer_ISO6789 (21.23, 34.56, false, false);
+
+      while (my.run ())
+        ;
+
+      my.get_step_results (job.results);
+    }
+  catch (exception& e)
+    {
+      job.error = e.what ();
+    }
+  job.duration = chrono::duration<double> (chrono::steady_clock::now () - t0).count ();
+}
+
+/*
+  Usage: check_sim_corpus [-j THREADS] [-u] SIM_FN...
+  -u: write the current results as expected results
+*/
+int main (int argc, char **argv)
+{
+  unsigned int num_threads = thread::hardware_concurrency ();
+  bool update = false;
+
+  int opt;
+  while ((opt = getopt (argc, argv, "j:u")) != -1)
+    {
+      if (opt == 'j')
+        num_threads = atoi (optarg);
+      else if (opt == 'u')
+        update = true;
+      else
+        {
+          cerr << "Usage: check_sim_corpus [-j THREADS] [-u] SIM_FN..." << endl;
+          return -1;
+        }
+    }
+
+  if (optind >= argc)
+    {
+      cerr << "Usage: check_sim_corpus [-j THREADS] [-u] SIM_FN..." << endl;
+      return -1;
+    }
+  if (num_threads < 1)
+    num_threads = 1;
+
+  setlocale (LC_ALL, "");
+  bindtextdomain("ttt","./po");
+  textdomain ("ttt");
+
+  vector<sim_job> jobs;
+  for (int k=optind; k<argc; ++k)
+    {
+      sim_job j;
+      j.fn = argv[k];
+      j.name = basename_without_ext (j.fn);
+      j.to_id = test_object_id_from_name (j.name);
+      j.duration = 0;
+      j.has_expected = false;
+      j.passed = false;
+      jobs.push_back (j);
+    }
+
+  // the sequencer is very talkative, mute it while the jobs are running
+  ofstream null_out ("/dev/null");
+  streambuf *cout_buf = cout.rdbuf (null_out.rdbuf ());
+
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now ();
+
+  atomic<unsigned int> next_job (0);
+  vector<thread> pool;
+  for (unsigned int k=0; k<num_threads && k<jobs.size (); ++k)
+    pool.push_back (thread ([&]
+    {
+      unsigned int i;
+      while ((i = next_job++) < jobs.size ())
+        if (jobs[i].to_id > 0)
+          run_job (jobs[i]);
+        else
+          jobs[i].error = "can't get test_object id from filename";
+    }));
+
+  for (unsigned int k=0; k<pool.size (); ++k)
+    pool[k].join ();
+
+  double total = chrono::duration<double> (chrono::steady_clock::now () - t0).count ();
+  cout.rdbuf (cout_buf);
+
+  int num_failed = 0;
+  cout << left << setw (36) << "sequence" << right << setw (8) << "steps" << setw (10) << "time[s]" << "  result" << endl;
+  for (unsigned int k=0; k<jobs.size (); ++k)
+    {
+      sim_job &j = jobs[k];
+      string expected_fn = string (EXPECTED_DIR) + j.name + ".txt";
+      string result;
+
+      if (j.error.empty ())
+        {
+          vector<step_result> expected;
+          if (update)
+            {
+              save_expected (expected_fn, j.results);
+              j.passed = true;
+              result = "updated";
+            }
+          else if (load_expected (expected_fn, expected))
+            {
+              j.has_expected = true;
+              compare (j, expected);
+              result = j.passed? "passed" : "FAILED " + j.error;
+            }
+          else
+            result = "FAILED no expected results in " + expected_fn;
+        }
+      else
+        result = "FAILED " + j.error;
+
+      if (! j.passed)
+        num_failed++;
+
+      cout << left << setw (36) << j.name << right << setw (8) << j.results.size ()
+           << setw (10) << fixed << setprecision (2) << j.duration << "  " << result << endl;
+    }
+
+  cout << jobs.size () - num_failed << "/" << jobs.size () << " passed, "
+       << num_threads << " threads, " << fixed << setprecision (2) << total << "s" << endl;
+
+  return (num_failed)? 1 : 0;
+}
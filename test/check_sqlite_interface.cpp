@@ -365,6 +365,43 @@ int main ()
     mm.add_measurement_item (get_localtime(), k*11, k*22, k/10.0);
 
   mm.save (db);
+  assert (mm.state == "finished");
+
+  /*********** CHECK incremental measurement (begin, append_item, finish) **********/
+  measurement mi;
+  mi.norm = "ISO6789";
+  mi.tp = tp;
+  mi.tt = tt;
+  mi.to = to;
+  mi.start_time = get_localtime ();
+  mi.repeat_on_timing_violation = true;
+  mi.begin (db);
+
+  for (int k=0; k<3; ++k)
+    {
+      measurement_item *p = new measurement_item;
+      p->ts = get_localtime ();
+      p->nominal_value = 10;
+      p->indicated_value = 10 + k * 0.1;
+      p->rise_time = -1;
+      mi.append_item (db, p);
+    }
+
+  // the measurement is unfinished until finish
+  int unfinished_tp_id = 0, unfinished_to_id = 0;
+  assert (find_unfinished_measurement (db, tt.id, unfinished_tp_id, unfinished_to_id) == mi.id);
+  assert (unfinished_tp_id == tp.id && unfinished_to_id == to.id);
+
+  measurement mi2;
+  mi2.load_with_id (db, mi.id);
+  assert (mi2.state == "running");
+  assert (mi2.repeat_on_timing_violation);
+  assert (mi2.get_measurement_item_count () == 3);
+  assert (mi2.get_measurement_item (2)->indicated_value == 10.2);
+
+  mi.end_time = get_localtime ();
+  mi.finish (db);
+  assert (find_unfinished_measurement (db, tt.id, unfinished_tp_id, unfinished_to_id) == 0);
 
   /********** CHECK search_test_objects ******************/
   vector<test_object> vto;
@@ -0,0 +1,120 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+Checks for ttt_decimator (see ttt_monitor.h)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <assert.h>
+#include <iostream>
+#include "ttt_monitor.h"
+
+// push raw[0..n-1] with the indices first_index, first_index + 1, ...
+static void push (ttt_decimator &d, const int *raw, int n, unsigned long first_index, vector<ttt_sample> &out)
+{
+  for (int k = 0; k < n; ++k)
+    {
+      ttt_sample s;
+      s.index = first_index + k;
+      s.raw = raw[k];
+      d.push (s, out);
+    }
+}
+
+static void check_sample (const ttt_sample &s, unsigned long index, int raw)
+{
+  if (s.index != index || s.raw != raw)
+    cerr << "expected index=" << index << " raw=" << raw
+         << ", got index=" << s.index << " raw=" << s.raw << endl;
+  assert (s.index == index && s.raw == raw);
+}
+
+static void check_mean ()
+{
+  ttt_decimator d (ttt_decimator::DECIMATE_MEAN, 3);
+  vector<ttt_sample> out;
+
+  // one sample per 3 input samples with the index of the first, rounded half away from zero
+  const int raw[] = {1, 2, 4,  -1, -2, -4,  10, 10, 10,  5, 6};
+  push (d, raw, 9, 100, out);
+  assert (out.size () == 3);
+  check_sample (out[0], 100, 2);
+  check_sample (out[1], 103, -2);
+  check_sample (out[2], 106, 10);
+
+  // an incomplete block is only written by flush
+  push (d, raw + 9, 2, 109, out);
+  assert (out.size () == 3);
+  d.flush (out);
+  assert (out.size () == 4);
+  check_sample (out[3], 109, 6);
+
+  // nothing left
+  d.flush (out);
+  assert (out.size () == 4);
+}
+
+static void check_minmax ()
+{
+  ttt_decimator d (ttt_decimator::DECIMATE_MINMAX, 2);
+  vector<ttt_sample> out;
+
+  // blocks of 4 samples, minimum and maximum at the first and the middle index
+  const int raw[] = {0, 5, -3, 1,  -2, 1, 8, 3,  7, 7, 7, 7,  4, -9};
+  push (d, raw, 12, 0, out);
+  assert (out.size () == 6);
+  check_sample (out[0], 0, -3);
+  check_sample (out[1], 2, 5);
+  check_sample (out[2], 4, -2);
+  check_sample (out[3], 6, 8);
+  // constant block: also two samples
+  check_sample (out[4], 8, 7);
+  check_sample (out[5], 10, 7);
+
+  // incomplete block, written by flush
+  push (d, raw + 12, 2, 12, out);
+  d.flush (out);
+  assert (out.size () == 8);
+  check_sample (out[6], 12, -9);
+  check_sample (out[7], 14, 4);
+
+  // two samples per 2*ratio input samples
+  assert (d.output_sps () == TTT_SPS / 2);
+  ttt_decimator m (ttt_decimator::DECIMATE_MEAN, 3);
+  assert (m.output_sps () == TTT_SPS / 3);
+}
+
+int main ()
+{
+  check_mean ();
+  check_minmax ();
+
+  bool thrown = false;
+  try
+    {
+      ttt_decimator d (ttt_decimator::DECIMATE_MEAN, 0);
+    }
+  catch (std::runtime_error &e)
+    {
+      thrown = true;
+    }
+  assert (thrown);
+
+  cout << "check_ttt_decimator: OK" << endl;
+  return 0;
+}
@@ -32,10 +32,196 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <locale.h>
 
 #define TEST_DEBUG_COUT
+#include <assert.h>
 #include "ttt.h"
 
+// feed one sample, returns the command of the step
+static out_cmd feed (step &s, double torque, unsigned long index)
+{
+  step_sample x = {torque, index, false};
+  return s.process (&x, 1).cmd;
+}
+
+// slow click with more maxima between 80% and the peak than STEP_RISE_RECORDS,
+// the 80% crossing mustn't be lost
+static void check_rise_records ()
+{
+  peak_click_step s (10, 0, 100, false, 0.6, 0.8);
+  const unsigned long N = 20 * TTT_SPS;     // 0..10Nm in 20s, 80%..100% in 4s
+  unsigned long index = 0;
+  for (unsigned long k = 0; k <= N; ++k)
+    feed (s, 10.0 * k / N, index++);
+  for (unsigned long k = 0; k < TTT_SPS && ! s.is_finished (); ++k)
+    feed (s, 0, index++);
+
+  assert (s.is_finished ());
+  assert (s.get_peak_torque () == 10);
+  cout << "check_rise_records rise_time=" << s.get_rise_time () << endl;
+  assert (fabs (s.get_rise_time () - 0.2 * N / TTT_SPS) < 2.0 / TTT_SPS);
+
+  // the same ramp with max_time 2s overflows the records: too slow, not finished
+  peak_click_step t (10, 0, 2, false, 0.6, 0.8);
+  index = 0;
+  for (unsigned long k = 0; k <= N; ++k)
+    feed (t, 10.0 * k / N, index++);
+  for (unsigned long k = 0; k < TTT_SPS; ++k)
+    feed (t, 0, index++);
+
+  assert (! t.is_finished ());
+  cout << "check_rise_records overflow rise_time=" << t.get_rise_time () << endl;
+  assert (t.get_rise_time () > 2);
+}
+
+// motor test rig (10Nm/s while running) with a tool which doesn't click
+static void check_motor_ramp ()
+{
+  motor_ramp m;
+  m.enable (10, 1.0, MOTOR_OVERLOAD_FACTOR);
+
+  double torque = 0;
+  bool running = false;
+  int starts = 0, stops = 0;
+  bool switched = false;
+  unsigned long last_switch = 0;
+  bool ramp = false;
+  unsigned long ramp_index = 0;
+  unsigned long index;
+  for (index = 0; index < 10 * TTT_SPS && ! m.is_done (); ++index)
+    {
+      if (! ramp && torque >= 8)
+        {
+          ramp = true;
+          ramp_index = index;
+        }
+      // above 80% the load follows the ramp to target in 1s, at most one
+      // pulse (MOTOR_MIN_PULSE at 10Nm/s) above the band
+      if (ramp)
+        assert (torque / 10 <= 0.8 + 0.2 * (index - ramp_index) / TTT_SPS + MOTOR_RAMP_BAND + MOTOR_MIN_PULSE + 1e-9);
+
+      out_cmd c = m.control (torque, index);
+      if (c != NO_CMD)
+        {
+          // START and STOP alternate, the first one is START
+          assert ((c == CMD_MOTOR_START && ! running) || (c == CMD_MOTOR_STOP && running));
+          // no chattering, only the stop at the limit is immediate
+          assert (! switched || m.is_done () || index - last_switch >= MOTOR_MIN_PULSE * TTT_SPS);
+          switched = true;
+          last_switch = index;
+          running = (c == CMD_MOTOR_START);
+          starts += running;
+          stops += ! running;
+        }
+      if (running)
+        torque += 10.0 / TTT_SPS;
+    }
+
+  cout << "check_motor_ramp starts=" << starts << " stops=" << stops << " torque=" << torque << endl;
+  // pulsed on the ramp, stopped at the limit
+  assert (m.is_done ());
+  assert (! running);
+  assert (starts > 1 && starts == stops);
+  assert (fabs (torque - 10 * MOTOR_OVERLOAD_FACTOR) < 0.1);
+  assert (m.control (torque, index) == NO_CMD);
+
+  // returned exactly once
+  assert (m.release () == CMD_MOTOR_RETURN);
+  assert (m.release () == NO_CMD);
+  assert (m.control (0, index + TTT_SPS) == NO_CMD);
+}
+
+// motor driven peak_meas_step: loaded to nominal, returned once, the load is released
+static void check_motor_step ()
+{
+  peak_meas_step s (10, 0.6, 0.1);
+  s.set_motor_driven ();
+  assert (s.is_motor_driven ());
+
+  double torque = 0;
+  bool running = false;
+  int returns = 0;
+  unsigned long index;
+  for (index = 0; index < 10 * TTT_SPS && ! s.is_finished (); ++index)
+    {
+      out_cmd c = feed (s, torque, index);
+      if (c == CMD_MOTOR_START)
+        running = true;
+      else if (c == CMD_MOTOR_STOP)
+        running = false;
+      else if (c == CMD_MOTOR_RETURN)
+        {
+          assert (! running);
+          returns++;
+          torque = 0;
+        }
+      if (running)
+        torque += 10.0 / TTT_SPS;
+    }
+
+  cout << "check_motor_step peak=" << s.get_peak_torque () << " returns=" << returns << endl;
+  assert (s.is_finished ());
+  assert (returns == 1);
+  assert (s.get_peak_torque () >= 10 && s.get_peak_torque () < 10 + 10 * MOTOR_MIN_PULSE);
+}
+
+// feed torque until the step is finished or returns a command, at most max_time s
+static out_cmd feed_until (step &s, double torque, unsigned long &index, double max_time)
+{
+  unsigned long end = index + max_time * TTT_SPS;
+  out_cmd c = NO_CMD;
+  while (index < end && c == NO_CMD && ! s.is_finished ())
+    c = feed (s, torque, index++);
+  return c;
+}
+
+// tare of the TTT in batch mode: skipped while the TTT shows zero
+static void check_tare_skip ()
+{
+  unsigned long index = 0;
+
+  // within the band for TTT_TARE_SKIP_TIME: finished without tare
+  tare_torque_tester_step in_band (0.05);
+  assert (feed_until (in_band, 0.04, index, TTT_TARE_SKIP_TIME + 0.1) == NO_CMD);
+  assert (in_band.is_finished ());
+
+  // not before TTT_TARE_SKIP_TIME, a sample outside the band restarts the time
+  tare_torque_tester_step spike (0.05);
+  assert (feed_until (spike, -0.04, index, 0.9 * TTT_TARE_SKIP_TIME) == NO_CMD);
+  assert (! spike.is_finished ());
+  feed (spike, 0.06, index++);
+  assert (feed_until (spike, 0.0, index, 0.9 * TTT_TARE_SKIP_TIME) == NO_CMD);
+  assert (! spike.is_finished ());
+  assert (feed_until (spike, 0.0, index, 0.2 * TTT_TARE_SKIP_TIME) == NO_CMD);
+  assert (spike.is_finished ());
+
+  // outside the band: the usual tare after 5s
+  tare_torque_tester_step out_band (0.05);
+  assert (feed_until (out_band, 0.1, index, 4.9) == NO_CMD);
+  assert (! out_band.is_finished ());
+  assert (feed_until (out_band, 0.1, index, 0.2) == CMD_TARA);
+  step_sample confirmed = {0.1, index++, true};
+  out_band.process (&confirmed, 1);
+  feed (out_band, 0.0, index++);
+  assert (out_band.is_finished ());
+
+  // without band (first object of a batch) the tare is never skipped
+  tare_torque_tester_step no_band;
+  assert (feed_until (no_band, 0.0, index, 4.9) == NO_CMD);
+  assert (! no_band.is_finished ());
+  assert (feed_until (no_band, 0.0, index, 0.2) == CMD_TARA);
+}
+
 int main (int argc, char **argv)
 {
+  check_rise_records ();
+  check_motor_ramp ();
+  check_motor_step ();
+  check_tare_skip ();
+  if (argc == 1)
+    {
+      cout << "check_ttt_step: OK" << endl;
+      return 0;
+    }
+
   static double start_peak_torque_factor = 0.6;
   static double stop_peak_torque_factor = 0.1;
   class ttt my (NULL, NULL, NULL, NULL, NULL, NULL, "ttt_certify.db", start_peak_torque_factor, stop_peak_torque_factor);
@@ -48,7 +234,7 @@ int main (int argc, char **argv)
     id = atoi (argv[1]);
   else
     {
-      cerr << "Usage: check_ttt_step TEST_OBJECT_RECORD_ID" << endl;
+      cerr << "Usage: check_ttt_step [TEST_OBJECT_RECORD_ID]" << endl;
       return -1;
     }
   my.load_test_object (id);
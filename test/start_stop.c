@@ -70,6 +70,8 @@ int main()
   if (r)
     ret = 1;
 
+  liballuris_print_metrics (stderr, usb_h);
+
   sleep (1.5);
   return ret;
 }
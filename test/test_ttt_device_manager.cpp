@@ -0,0 +1,78 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+Tests for class ttt_device_manager: stream from all connected TTTs in parallel
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "ttt_device_manager.h"
+
+/*
+  Usage: test_ttt_device_manager [SECONDS]
+  every device is polled from its own thread like a ttt sequencer would do
+*/
+int main (int argc, char **argv)
+{
+  int seconds = 10;
+  if (argc == 2)
+    seconds = atoi (argv[1]);
+
+  try
+    {
+      ttt_device_manager mgr;
+      vector<ttt_device *> devs = mgr.open_all ();
+      cout << "opened " << devs.size () << " devices" << endl;
+      if (devs.empty ())
+        return -1;
+
+      vector<unsigned long> num_samples (devs.size (), 0);
+      vector<thread> stations;
+      for (unsigned int k=0; k<devs.size (); ++k)
+        stations.push_back (thread ([&, k]
+        {
+          devs[k]->start ();
+          for (int i=0; i < seconds * 100; ++i)
+            {
+              num_samples[k] += devs[k]->poll_samples ().size ();
+              usleep (10e3);
+            }
+          devs[k]->stop ();
+        }));
+
+      for (unsigned int k=0; k<stations.size (); ++k)
+        stations[k].join ();
+
+      int ret = 0;
+      for (unsigned int k=0; k<devs.size (); ++k)
+        {
+          cout << devs[k]->get_serial () << ": " << num_samples[k] << " samples in " << seconds << "s" << endl;
+          devs[k]->print_usb_metrics ();
+          if (num_samples[k] < 0.95 * seconds * TTT_SPS)
+            ret = 1;
+        }
+      return ret;
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << "Exception: " << e.what () << endl;
+      return -1;
+    }
+}
@@ -0,0 +1,110 @@
+/*
+
+Copyright (C) 2026 Alluris GmbH & Co. KG <weber@alluris.de>
+
+Long-duration decimated recording of a TTT (see class ttt_monitor)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  See ../COPYING
+If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <chrono>
+#include "ttt_monitor.h"
+#include "ttt_emulator.h"
+
+#define USAGE "Usage: ttt_monitor [-m device|mean|minmax] [-r RATIO] [-t SECONDS] [-e LOG] OUT_FN"
+
+/*
+  -m: decimation on the TTT (device) or on the host (mean, minmax; default)
+  -r: decimation ratio 1..255 and a divisor of 900, default 9 (100Hz)
+  -t: duration in s, default 10
+  -e: use ttt_emulator with the recorded torque in LOG instead of a TTT on USB
+  Convert OUT_FN to text with raw2log.
+*/
+int main (int argc, char **argv)
+{
+  ttt_monitor_mode mode = TTT_MONITOR_MINMAX;
+  int ratio = 9;
+  double duration = 10;
+  const char *emu_log = 0;
+
+  int opt;
+  while ((opt = getopt (argc, argv, "m:r:t:e:")) != -1)
+    {
+      if (opt == 'm' && ! strcmp (optarg, "device"))
+        mode = TTT_MONITOR_DEVICE;
+      else if (opt == 'm' && ! strcmp (optarg, "mean"))
+        mode = TTT_MONITOR_MEAN;
+      else if (opt == 'm' && ! strcmp (optarg, "minmax"))
+        mode = TTT_MONITOR_MINMAX;
+      else if (opt == 'r')
+        ratio = atoi (optarg);
+      else if (opt == 't')
+        duration = atof (optarg);
+      else if (opt == 'e')
+        emu_log = optarg;
+      else
+        {
+          cerr << USAGE << endl;
+          return -1;
+        }
+    }
+
+  if (argc - optind != 1)
+    {
+      cerr << USAGE << endl;
+      return -1;
+    }
+
+  try
+    {
+      // the emulator has to outlive the ttt_device
+      unique_ptr<ttt_emulator> emu;
+      unique_ptr<ttt_device> td;
+      if (emu_log)
+        {
+          emu.reset (new ttt_emulator (emu_log));
+          td.reset (new ttt_device (emu->get_serial ()));
+        }
+      else
+        td.reset (new ttt_device ());
+
+      {
+        ttt_monitor mon (td.get (), argv[optind], mode, ratio);
+
+        chrono::steady_clock::time_point t_end = chrono::steady_clock::now ()
+            + chrono::milliseconds (long (duration * 1000));
+        while (chrono::steady_clock::now () < t_end)
+          {
+            if (! mon.poll ())
+              cerr << "TTT disconnected, waiting..." << endl;
+            usleep (100e3);
+          }
+      }
+      td->print_usb_metrics ();
+    }
+  catch (exception& e)
+    {
+      cerr << "Exception: " << e.what () << endl;
+      return -1;
+    }
+
+  return 0;
+}
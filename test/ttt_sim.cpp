@@ -31,7 +31,12 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <libintl.h>
 
 #include <locale.h>
+#include <memory>
+#include <sstream>
 #include "ttt.h"
+#include "ttt_emulator.h"
+#include "ttt_worker.h"
+#include "usb_capture_replay.h"
 
 void print_indicated_torque (double v)
 {
@@ -53,6 +58,15 @@ void print_peak_torque (double v)
     }
 }
 
+// the emulated click tool is adjusted to the nominal torque of the current step
+static ttt_emulator *click_emu = 0;
+
+void set_click_torque (double v)
+{
+  if (click_emu)
+    click_emu->set_click_torque (1.02 * fabs (v));
+}
+
 void print_instruction (string s)
 {
   cout << "instruction: " << s << endl;
@@ -73,19 +87,92 @@ void print_result (string s)
   cout << "result: " << s << endl;
 }
 
+// -k: simulated crash, the measurement stays "running" in the database
+static int kill_after_items = 0;
+static int accepted_items = 0;
+
+void count_items (void *, const ttt_event &e)
+{
+  if (e.type == TTT_EVENT_ITEM_ACCEPTED && ++accepted_items == kill_after_items)
+    {
+      cout << "killed after " << accepted_items << " items" << endl;
+      _exit (3);
+    }
+}
+
 /*
-  Usage: ttt_sim TEST_OBJECT_RECORD_ID SIM_FN
+  Usage: ttt_sim [-f] [-e [-s SECONDS] [-j JITTER_MS] [-l LOSS] [-m RATE]] [-r] [-w] [-k ITEMS] [-c] TEST_OBJECT_RECORD_ID SIM_FN
+  -f: replay as fast as possible and don't open the report
+  -e: replay SIM_FN with ttt_emulator through ttt_device and liballuris (always real time)
+  -s: the emulator streams SIM_FN from SECONDS, the TTT is tared 5s after the start
+      (skip the torque tester preloads at the beginning of the test signals)
+  -j: max. jitter of the emulated streaming packets in ms
+  -l: probability that an emulated streaming packet is lost (0..1)
+  -m: motor driven calibration, the emulator is a motor test rig with RATE Nm/s
+      and a click tool which triggers 2% above the nominal torque (SIM_FN isn't used)
+  -r: SIM_FN is a USB capture (LIBALLURIS_CAPTURE=file ttt_sim -e ...), replay it through
+      ttt_device and liballuris, with -f at full speed
+  -w: run the sequencer in a ttt_worker thread like the GUI
+      (the confirmations of SIM_FN with -e or -r aren't passed to the worker)
+  -k: exit with 3 after ITEMS accepted measurement items (simulated crash)
+  -c: continue the unfinished measurement of a previous -k run (see ttt::resume_sequencer)
+  TEST_OBJECT_RECORD_ID may be a comma separated list, the test objects
+  are calibrated as batch (see ttt::start_sequencer_ISO6789_batch)
 */
 int main (int argc, char **argv)
 {
   int to_id = 1;
-  if (argc != 3)
+  bool fast = false;
+  bool emulate = false;
+  bool replay = false;
+  bool worker_thread = false;
+  bool resume = false;
+  ttt_emulator_config emu_cfg;
+
+  int opt;
+  while ((opt = getopt (argc, argv, "fes:j:l:m:rwk:c")) != -1)
+    {
+      if (opt == 'f')
+        fast = true;
+      else if (opt == 'e')
+        emulate = true;
+      else if (opt == 'r')
+        replay = true;
+      else if (opt == 'w')
+        worker_thread = true;
+      else if (opt == 's')
+        emu_cfg.log_start = atof (optarg);
+      else if (opt == 'j')
+        emu_cfg.jitter = atof (optarg) * 1e-3;
+      else if (opt == 'l')
+        emu_cfg.packet_loss = atof (optarg);
+      else if (opt == 'm')
+        emu_cfg.motor_rate = atof (optarg);
+      else if (opt == 'k')
+        kill_after_items = atoi (optarg);
+      else if (opt == 'c')
+        resume = true;
+      else
+        {
+          cerr << "Usage: ttt_sim [-f] [-e [-s SECONDS] [-j JITTER_MS] [-l LOSS] [-m RATE]] [-r] [-w] [-k ITEMS] [-c] TEST_OBJECT_RECORD_ID SIM_FN" << endl;
+          return -1;
+        }
+    }
+
+  if (argc - optind != 2)
     {
-      cerr << "Usage: ttt_sim TEST_OBJECT_RECORD_ID SIM_FN" << endl;
+      cerr << "Usage: ttt_sim [-f] [-e [-s SECONDS] [-j JITTER_MS] [-l LOSS] [-m RATE]] [-r] [-w] [-k ITEMS] [-c] TEST_OBJECT_RECORD_ID SIM_FN" << endl;
       return -1;
     }
 
-  to_id = atoi (argv[1]);
+  vector<int> to_ids;
+  istringstream ids (argv[optind]);
+  string id;
+  while (getline (ids, id, ','))
+    to_ids.push_back (atoi (id.c_str ()));
+  if (! to_ids.empty ())
+    to_id = to_ids[0];
+  char *sim_fn = argv[optind + 1];
 
   // read setting with libconfuse
   static char *database = NULL;
@@ -115,22 +202,125 @@ int main (int argc, char **argv)
   bindtextdomain("ttt","./po");
   textdomain ("ttt");
 
+  // the emulator or replay has to outlive the ttt_device in "my"
+  unique_ptr<ttt_emulator> emu;
+  unique_ptr<usb_capture_replay> rep;
+  bool motor_driven = emulate && emu_cfg.motor_rate > 0;
+  if (emulate)
+    emu.reset (new ttt_emulator (motor_driven ? "" : sim_fn, emu_cfg));
+  else if (replay)
+    rep.reset (new usb_capture_replay (sim_fn, 0, ! fast));
+  if (motor_driven)
+    click_emu = emu.get ();
+
   //class ttt my (print_indicated_torque, print_nominal_torque, print_peak_torque, print_instruction, print_step, print_result, "ttt_certify.db");
-  class ttt my (NULL, NULL, NULL, NULL, print_step, print_result, database, start_peak_torque_factor, stop_peak_torque_factor);
+  class ttt my (NULL, motor_driven ? set_click_torque : NULL, NULL, NULL, print_step, print_result, database, start_peak_torque_factor, stop_peak_torque_factor);
+  my.set_motor_driven (motor_driven);
 
   my.load_test_person (1);
   my.load_test_object (to_id);
   my.load_torque_tester ();
 
-  my.connect_measurement_input (argv[2]);
-  cout << "Used simulation file = " << argv[2] << endl;
-  my.start_sequencer_ISO6789 (21.23, 34.56, false, false);
+  my.set_headless (fast);
+  if (emu || rep)
+    my.connect_TTT ();
+  else
+    my.connect_measurement_input (sim_fn, fast? REPLAY_FAST : REPLAY_REALTIME);
+  cout << "Used simulation file = " << sim_fn << endl;
+
+  if (kill_after_items > 0)
+    my.add_event_listener (count_items, 0);
 
   try
     {
-      do
-        usleep(100e3);
-      while (my.run ());
+      int resume_id = 0;
+      if (resume)
+        {
+          int resume_tp_id, resume_to_id;
+          resume_id = my.find_unfinished_measurement (resume_tp_id, resume_to_id);
+          if (! resume_id)
+            throw runtime_error ("no unfinished measurement");
+        }
+
+      if (worker_thread)
+        {
+          ttt_worker w (&my, 0, 0, fast ? 0 : TTT_WORKER_PERIOD);
+          ttt_command c (TTT_CMD_START_ISO6789);
+          if (resume_id)
+            {
+              c.type = TTT_CMD_RESUME;
+              c.measurement_id = resume_id;
+            }
+          else if (to_ids.size () > 1)
+            {
+              c.type = TTT_CMD_START_ISO6789_BATCH;
+              c.test_object_ids = to_ids;
+            }
+          c.temperature = 21.23;
+          c.humidity = 34.56;
+          w.post (c);
+
+          // published after the report
+          bool stopped = false;
+          bool stop_posted = false;
+          vector<ttt_event> ev;
+          while (! stopped)
+            {
+              usleep (10e3);
+              if (emu && ! stop_posted && emu->end_of_log ())
+                {
+                  cerr << "ERROR: end of " << sim_fn << endl;
+                  w.post (ttt_command (TTT_CMD_STOP));
+                  stop_posted = true;
+                }
+              ev.clear ();
+              w.poll_events (ev);
+              for (unsigned int k = 0; k < ev.size (); ++k)
+                {
+                  if (ev[k].type == TTT_EVENT_SEQUENCER_STOPPED)
+                    stopped = true;
+                  else if (ev[k].type == TTT_EVENT_ITEM_ACCEPTED)
+                    cout << "worker: accepted " << ev[k].text << " peak=" << ev[k].value << endl;
+                  else if (ev[k].type == TTT_EVENT_ERROR)
+                    throw runtime_error (ev[k].text);
+                }
+            }
+        }
+      else
+        {
+          if (resume_id)
+            my.resume_sequencer (resume_id);
+          else if (to_ids.size () > 1)
+            my.start_sequencer_ISO6789_batch (to_ids, 21.23, 34.56, false, false);
+          else
+            my.start_sequencer_ISO6789 (21.23, 34.56, false, false);
+          bool emu_confirmation = false;
+          do
+            {
+              if (! fast)
+                usleep(100e3);
+              // the recorded confirmation is held as long as in the log
+              if (emu && emu->confirmation () != emu_confirmation)
+                {
+                  emu_confirmation = ! emu_confirmation;
+                  if (emu_confirmation)
+                    my.set_confirmation ();
+                  else
+                    my.reset_confirmation ();
+                }
+              // the confirmations and the stop of the captured run
+              vector<unsigned char> e;
+              if (rep && rep->poll_host_event (e))
+                my.replay_capture_event (e);
+              // like EOF of a direct replay
+              if (emu && emu->end_of_log ())
+                {
+                  cerr << "ERROR: end of " << sim_fn << endl;
+                  my.abort_sequencer ();
+                }
+            }
+          while (my.run ());
+        }
 
       my.print_result ();
     }